@@ -0,0 +1,715 @@
+/**
+ * Host runnable benchmark for the BCM encoder. Does not touch real GPIO and does not
+ * need the GPU or video libraries, so it runs on any linux box.
+ * To compile and run:
+ * make bench
+ * # or by hand
+ * gcc -O3 -std=gnu2x -ffast-math -DNDEBUG=1 -Iinclude bench.c src/util.c src/pixels.c src/rpihub75.c src/workers.c src/gpio.c src/realtime.c -o encoder_bench -lpthread -lrt -lm
+ * ./encoder_bench -n 20 -a assets > bench.json
+ *
+ * Sweeps bit depth, port count, chain length, pixel order and the pin spread tables
+ * against the transpose kernels (scene_info.bcm_pin_spread) over a synthetic
+ * gradient and every PNG in the assets directory (RGB order only for the PNGs, pixel
+ * order only changes which kernel is selected, not the work it does). The gradient is
+ * also encoded as IMAGE_FORMAT_RGB16 and IMAGE_FORMAT_RGB16F, to compare the 16 bit
+ * and half float paths with the 8 bit one. Every frame changes every row so the
+ * unchanged row skip never kicks in.
+ *
+ * Reports as JSON on stdout:
+ *  - tone_map: tone_map_rgb_bits() and tone_map_rgb_bits_deep() build time per bit depth
+ *  - encode:   map_byte_image_to_bcm() on one encode thread (row hashing, the row kernels
+ *              and the lookup table check) and the row kernels alone, in ns per pixel,
+ *              MB/s of image data in and frames per second
+ *  - scanout:  render_forever() driving a simulated pi 4 and pi 5 GPIO (see gpio_sim_create())
+ *              from BCM_LAYOUT_PLANE and prebaked BCM_LAYOUT_STREAM / BCM_LAYOUT_SET_CLEAR buffers, and 12 binary
+ *              weighted planes (BCM_WEIGHT_BINARY), in GPIO writes per second, full frames (every bit plane) per second and the
+ *              frame time spread and worst row from scene->scanout_stats. each configuration runs until
+ *              -n full frames are published, configurations that do not get there are skipped
+ *  - uniformity: how evenly a simulated pi 5 emits the gradient over each refresh for every bit
+ *              plane order (scene->bcm_plane_order), see gpio_sim_uniformity(). lower is less flicker
+ *  - color_lut: map_byte_image_to_bcm() of the gradient on a 384x192 scene through a 17^3 and 33^3
+ *              identity scene->color_lut, and the overhead against the same scene without one
+ *
+ * progress and errors go to stderr
+ */
+#include <dirent.h>
+#include <math.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/param.h>
+#include <rpihub75.h>
+#include <util.h>
+#include <pixels.h>
+#include <workers.h>
+#include <gpio.h>
+
+#define STB_IMAGE_IMPLEMENTATION
+#define STBI_ONLY_PNG
+#include <stb_image.h>
+
+// panel size used for every benchmark, chains are added to the width, ports to the height
+#define BENCH_PANEL_WIDTH 64
+#define BENCH_PANEL_HEIGHT 64
+// largest chain length swept, sizes the source images
+#define BENCH_MAX_CHAINS 8
+#define BENCH_MAX_PORTS 3
+#define BENCH_MAX_SOURCES 32
+// longest a simulated scanout may take to publish the requested frames before the config is skipped
+#define BENCH_SCANOUT_TIMEOUT_S 120
+
+static const uint8_t bench_depths[] = {8, 16, 24, 32, 48, 64};
+static const uint8_t bench_chains[] = {1, 2, 4, 8};
+static const char *bench_order_names[] = {"RGB", "RBG", "BGR"};
+static const char *bench_format_names[] = {"rgb8", "rgb16", "rgb16f"};
+
+
+/**
+ * @brief one source image, scaled to the largest benchmarked scene
+ */
+typedef struct {
+    char name[64];
+    uint8_t *pixels;
+} bench_source;
+
+
+/**
+ * @brief monotonic time in nanoseconds
+ */
+static inline double bench_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+
+/**
+ * @brief fill a width x height RGB image with a gradient,
+ * red across, green down, blue along the diagonal
+ */
+static uint8_t *bench_gradient(const uint16_t width, const uint16_t height) {
+    uint8_t *pixels = malloc((size_t)width * height * 3);
+    if (pixels == NULL) {
+        die("unable to allocate gradient\n");
+    }
+
+    for (uint16_t y=0; y<height; y++) {
+        for (uint16_t x=0; x<width; x++) {
+            uint8_t *pixel = pixels + ((size_t)y * width + x) * 3;
+            pixel[0] = (x * 255) / (width - 1);
+            pixel[1] = (y * 255) / (height - 1);
+            pixel[2] = ((x + y) * 255) / (width + height - 2);
+        }
+    }
+    return pixels;
+}
+
+
+/**
+ * @brief load a PNG and nearest neighbor scale it to width x height RGB
+ * @return NULL if the file could not be read
+ */
+static uint8_t *bench_load_png(const char *filename, const uint16_t width, const uint16_t height) {
+    int png_width, png_height, channels;
+    uint8_t *png = stbi_load(filename, &png_width, &png_height, &channels, 3);
+    if (png == NULL) {
+        fprintf(stderr, "skipping %s: %s\n", filename, stbi_failure_reason());
+        return NULL;
+    }
+
+    uint8_t *pixels = malloc((size_t)width * height * 3);
+    if (pixels == NULL) {
+        die("unable to allocate image for %s\n", filename);
+    }
+    for (uint16_t y=0; y<height; y++) {
+        const uint8_t *src_row = png + (size_t)((y * png_height) / height) * png_width * 3;
+        for (uint16_t x=0; x<width; x++) {
+            memcpy(pixels + ((size_t)y * width + x) * 3, src_row + (size_t)((x * png_width) / width) * 3, 3);
+        }
+    }
+    stbi_image_free(png);
+    return pixels;
+}
+
+
+/**
+ * @brief load the gradient and every PNG in dir
+ * @return number of sources loaded
+ */
+static int bench_load_sources(const char *dir, bench_source *sources, const uint16_t width, const uint16_t height) {
+    int count = 0;
+    snprintf(sources[count].name, sizeof(sources[count].name), "gradient");
+    sources[count++].pixels = bench_gradient(width, height);
+
+    DIR *assets = opendir(dir);
+    if (assets == NULL) {
+        fprintf(stderr, "unable to open %s, benchmarking the gradient only\n", dir);
+        return count;
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(assets)) != NULL && count < BENCH_MAX_SOURCES) {
+        const size_t len = strlen(entry->d_name);
+        if (len < 5 || strcasecmp(entry->d_name + len - 4, ".png") != 0) {
+            continue;
+        }
+        char filename[PATH_MAX];
+        snprintf(filename, sizeof(filename), "%s/%s", dir, entry->d_name);
+        uint8_t *pixels = bench_load_png(filename, width, height);
+        if (pixels == NULL) {
+            continue;
+        }
+        snprintf(sources[count].name, sizeof(sources[count].name), "%.*s", (int)(len - 4), entry->d_name);
+        sources[count++].pixels = pixels;
+    }
+    closedir(assets);
+    return count;
+}
+
+
+/**
+ * @brief scene for one benchmark configuration, the same defaults as default_scene()
+ * without parsing the command line or allocating locked buffers
+ */
+static void bench_scene(scene_info *scene, const uint8_t bit_depth, const uint8_t num_ports, const uint8_t num_chains, const enum pixel_order_e pixel_order, const enum bcm_layout_e layout, const enum image_format_e image_format) {
+    memset(scene, 0, sizeof(scene_info));
+    scene->panel_width = BENCH_PANEL_WIDTH;
+    scene->panel_height = BENCH_PANEL_HEIGHT;
+    scene->num_chains = num_chains;
+    scene->num_ports = num_ports;
+    scene->width = BENCH_PANEL_WIDTH * num_chains;
+    scene->height = BENCH_PANEL_HEIGHT * num_ports;
+    scene->stride = 3;
+    scene->bit_depth = bit_depth;
+    scene->pixel_order = pixel_order;
+    scene->gamma = GAMMA;
+    scene->red_gamma = RED_GAMMA_SCALE;
+    scene->green_gamma = GREEN_GAMMA_SCALE;
+    scene->blue_gamma = BLUE_GAMMA_SCALE;
+    scene->red_linear = RED_SCALE;
+    scene->green_linear = GREEN_SCALE;
+    scene->blue_linear = BLUE_SCALE;
+    scene->oe_brightness = true;
+    scene->brightness = 200;
+    scene->bcm_layout = layout;
+    scene->bcm_weight = BCM_WEIGHT_LINEAR;
+    scene->bcm_lsb_ns = BCM_LSB_NS;
+    scene->bcm_fraction_bits = 0;
+    scene->bcm_plane_order = BCM_ORDER_SEQUENTIAL;
+    scene->bcm_pin_spread = !BCM_SIMD;
+    scene->encode_threads = 1;
+    scene->panel_layout = PANEL_LAYOUT_NONE;
+    scene->image_format = image_format;
+    scene->tone_mapper = copy_tone_mapperF;
+    scene->bcm_mapper = map_byte_image_to_bcm;
+
+    const size_t words = bcm_buffer_words(scene);
+    scene->bcm_signalA = calloc(words, sizeof(uint32_t));
+    scene->bcm_signalB = calloc(words, sizeof(uint32_t));
+    scene->bcm_signalC = calloc(words, sizeof(uint32_t));
+    scene->image = malloc((size_t)scene->width * scene->height * image_pixel_bytes(scene));
+    if (scene->bcm_signalA == NULL || scene->bcm_signalB == NULL || scene->bcm_signalC == NULL || scene->image == NULL) {
+        die("unable to allocate %zu bcm words\n", words);
+    }
+}
+
+static void bench_free_scene(scene_info *scene) {
+    free(scene->bcm_signalA);
+    free(scene->bcm_signalB);
+    free(scene->bcm_signalC);
+    free(scene->image);
+}
+
+
+/**
+ * @brief IEEE half float of a value in 0.0 - 1.0, rounded down
+ */
+static uint16_t bench_half(const float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    const int32_t exponent = (int32_t)((bits >> 23) & 0xFF) - 127 + 15;
+    if (value <= 0.0f) {
+        return 0;
+    }
+    // subnormals are mantissa * 2^-24
+    if (exponent <= 0) {
+        return (uint16_t)(value * 16777216.0f);
+    }
+    return (uint16_t)((exponent << 10) | ((bits >> 13) & 0x3FF));
+}
+
+/**
+ * @brief crop the source image to the scene size, converted to scene->image_format
+ */
+static void bench_copy_source(scene_info *scene, const uint8_t *pixels, const uint16_t source_width) {
+    const size_t row_bytes = (size_t)scene->width * 3;
+    for (uint16_t y=0; y<scene->height; y++) {
+        const uint8_t *src = pixels + (size_t)y * source_width * 3;
+        if (scene->image_format == IMAGE_FORMAT_RGB8) {
+            memcpy(scene->image + y * row_bytes, src, row_bytes);
+            continue;
+        }
+        uint16_t *dst = (uint16_t *)scene->image + y * row_bytes;
+        for (size_t i=0; i<row_bytes; i++) {
+            dst[i] = (scene->image_format == IMAGE_FORMAT_RGB16) ? src[i] * 257 : bench_half(src[i] / 255.0f);
+        }
+    }
+}
+
+
+/**
+ * @brief change the first pixel of every image row so no row is skipped as unchanged
+ */
+static inline void bench_touch_rows(scene_info *scene) {
+    const size_t row_bytes = (size_t)scene->width * image_pixel_bytes(scene);
+    for (uint16_t y=0; y<scene->height; y++) {
+        scene->image[y * row_bytes]++;
+    }
+}
+
+
+/**
+ * @brief time map_byte_image_to_bcm() over frames frames
+ * @return nanoseconds per frame
+ */
+static double bench_map_frames(scene_info *scene, const int frames) {
+    // first frames build the lookup table and select the kernels
+    map_byte_image_to_bcm(scene, NULL);
+    bench_touch_rows(scene);
+    map_byte_image_to_bcm(scene, NULL);
+
+    const double start = bench_now();
+    for (int i=0; i<frames; i++) {
+        bench_touch_rows(scene);
+        map_byte_image_to_bcm(scene, NULL);
+    }
+    const double elapsed = (bench_now() - start) / frames;
+
+    if (scene->bcm_rows_skipped != 0) {
+        fprintf(stderr, "warning: %d rows skipped as unchanged, timing is not of a full frame\n", scene->bcm_rows_skipped);
+    }
+    return elapsed;
+}
+
+
+/**
+ * @brief time the selected row kernel alone over every row of frames frames
+ * @return nanoseconds per frame
+ */
+static double bench_kernel_frames(scene_info *scene, const int frames) {
+    float quant_errors[768];
+    bcm_row_args args;
+    bcm_build_row_args(scene, &args);
+    const bcm_row_fn kernel = bcm_select_row_kernel(&args);
+    void *bits = (scene->image_format == IMAGE_FORMAT_RGB8) ? tone_map_rgb_bits(scene, scene->bit_depth, quant_errors) : tone_map_rgb_bits_deep(scene, scene->bit_depth);
+    void *spread = (args.pin_spread) ? bcm_build_spread_lut(&args, bits) : NULL;
+    const void *table = (spread != NULL) ? spread : bits;
+
+    const uint16_t rows = scene->panel_height / 2;
+    const uint32_t row_stride = args.width * args.stride;
+    const uint32_t bcm_row = args.width * args.pixel_stride;
+
+    double start = 0;
+    // one untimed frame to warm the caches
+    for (int i=-1; i<frames; i++) {
+        if (i == 0) {
+            start = bench_now();
+        }
+        for (uint16_t y=0; y<rows; y++) {
+            kernel(&args, table, scene->bcm_signalA + y * bcm_row, scene->image + y * row_stride, NULL, NULL);
+        }
+    }
+    const double elapsed = (bench_now() - start) / frames;
+
+    free(spread);
+    free(bits);
+    return elapsed;
+}
+
+
+/**
+ * @brief time the lookup table builds for every benchmarked bit depth
+ */
+static void bench_tone_map(const int frames) {
+    float quant_errors[768];
+    scene_info scene;
+
+    printf("  \"tone_map\": [\n");
+    for (size_t d=0; d<sizeof(bench_depths); d++) {
+        bench_scene(&scene, bench_depths[d], 1, 1, PIXEL_ORDER_RGB, BCM_LAYOUT_PLANE, IMAGE_FORMAT_RGB8);
+
+        double start = bench_now();
+        for (int i=0; i<frames; i++) {
+            free(tone_map_rgb_bits(&scene, scene.bit_depth, quant_errors));
+        }
+        const double rgb8 = (bench_now() - start) / frames;
+
+        // the deep table is only built for the 16 bit formats
+        scene.image_format = IMAGE_FORMAT_RGB16;
+        start = bench_now();
+        for (int i=0; i<frames; i++) {
+            free(tone_map_rgb_bits_deep(&scene, scene.bit_depth));
+        }
+        const double deep = (bench_now() - start) / frames;
+
+        printf("    {\"bit_depth\": %d, \"rgb8_us\": %.3f, \"deep_us\": %.3f}%s\n",
+            scene.bit_depth, rgb8 / 1e3, deep / 1e3, (d + 1 < sizeof(bench_depths)) ? "," : "");
+        bench_free_scene(&scene);
+    }
+    printf("  ],\n");
+}
+
+
+/**
+ * @brief print one encode result as JSON
+ */
+static void bench_print_result(const scene_info *scene, const char *source, const double map_ns, const double kernel_ns, const bool first) {
+    const double pixels = (double)scene->width * scene->height;
+    const double bytes = pixels * image_pixel_bytes(scene);
+    printf("%s    {\"source\": \"%s\", \"format\": \"%s\", \"bit_depth\": %d, \"ports\": %d, \"chains\": %d, \"pixel_order\": \"%s\", "
+        "\"pin_spread\": %d, \"width\": %d, \"height\": %d, "
+        "\"ns_per_pixel\": %.3f, \"mb_per_s\": %.1f, \"fps\": %.1f, "
+        "\"kernel_ns_per_pixel\": %.3f, \"kernel_mb_per_s\": %.1f, \"kernel_fps\": %.1f}",
+        first ? "" : ",\n", source, bench_format_names[scene->image_format], scene->bit_depth, scene->num_ports, scene->num_chains,
+        bench_order_names[scene->pixel_order], scene->bcm_pin_spread, scene->width, scene->height,
+        map_ns / pixels, bytes * 1e3 / map_ns, 1e9 / map_ns,
+        kernel_ns / pixels, bytes * 1e3 / kernel_ns, 1e9 / kernel_ns);
+}
+
+
+static void *bench_render(void *arg) {
+    render_forever((scene_info *)arg);
+    return NULL;
+}
+
+/**
+ * @brief run render_forever on its own thread until frames full frames are published to
+ * scene->scanout_stats, then stop it
+ *
+ * @param timing the published timing after the last frame
+ * @param elapsed nanoseconds the scanout ran for
+ * @return false if fewer than frames frames were published within BENCH_SCANOUT_TIMEOUT_S
+ */
+static bool bench_run_scanout(scene_info *scene, const uint64_t frames, scanout_timing_t *timing, double *elapsed) {
+    // allocated here so it can be polled from the first frame, render_forever uses it as is
+    scene->scanout_stats = (scanout_stats_t *)calloc(1, sizeof(scanout_stats_t));
+    if (scene->scanout_stats == NULL) {
+        die("unable to allocate scanout stats\n");
+    }
+    scene->do_render = true;
+
+    pthread_t thread;
+    const double start = bench_now();
+    if (pthread_create(&thread, NULL, bench_render, scene) != 0) {
+        die("unable to start the scanout thread\n");
+    }
+    bool published = false;
+    while (bench_now() - start < BENCH_SCANOUT_TIMEOUT_S * 1e9) {
+        published = scanout_stats_read(scene->scanout_stats, timing) && timing->frames >= frames;
+        if (published) {
+            break;
+        }
+        usleep(1000);
+    }
+    scene->do_render = false;
+    pthread_join(thread, NULL);
+    *elapsed = bench_now() - start;
+
+    // frames published between the last read and the stop are counted against the full run
+    return published && scanout_stats_read(scene->scanout_stats, timing);
+}
+
+/**
+ * @brief one simulated scanout configuration
+ */
+typedef struct {
+    uint8_t version;
+    enum bcm_layout_e layout;
+    enum bcm_weight_e weight;
+    uint8_t bit_depth;
+} bench_scanout_config;
+
+static const bench_scanout_config bench_scanouts[] = {
+    {4, BCM_LAYOUT_PLANE,     BCM_WEIGHT_LINEAR, 32},
+    {5, BCM_LAYOUT_PLANE,     BCM_WEIGHT_LINEAR, 32},
+    {4, BCM_LAYOUT_STREAM,    BCM_WEIGHT_LINEAR, 32},
+    {5, BCM_LAYOUT_STREAM,    BCM_WEIGHT_LINEAR, 32},
+    {4, BCM_LAYOUT_SET_CLEAR, BCM_WEIGHT_LINEAR, 32},
+    {4, BCM_LAYOUT_PLANE,     BCM_WEIGHT_BINARY, 12},
+    {5, BCM_LAYOUT_PLANE,     BCM_WEIGHT_BINARY, 12}
+};
+
+/**
+ * @brief run the scanout loop against a simulated GPIO that only counts writes
+ */
+static void bench_scanout(const int frames) {
+    const size_t configs = sizeof(bench_scanouts) / sizeof(bench_scanouts[0]);
+    int printed = 0;
+    printf("  \"scanout\": [\n");
+    for (size_t v=0; v<configs; v++) {
+        const bench_scanout_config *config = &bench_scanouts[v];
+        scene_info scene;
+        bench_scene(&scene, config->bit_depth, BENCH_MAX_PORTS, 4, PIXEL_ORDER_RGB, config->layout, IMAGE_FORMAT_RGB8);
+        scene.bcm_weight = config->weight;
+        gpio_sim_t *sim = gpio_sim_create(config->version, 0);
+        scene.gpio_backend = &sim->backend;
+
+        // frame time spread and worst row as measured by render_forever
+        scanout_timing_t timing;
+        double elapsed;
+        const char *layout = (config->layout == BCM_LAYOUT_STREAM) ? "stream" : (config->layout == BCM_LAYOUT_SET_CLEAR) ? "setclear" : "plane";
+        if (!bench_run_scanout(&scene, frames, &timing, &elapsed) || sim->writes == 0 || timing.ticks_per_second == 0) {
+            fprintf(stderr, "skipping %s %s scanout: %llu of %d frames published in %ds\n", sim->backend.name, layout,
+                (unsigned long long)timing.frames, frames, BENCH_SCANOUT_TIMEOUT_S);
+            free(scene.scanout_stats);
+            gpio_sim_free(sim);
+            bench_free_scene(&scene);
+            continue;
+        }
+        const double tick_us = 1e6 / timing.ticks_per_second;
+        const double frame_mean = (double)timing.frame_sum / timing.frames;
+        const double frame_sd = sqrt(MAX(timing.frame_sum_sq / timing.frames - frame_mean * frame_mean, 0));
+
+        printf("%s    {\"gpio\": \"%s\", \"layout\": \"%s\", \"weight\": \"%s\", \"bit_depth\": %d, \"ports\": %d, \"chains\": %d, "
+            "\"writes_per_s\": %.0f, \"ns_per_write\": %.3f, \"fps\": %.1f, "
+            "\"frame_mean_us\": %.1f, \"frame_jitter_us\": %.1f, \"worst_row_us\": %.1f, \"stalls\": %llu}",
+            (printed++ > 0) ? ",\n" : "", sim->backend.name, layout,
+            (config->weight == BCM_WEIGHT_BINARY) ? "binary" : "linear",
+            scene.bit_depth, scene.num_ports, scene.num_chains,
+            sim->writes * 1e9 / elapsed, elapsed / sim->writes, timing.frames * 1e9 / elapsed,
+            frame_mean * tick_us, frame_sd * tick_us, timing.row_max * tick_us, (unsigned long long)timing.stalls);
+        free(scene.scanout_stats);
+        gpio_sim_free(sim);
+        bench_free_scene(&scene);
+    }
+    printf("\n  ],\n");
+}
+
+
+/**
+ * @brief one bit plane order configuration
+ */
+typedef struct {
+    enum bcm_weight_e weight;
+    uint8_t bit_depth;
+    enum bcm_plane_order_e order;
+} bench_uniformity_config;
+
+static const bench_uniformity_config bench_uniformities[] = {
+    {BCM_WEIGHT_LINEAR, 32, BCM_ORDER_SEQUENTIAL},
+    {BCM_WEIGHT_LINEAR, 32, BCM_ORDER_INTERLEAVED},
+    {BCM_WEIGHT_LINEAR, 32, BCM_ORDER_BIT_REVERSED},
+    {BCM_WEIGHT_BINARY, 12, BCM_ORDER_SEQUENTIAL},
+    {BCM_WEIGHT_BINARY, 12, BCM_ORDER_INTERLEAVED},
+    {BCM_WEIGHT_BINARY, 12, BCM_ORDER_BIT_REVERSED}
+};
+static const char *bench_plane_order_names[] = {"sequential", "interleaved", "bitreversed"};
+
+// waveform writes recorded for the uniformity replay, a few frames of one 64 pixel chain
+#define BENCH_UNIFORMITY_WRITES (1 << 21)
+// time slices each frame is split into
+#define BENCH_UNIFORMITY_BINS 16
+
+/**
+ * @brief scan the gradient out of a simulated pi 5 and replay the waveform log to measure
+ * how evenly the light of each refresh is spread over time
+ */
+static void bench_uniformity(const int frames, const uint8_t *pixels, const uint16_t source_width) {
+    const size_t configs = sizeof(bench_uniformities) / sizeof(bench_uniformities[0]);
+    int printed = 0;
+    printf("  \"uniformity\": [\n");
+    for (size_t v=0; v<configs; v++) {
+        const bench_uniformity_config *config = &bench_uniformities[v];
+        scene_info scene;
+        bench_scene(&scene, config->bit_depth, 1, 1, PIXEL_ORDER_RGB, BCM_LAYOUT_PLANE, IMAGE_FORMAT_RGB8);
+        scene.bcm_weight = config->weight;
+        scene.bcm_plane_order = config->order;
+        bench_copy_source(&scene, pixels, source_width);
+        bench_map_frames(&scene, 1);
+
+        // show the frame from the first refresh on
+        const uint32_t *frame = bcm_buffer(&scene, scene.bcm_swap.last);
+        for (uint8_t b=0; b<BCM_BUFFERS; b++) {
+            if (bcm_buffer(&scene, b) != frame) {
+                memcpy(bcm_buffer(&scene, b), frame, bcm_buffer_words(&scene) * sizeof(uint32_t));
+            }
+        }
+
+        gpio_sim_t *sim = gpio_sim_create(5, BENCH_UNIFORMITY_WRITES);
+        scene.gpio_backend = &sim->backend;
+
+        // at least one frame between two frame boundaries, the log keeps the first ones
+        scanout_timing_t timing;
+        double elapsed;
+        if (!bench_run_scanout(&scene, MAX(frames, 2) + 1, &timing, &elapsed)) {
+            fprintf(stderr, "skipping %s uniformity: %llu frames published in %ds\n",
+                bench_plane_order_names[config->order], (unsigned long long)timing.frames, BENCH_SCANOUT_TIMEOUT_S);
+            free(scene.scanout_stats);
+            gpio_sim_free(sim);
+            bench_free_scene(&scene);
+            continue;
+        }
+
+        const double cv = gpio_sim_uniformity(sim, scene.bit_depth * bcm_scan_rows(&scene), BENCH_UNIFORMITY_BINS);
+        printf("%s    {\"weight\": \"%s\", \"bit_depth\": %d, \"order\": \"%s\", \"light_cv\": %.4f}",
+            (printed++ > 0) ? ",\n" : "", (config->weight == BCM_WEIGHT_BINARY) ? "binary" : "linear", scene.bit_depth,
+            bench_plane_order_names[config->order], cv);
+        free(scene.scanout_stats);
+        gpio_sim_free(sim);
+        bench_free_scene(&scene);
+    }
+    printf("\n  ],\n");
+}
+
+
+// the color lut scene, 6 chains and 3 ports of 64x64 panels
+#define BENCH_LUT_CHAINS 6
+static const uint8_t bench_lut_sizes[] = {0, 17, 33};
+
+/**
+ * @brief identity 3D color lut of size^3 lattice points, every color maps to itself
+ */
+static color_lut_t *bench_identity_lut(const uint16_t size) {
+    color_lut_t *lut = (color_lut_t *)calloc(1, sizeof(color_lut_t));
+    const size_t entries = (size_t)size * size * size;
+    if (lut == NULL || (lut->table = (float *)aligned_alloc(16, entries * 4 * sizeof(float))) == NULL) {
+        die("unable to allocate a %d^3 color lut\n", size);
+    }
+    lut->size = size;
+    for (uint8_t c=0; c<3; c++) {
+        lut->domain_min[c] = 0.0f;
+        lut->domain_max[c] = 1.0f;
+    }
+    // red changes fastest, then green, then blue
+    for (size_t i=0; i<entries; i++) {
+        lut->table[i * 4 + 0] = (float)(i % size) / (size - 1);
+        lut->table[i * 4 + 1] = (float)((i / size) % size) / (size - 1);
+        lut->table[i * 4 + 2] = (float)(i / ((size_t)size * size)) / (size - 1);
+        lut->table[i * 4 + 3] = 0.0f;
+    }
+    return lut;
+}
+
+/**
+ * @brief time map_byte_image_to_bcm() on a 384x192 scene of the gradient through identity color luts
+ * of each size in bench_lut_sizes, next to the same scene without a lut (lut_size 0)
+ */
+static void bench_color_lut(const int frames, const uint8_t *pixels, const uint16_t source_width) {
+    const size_t sizes = sizeof(bench_lut_sizes);
+    // held for the whole run, the encoder only rebuilds its cube when the lut pointer changes
+    color_lut_t *luts[sizeof(bench_lut_sizes)];
+    for (size_t l=0; l<sizes; l++) {
+        luts[l] = (bench_lut_sizes[l] > 0) ? bench_identity_lut(bench_lut_sizes[l]) : NULL;
+    }
+
+    printf("  \"color_lut\": [\n");
+    for (size_t d=0; d<sizeof(bench_depths); d++) {
+        double none_ns = 0;
+        for (size_t l=0; l<sizes; l++) {
+            scene_info scene;
+            bench_scene(&scene, bench_depths[d], BENCH_MAX_PORTS, BENCH_LUT_CHAINS, PIXEL_ORDER_RGB, BCM_LAYOUT_PLANE, IMAGE_FORMAT_RGB8);
+            scene.color_lut = luts[l];
+            bench_copy_source(&scene, pixels, source_width);
+
+            const double map_ns = bench_map_frames(&scene, frames);
+            none_ns = (bench_lut_sizes[l] == 0) ? map_ns : none_ns;
+            const double pixels_per_frame = (double)scene.width * scene.height;
+            printf("    {\"bit_depth\": %d, \"width\": %d, \"height\": %d, \"lut_size\": %d, "
+                "\"ns_per_pixel\": %.3f, \"fps\": %.1f, \"overhead\": %.3f}%s\n",
+                scene.bit_depth, scene.width, scene.height, bench_lut_sizes[l],
+                map_ns / pixels_per_frame, 1e9 / map_ns, map_ns / none_ns,
+                (d + 1 < sizeof(bench_depths) || l + 1 < sizes) ? "," : "");
+            bench_free_scene(&scene);
+        }
+    }
+    printf("  ],\n");
+
+    for (size_t l=0; l<sizes; l++) {
+        if (luts[l] != NULL) {
+            free(luts[l]->table);
+            free(luts[l]);
+        }
+    }
+}
+
+
+static void bench_usage(const char *name) {
+    fprintf(stderr, "Usage: %s [-n frames] [-a assets_dir]\n", name);
+    fprintf(stderr, "     -n <frames>  frames timed per configuration (20)\n");
+    fprintf(stderr, "     -a <dir>     directory of PNG images to encode (assets)\n");
+    exit(EXIT_FAILURE);
+}
+
+
+int main(int argc, char **argv) {
+    int frames = 20;
+    const char *assets_dir = "assets";
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:a:")) != -1) {
+        switch (opt) {
+        case 'n':
+            frames = atoi(optarg);
+            break;
+        case 'a':
+            assets_dir = optarg;
+            break;
+        default:
+            bench_usage(argv[0]);
+        }
+    }
+    if (frames < 1) {
+        bench_usage(argv[0]);
+    }
+
+    const uint16_t source_width = BENCH_PANEL_WIDTH * BENCH_MAX_CHAINS;
+    const uint16_t source_height = BENCH_PANEL_HEIGHT * BENCH_MAX_PORTS;
+    bench_source sources[BENCH_MAX_SOURCES];
+    const int num_sources = bench_load_sources(assets_dir, sources, source_width, source_height);
+
+    printf("{\n");
+    printf("  \"frames\": %d, \"simd\": %d, \"panel_width\": %d, \"panel_height\": %d,\n",
+        frames, BCM_SIMD, BENCH_PANEL_WIDTH, BENCH_PANEL_HEIGHT);
+    bench_tone_map(frames);
+    bench_scanout(frames);
+    bench_uniformity(frames, sources[0].pixels, source_width);
+    bench_color_lut(frames, sources[0].pixels, source_width);
+
+    printf("  \"encode\": [\n");
+    int printed = 0;
+    for (int s=0; s<num_sources; s++) {
+        // pixel order only changes the kernel selected and the 16 bit formats only the table
+        // index, sweep them on the gradient alone
+        const int num_orders = (s == 0) ? 3 : 1;
+        const int num_formats = (s == 0) ? 3 : 1;
+        for (int format=0; format<num_formats; format++) {
+            for (size_t d=0; d<sizeof(bench_depths); d++) {
+                for (uint8_t ports=1; ports<=BENCH_MAX_PORTS; ports++) {
+                    for (size_t c=0; c<sizeof(bench_chains); c++) {
+                        for (int order=0; order<num_orders; order++) {
+                            // the pin spread tables against the transpose kernels, see scene_info.bcm_pin_spread.
+                            // the 16 bit formats have no pin spread kernels
+                            const int num_spreads = (format == IMAGE_FORMAT_RGB8) ? 2 : 1;
+                            for (int pin_spread=0; pin_spread<num_spreads; pin_spread++) {
+                                scene_info scene;
+                                bench_scene(&scene, bench_depths[d], ports, bench_chains[c], order, BCM_LAYOUT_PLANE, format);
+                                scene.bcm_pin_spread = pin_spread;
+                                bench_copy_source(&scene, sources[s].pixels, source_width);
+
+                                const double map_ns = bench_map_frames(&scene, frames);
+                                const double kernel_ns = bench_kernel_frames(&scene, frames);
+                                bench_print_result(&scene, sources[s].name, map_ns, kernel_ns, printed++ == 0);
+                                bench_free_scene(&scene);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+        fprintf(stderr, "benchmarked %s\n", sources[s].name);
+        free(sources[s].pixels);
+    }
+    printf("\n  ]\n}\n");
+
+    workers_stop();
+    return 0;
+}
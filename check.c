@@ -0,0 +1,437 @@
+/**
+ * Host runnable check of the scanout waveforms. Does not touch real GPIO and does not
+ * need the GPU or video libraries, so it runs on any linux box.
+ * To compile and run:
+ * make check
+ * # or by hand
+ * gcc -O3 -std=gnu2x -ffast-math -DNDEBUG=1 -DCONSOLE_DEBUG=0 -Iinclude check.c src/util.c src/pixels.c src/rpihub75.c src/workers.c src/gpio.c src/realtime.c -o scanout_check -lpthread -lrt -lm
+ * ./scanout_check
+ *
+ * Encodes a random image, scans it out of a simulated pi 4 and pi 5 GPIO (see gpio_sim_create())
+ * from every bcm layout and replays the waveform log through gpio_sim_decode(). For every latch
+ * of every complete frame in the log it asserts:
+ *  - the row address on the address pins follows the row address sequence, row_to_address()
+ *    of each row in the order bcm_plane_schedule() shows them
+ *  - exactly one shift width of clocks were shifted in since the previous latch
+ *  - the color pins at each clock are the pixels of that row and bit plane in a
+ *    BCM_LAYOUT_PLANE encode of the same image
+ *  - BCM_WEIGHT_LINEAR: the display is on (OE low) for the whole shift after a full plane
+ *    is latched, and for 1 / 2^bits and 2 / 2^bits of it after the fraction planes
+ *    bit_depth - 1 and bit_depth - 2 (scene_info.bcm_fraction_bits). the OE duty is counted in
+ *    clocks, the unit the scanout and the stream encoder gate OE in. brightness is applied in
+ *    the lookup table (oe_brightness off) so every full plane keeps the display on for every clock
+ *
+ * prints one line per configuration, exits with 1 if any configuration fails
+ */
+#include <pthread.h>
+#include <time.h>
+#include <sys/param.h>
+#include <rpihub75.h>
+#include <util.h>
+#include <pixels.h>
+#include <workers.h>
+#include <gpio.h>
+
+// scene used for every configuration, chains are added to the width, ports to the height
+#define CHECK_PANEL_WIDTH 64
+#define CHECK_PANEL_HEIGHT 64
+#define CHECK_CHAINS 2
+#define CHECK_PORTS 2
+// frames the scanout runs for, the log holds about this many
+#define CHECK_FRAMES 3
+// longest a simulated scanout may take to publish CHECK_FRAMES frames
+#define CHECK_TIMEOUT_S 60
+// mismatches reported per configuration
+#define CHECK_MAX_REPORTS 8
+
+// the pins shifted into the panel, everything but the address, OE, latch and clock
+#define CHECK_COLOR_MASK (GPIO_SCANOUT_MASK & ~(ADDRESS_LINES_MASK | PIN_OE | PIN_LATCH | PIN_CLK))
+
+static const char *check_layout_names[] = {"pixel", "plane", "stream", "setclear"};
+static const char *check_order_names[] = {"sequential", "interleaved", "bitreversed"};
+
+
+/**
+ * @brief one simulated scanout configuration
+ */
+typedef struct {
+    uint8_t version;
+    enum bcm_layout_e layout;
+    enum bcm_weight_e weight;
+    uint8_t bit_depth;
+    enum bcm_plane_order_e order;
+    /** @brief scan_pattern_t.scan, 0 for the standard scan */
+    uint8_t scan;
+    /** @brief scene_info.bcm_fraction_bits */
+    uint8_t fraction_bits;
+} check_config;
+
+static const check_config check_configs[] = {
+    {4, BCM_LAYOUT_PLANE,     BCM_WEIGHT_LINEAR, 32, BCM_ORDER_SEQUENTIAL,   0, 2},
+    {5, BCM_LAYOUT_PLANE,     BCM_WEIGHT_LINEAR, 32, BCM_ORDER_INTERLEAVED,  0, 2},
+    {4, BCM_LAYOUT_PIXEL,     BCM_WEIGHT_LINEAR, 16, BCM_ORDER_BIT_REVERSED, 0, 1},
+    {5, BCM_LAYOUT_PIXEL,     BCM_WEIGHT_LINEAR, 16, BCM_ORDER_SEQUENTIAL,   0, 0},
+    {4, BCM_LAYOUT_STREAM,    BCM_WEIGHT_LINEAR, 32, BCM_ORDER_BIT_REVERSED, 0, 2},
+    {5, BCM_LAYOUT_STREAM,    BCM_WEIGHT_LINEAR, 32, BCM_ORDER_SEQUENTIAL,   0, 2},
+    {5, BCM_LAYOUT_STREAM,    BCM_WEIGHT_LINEAR, 32, BCM_ORDER_INTERLEAVED,  0, 1},
+    {4, BCM_LAYOUT_SET_CLEAR, BCM_WEIGHT_LINEAR, 32, BCM_ORDER_INTERLEAVED,  0, 2},
+    {5, BCM_LAYOUT_SET_CLEAR, BCM_WEIGHT_LINEAR, 32, BCM_ORDER_BIT_REVERSED, 0, 2},
+    {5, BCM_LAYOUT_PLANE,     BCM_WEIGHT_LINEAR, 32, BCM_ORDER_SEQUENTIAL,   8, 2},
+    {4, BCM_LAYOUT_STREAM,    BCM_WEIGHT_LINEAR, 16, BCM_ORDER_INTERLEAVED,  8, 2},
+    {4, BCM_LAYOUT_PLANE,     BCM_WEIGHT_BINARY, 12, BCM_ORDER_SEQUENTIAL,   0, 0},
+    {5, BCM_LAYOUT_PLANE,     BCM_WEIGHT_BINARY, 12, BCM_ORDER_BIT_REVERSED, 0, 0}
+};
+
+
+/**
+ * @brief monotonic time in nanoseconds
+ */
+static inline double check_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+
+/**
+ * @brief scene for one configuration, the same defaults as default_scene() without
+ * parsing the command line or allocating locked buffers
+ */
+static void check_setup_scene(scene_info *scene, const check_config *config, const enum bcm_layout_e layout) {
+    memset(scene, 0, sizeof(scene_info));
+    scene->panel_width = CHECK_PANEL_WIDTH;
+    scene->panel_height = CHECK_PANEL_HEIGHT;
+    scene->num_chains = CHECK_CHAINS;
+    scene->num_ports = CHECK_PORTS;
+    scene->width = CHECK_PANEL_WIDTH * CHECK_CHAINS;
+    scene->height = CHECK_PANEL_HEIGHT * CHECK_PORTS;
+    scene->stride = 3;
+    scene->bit_depth = config->bit_depth;
+    scene->pixel_order = PIXEL_ORDER_RGB;
+    scene->gamma = GAMMA;
+    scene->red_gamma = RED_GAMMA_SCALE;
+    scene->green_gamma = GREEN_GAMMA_SCALE;
+    scene->blue_gamma = BLUE_GAMMA_SCALE;
+    scene->red_linear = RED_SCALE;
+    scene->green_linear = GREEN_SCALE;
+    scene->blue_linear = BLUE_SCALE;
+    // brightness in the lookup table, a full linear plane keeps the display on for the whole shift
+    scene->oe_brightness = false;
+    scene->brightness = 200;
+    scene->bcm_layout = layout;
+    scene->bcm_weight = config->weight;
+    scene->bcm_lsb_ns = BCM_LSB_NS;
+    scene->bcm_fraction_bits = config->fraction_bits;
+    scene->bcm_plane_order = config->order;
+    scene->bcm_pin_spread = !BCM_SIMD;
+    scene->scan_pattern.scan = config->scan;
+    scene->encode_threads = 1;
+    scene->panel_layout = PANEL_LAYOUT_NONE;
+    scene->image_format = IMAGE_FORMAT_RGB8;
+    scene->tone_mapper = copy_tone_mapperF;
+    scene->bcm_mapper = map_byte_image_to_bcm;
+
+    const size_t words = bcm_buffer_words(scene);
+    scene->bcm_signalA = calloc(words, sizeof(uint32_t));
+    scene->bcm_signalB = calloc(words, sizeof(uint32_t));
+    scene->bcm_signalC = calloc(words, sizeof(uint32_t));
+    scene->image = malloc((size_t)scene->width * scene->height * scene->stride);
+    if (scene->bcm_signalA == NULL || scene->bcm_signalB == NULL || scene->bcm_signalC == NULL || scene->image == NULL) {
+        die("unable to allocate %zu bcm words\n", words);
+    }
+    check_scene(scene);
+}
+
+static void check_free_scene(scene_info *scene) {
+    free(scene->bcm_signalA);
+    free(scene->bcm_signalB);
+    free(scene->bcm_signalC);
+    free(scene->image);
+    free(scene->scanout_stats);
+}
+
+
+/**
+ * @brief fill the image with xorshift noise, a new image for each seed
+ */
+static void check_random_image(scene_info *scene, uint32_t seed) {
+    const size_t bytes = (size_t)scene->width * scene->height * scene->stride;
+    seed = seed * 2654435761u + 1;
+    for (size_t i=0; i<bytes; i++) {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        scene->image[i] = seed >> 24;
+    }
+}
+
+/**
+ * @brief encode the scene image and copy the frame to every bcm buffer, so the scanout
+ * shows it from the first refresh on
+ * @return the encoded frame
+ */
+static const uint32_t *check_encode(scene_info *scene) {
+    map_byte_image_to_bcm(scene, NULL);
+    if (scene->bcm_rows_skipped != 0) {
+        die("%d rows skipped as unchanged, the frame is not fully encoded\n", scene->bcm_rows_skipped);
+    }
+
+    uint32_t *frame = bcm_buffer(scene, scene->bcm_swap.last);
+    for (uint8_t b=0; b<BCM_BUFFERS; b++) {
+        if (bcm_buffer(scene, b) != frame) {
+            memcpy(bcm_buffer(scene, b), frame, bcm_buffer_words(scene) * sizeof(uint32_t));
+        }
+    }
+    return frame;
+}
+
+
+static void *check_render(void *arg) {
+    render_forever((scene_info *)arg);
+    return NULL;
+}
+
+/**
+ * @brief run render_forever on its own thread until CHECK_FRAMES frames are published
+ * @return false if they were not published within CHECK_TIMEOUT_S
+ */
+static bool check_run_scanout(scene_info *scene) {
+    scene->scanout_stats = (scanout_stats_t *)calloc(1, sizeof(scanout_stats_t));
+    if (scene->scanout_stats == NULL) {
+        die("unable to allocate scanout stats\n");
+    }
+    scene->do_render = true;
+
+    pthread_t thread;
+    const double start = check_now();
+    if (pthread_create(&thread, NULL, check_render, scene) != 0) {
+        die("unable to start the scanout thread\n");
+    }
+    scanout_timing_t timing;
+    bool published = false;
+    while (!published && check_now() - start < CHECK_TIMEOUT_S * 1e9) {
+        published = scanout_stats_read(scene->scanout_stats, &timing) && timing.frames >= CHECK_FRAMES;
+        usleep(1000);
+    }
+    scene->do_render = false;
+    pthread_join(thread, NULL);
+    return published;
+}
+
+
+/**
+ * @brief expected waveform of one configuration, checked latch by latch by check_latch()
+ */
+typedef struct {
+    const scene_info *scene;
+    /** @brief BCM_LAYOUT_PLANE encode of the same image */
+    const scene_info *reference;
+    const uint32_t *reference_frame;
+    /** @brief bcm_plane_schedule() of the scene */
+    const uint8_t *schedule;
+    /** @brief latches per frame and latches checked, every complete frame in the log */
+    uint32_t frame_latches;
+    uint32_t checked_latches;
+    /** @brief latches seen so far, and the plane of the last one */
+    uint32_t latch;
+    uint8_t shown;
+    /** @brief clocks the display was on for after each plane was latched, and the rows counted */
+    uint64_t on_clocks[MAX_BITS];
+    uint32_t on_rows[MAX_BITS];
+    /** @brief mismatches found */
+    uint32_t errors;
+} check_waveform;
+
+/**
+ * @brief clocks of a row shift the display should stay on for after plane was latched.
+ * the last plane is a fraction plane of 1 / 2^fraction_bits, with 2 or more fraction bits the
+ * one before it of 2 / 2^fraction_bits, see scene_info.bcm_fraction_bits
+ */
+static uint16_t check_on_clocks(const scene_info *scene, const uint8_t plane) {
+    const uint16_t width    = bcm_shift_width(scene);
+    const uint8_t  bits     = scene->bcm_fraction_bits;
+    const uint8_t  from_end = scene->bit_depth - 1 - plane;
+    if (bits >= 1 && from_end == 0) {
+        return width >> bits;
+    }
+    if (bits >= 2 && from_end == 1) {
+        return (2 * width) >> bits;
+    }
+    return width;
+}
+
+/**
+ * @brief report a mismatch, only the first CHECK_MAX_REPORTS of a configuration are printed
+ */
+#define check_fail(wave, ...) do { \
+    if ((wave)->errors++ < CHECK_MAX_REPORTS) { \
+        fprintf(stderr, "    latch %u: ", (wave)->latch); \
+        fprintf(stderr, __VA_ARGS__); \
+    } \
+} while (0)
+
+/**
+ * @brief gpio_latch_fn, compare one latched row against the reference encode
+ */
+static void check_latch(void *arg, const uint8_t address, const uint32_t *shifted, const uint32_t count) {
+    check_waveform *wave = (check_waveform *)arg;
+    const scene_info *scene = wave->scene;
+    const uint8_t  rows  = bcm_scan_rows(scene);
+    const uint16_t width = bcm_shift_width(scene);
+
+    // linear planes show the row latched before this one while this one shifts in, the
+    // display is on for the clocks OE is low at the rising clock edge
+    if (scene->bcm_weight == BCM_WEIGHT_LINEAR && wave->latch > 0 && wave->latch <= wave->checked_latches) {
+        uint16_t on = 0;
+        for (uint32_t x=0; x<count; x++) {
+            on += (shifted[x] & PIN_OE) == 0;
+        }
+        const uint16_t want = check_on_clocks(scene, wave->shown);
+        if (on != want) {
+            check_fail(wave, "display on for %d clocks after plane %d, expected %d\n", on, wave->shown, want);
+        }
+        wave->on_clocks[wave->shown] += on;
+        wave->on_rows[wave->shown]++;
+    }
+    if (wave->latch >= wave->checked_latches) {
+        wave->latch++;
+        return;
+    }
+
+    const uint32_t step  = wave->latch % wave->frame_latches;
+    const uint16_t y     = step % rows;
+    const uint8_t  plane = wave->schedule[step];
+
+    // the address of row y on the address pins, see row_to_address()
+    const uint32_t pins = row_to_address(y, rows);
+    const uint8_t expected =
+        ((pins >> ADDRESS_A) & 1) |
+        (((pins >> ADDRESS_B) & 1) << 1) |
+        (((pins >> ADDRESS_C) & 1) << 2) |
+        (((pins >> ADDRESS_D) & 1) << 3) |
+        (((pins >> ADDRESS_E) & 1) << 4);
+    if (address != expected) {
+        check_fail(wave, "row %d plane %d latched at address %d, expected %d\n", y, plane, address, expected);
+    }
+    if (count != width) {
+        check_fail(wave, "row %d plane %d shifted %u clocks, expected %d\n", y, plane, count, width);
+    }
+
+    const scene_info *reference = wave->reference;
+    const uint32_t *word = wave->reference_frame + (plane * bcm_plane_stride(reference)) + (y * bcm_row_stride(reference));
+    const uint32_t pixel_stride = bcm_pixel_stride(reference);
+    for (uint16_t x=0; x<MIN(count, width); x++) {
+        const uint32_t color = shifted[x] & CHECK_COLOR_MASK;
+        const uint32_t want  = word[x * pixel_stride] & CHECK_COLOR_MASK;
+        if (color != want) {
+            check_fail(wave, "row %d plane %d pixel %d shifted color pins %08x, expected %08x\n", y, plane, x, color, want);
+            break;
+        }
+    }
+    wave->shown = plane;
+    wave->latch++;
+}
+
+/**
+ * @brief mean display on time after plane was latched, in full planes (a whole row shift)
+ */
+static double check_on_time(const check_waveform *wave, const uint8_t plane) {
+    const double full = (double)bcm_shift_width(wave->scene) * wave->on_rows[plane];
+    return (full > 0) ? wave->on_clocks[plane] / full : 0;
+}
+
+
+/**
+ * @brief gpio_latch_fn that only counts, gpio_sim_decode() returns the count
+ */
+static void check_count_latch(void *arg, const uint8_t address, const uint32_t *shifted, const uint32_t count) {
+}
+
+/**
+ * @brief scan one configuration out of a simulated GPIO and check every complete frame in the log
+ * @return true if the waveform matched
+ */
+static bool check_config_waveform(const check_config *config, const uint32_t seed) {
+    scene_info scene, plane;
+    check_setup_scene(&scene, config, config->layout);
+    check_random_image(&scene, seed);
+    const uint32_t *frame = check_encode(&scene);
+
+    // the other layouts are checked against a BCM_LAYOUT_PLANE encode of the same image
+    const bool own_reference = config->layout == BCM_LAYOUT_PLANE;
+    const scene_info *reference = &scene;
+    const uint32_t *reference_frame = frame;
+    if (!own_reference) {
+        check_setup_scene(&plane, config, BCM_LAYOUT_PLANE);
+        memcpy(plane.image, scene.image, (size_t)scene.width * scene.height * scene.stride);
+        reference = &plane;
+        reference_frame = check_encode(&plane);
+    }
+
+    // room for CHECK_FRAMES frames of at most 4 writes per clock and 16 per row
+    const uint8_t  rows  = bcm_scan_rows(&scene);
+    const uint16_t width = bcm_shift_width(&scene);
+    const uint32_t frame_latches = (uint32_t)scene.bit_depth * rows;
+    gpio_sim_t *sim = gpio_sim_create(config->version, (size_t)CHECK_FRAMES * frame_latches * (width * 4 + 16));
+    scene.gpio_backend = &sim->backend;
+
+    uint8_t schedule[frame_latches];
+    bcm_plane_schedule(&scene, schedule);
+
+    check_waveform wave = {
+        .scene = &scene,
+        .reference = reference,
+        .reference_frame = reference_frame,
+        .schedule = schedule,
+        .frame_latches = frame_latches
+    };
+
+    bool passed = check_run_scanout(&scene);
+    if (!passed) {
+        fprintf(stderr, "    scanout did not publish %d frames in %ds\n", CHECK_FRAMES, CHECK_TIMEOUT_S);
+    } else {
+        // the latches of the complete frames in the log, the last frame may be cut off
+        const uint32_t latches = gpio_sim_decode(sim, check_count_latch, NULL);
+        wave.checked_latches = (latches / frame_latches) * frame_latches;
+        if (wave.checked_latches == 0) {
+            fprintf(stderr, "    no complete frame in the waveform log, %u latches of %u\n", latches, frame_latches);
+            passed = false;
+        } else {
+            gpio_sim_decode(sim, check_latch, &wave);
+            passed = wave.errors == 0;
+        }
+    }
+
+    printf("%s %s %s %s %d bits, 1/%d scan, %s, %d fraction bits: %u frames, %u latches checked, %u errors",
+        passed ? "ok  " : "FAIL", sim->backend.name, check_layout_names[config->layout],
+        (config->weight == BCM_WEIGHT_BINARY) ? "binary" : "linear", config->bit_depth, rows,
+        check_order_names[config->order], config->fraction_bits, wave.checked_latches / frame_latches, wave.checked_latches, wave.errors);
+    if (config->fraction_bits > 0) {
+        // the OE on time of the fraction planes, 1 / 2^bits and 2 / 2^bits of a full plane
+        printf(", on time of planes %d / %d: %.4f / %.4f of plane 0",
+            config->bit_depth - 1, config->bit_depth - 2,
+            check_on_time(&wave, config->bit_depth - 1) / check_on_time(&wave, 0),
+            check_on_time(&wave, config->bit_depth - 2) / check_on_time(&wave, 0));
+    }
+    printf("\n");
+
+    gpio_sim_free(sim);
+    check_free_scene(&scene);
+    if (!own_reference) {
+        check_free_scene(&plane);
+    }
+    return passed;
+}
+
+
+int main(int argc, char **argv) {
+    const size_t configs = sizeof(check_configs) / sizeof(check_configs[0]);
+    uint32_t failed = 0;
+    for (size_t c=0; c<configs; c++) {
+        failed += !check_config_waveform(&check_configs[c], c);
+    }
+    printf("%zu of %zu scanout configurations passed\n", configs - failed, configs);
+
+    workers_stop();
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,184 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "rpihub75.h"
+
+#ifndef _HUB75_GPIO_H
+#define _HUB75_GPIO_H 1
+
+/**
+ * @brief the GPIO operations render_forever needs. one backend per pi model that writes
+ * to the mmaped registers, and gpio_sim_create() for a backend that logs every write
+ * so the scanout can run on any linux host. select one with scene->gpio_backend,
+ * NULL detects the pi model.
+ *
+ * the hardware backends are inlined into the scanout loop, any other backend is
+ * called through these pointers
+ */
+typedef struct gpio_backend_t {
+    /** @brief name for log messages */
+    const char *name;
+    /**
+     * @brief pi model whose scanout sequence is used. 5 writes all pins in one op,
+     * 3 and 4 only set and clear pins
+     */
+    uint8_t version;
+    /** @brief true if the backend drives real pins. render_forever sets its thread up for real time for these, see realtime_setup() */
+    bool hardware;
+    /** @brief map the GPIO registers, returns the handle passed to every other op */
+    void *(*map)(const struct gpio_backend_t *backend);
+    /** @brief set GPIO 2-27 to outputs */
+    void (*configure)(const struct gpio_backend_t *backend, void *gpio);
+    /** @brief set every scanout pin to pins, high for 1 bits and low for 0 bits */
+    void (*write)(void *gpio, const uint32_t pins);
+    /** @brief set the pins in mask high, leave the others */
+    void (*set)(void *gpio, const uint32_t mask);
+    /** @brief set the pins in mask low, leave the others */
+    void (*clear)(void *gpio, const uint32_t mask);
+    /** @brief backend state, the gpio_sim_t for simulators */
+    void *context;
+} gpio_backend_t;
+
+extern const gpio_backend_t gpio_backend_pi3;
+extern const gpio_backend_t gpio_backend_pi4;
+extern const gpio_backend_t gpio_backend_pi5;
+
+
+/**
+ * @brief the register ops of the hardware backends. inline so the scanout loop
+ * compiles to plain stores for them
+ */
+static inline __attribute__((always_inline)) void gpio_pi5_write(void *gpio, const uint32_t pins) {
+    uint32_t *RIOBase = (uint32_t *)gpio + RIO5_OFFSET;
+    rio->Out = pins;
+}
+
+static inline __attribute__((always_inline)) void gpio_pi5_set(void *gpio, const uint32_t mask) {
+    uint32_t *RIOBase = (uint32_t *)gpio + RIO5_OFFSET;
+    rioSET->Out = mask;
+}
+
+static inline __attribute__((always_inline)) void gpio_pi5_clear(void *gpio, const uint32_t mask) {
+    uint32_t *RIOBase = (uint32_t *)gpio + RIO5_OFFSET;
+    rioCLR->Out = mask;
+}
+
+// GPSET0 and GPCLR0 of the pi 3 and 4
+static inline __attribute__((always_inline)) void gpio_pi4_set(void *gpio, const uint32_t mask) {
+    ((uint32_t *)gpio)[7] = mask;
+}
+
+static inline __attribute__((always_inline)) void gpio_pi4_clear(void *gpio, const uint32_t mask) {
+    ((uint32_t *)gpio)[10] = mask;
+}
+
+// the pi 3 and 4 have no register to write every pin at once
+static inline __attribute__((always_inline)) void gpio_pi4_write(void *gpio, const uint32_t pins) {
+    gpio_pi4_set(gpio, pins);
+    gpio_pi4_clear(gpio, ~pins & GPIO_SCANOUT_MASK);
+}
+
+
+/**
+ * @brief detect the pi model from /proc/cpuinfo
+ * will die() if this is not a pi 3, 4 or 5
+ *
+ * @return const gpio_backend_t* the hardware backend for this pi
+ */
+const gpio_backend_t *gpio_detect_backend(void);
+
+
+
+/**
+ * @brief the operation a gpio_sim_event_t records
+ */
+enum gpio_op_e {
+    GPIO_OP_WRITE,
+    GPIO_OP_SET,
+    GPIO_OP_CLEAR
+};
+
+/**
+ * @brief one simulated register write
+ */
+typedef struct {
+    /** @brief the value written, the pin levels for GPIO_OP_WRITE, else the mask */
+    uint32_t value;
+    /** @brief level of every pin after the write */
+    uint32_t pins;
+    /** @brief the gpio_op_e of the write */
+    uint8_t op;
+    /** @brief cycle_counter() at the write */
+    uint64_t ticks;
+} gpio_sim_event_t;
+
+/**
+ * @brief memory backed GPIO. records the first capacity writes in a waveform log,
+ * writes past that only update the pin levels and counters
+ */
+typedef struct {
+    /** @brief the backend to point scene->gpio_backend at */
+    gpio_backend_t backend;
+    /** @brief waveform log, the first MIN(writes, capacity) writes */
+    gpio_sim_event_t *log;
+    size_t capacity;
+    /** @brief every write since creation or gpio_sim_reset() */
+    uint64_t writes;
+    /** @brief current level of every pin */
+    uint32_t pins;
+} gpio_sim_t;
+
+/**
+ * @brief create a simulated GPIO backend
+ * will die() if the log can not be allocated
+ *
+ * @param version pi model whose scanout sequence render_forever should run (3, 4 or 5)
+ * @param capacity number of writes to record, 0 to only count writes (throughput runs)
+ * @return gpio_sim_t* release with gpio_sim_free()
+ */
+gpio_sim_t *gpio_sim_create(const uint8_t version, const size_t capacity);
+
+/**
+ * @brief clear the waveform log, the write counter and every pin
+ */
+void gpio_sim_reset(gpio_sim_t *sim);
+
+void gpio_sim_free(gpio_sim_t *sim);
+
+/**
+ * @brief called by gpio_sim_decode() for every rising edge of the latch pin
+ *
+ * @param arg passed through from gpio_sim_decode()
+ * @param address row address on the address pins, bit 0 = ADDRESS_A
+ * @param shifted pin levels at each rising clock edge since the previous latch, oldest first
+ * @param count number of clock edges since the previous latch
+ */
+typedef void (*gpio_latch_fn)(void *arg, const uint8_t address, const uint32_t *shifted, const uint32_t count);
+
+/**
+ * @brief replay the waveform log through a model of the HUB75 shift registers
+ * so a scanout can be checked against the expected shift / latch sequence, see check.c
+ *
+ * @param sim simulator to replay
+ * @param latch called for every latch
+ * @param arg passed through to latch
+ * @return uint32_t number of latches in the log
+ */
+uint32_t gpio_sim_decode(const gpio_sim_t *sim, gpio_latch_fn latch, void *arg);
+
+/**
+ * @brief how evenly the panel emits light over each refresh, from the waveform log.
+ * replays the log through the same shift register model as gpio_sim_decode(): while OE is
+ * low the panel shows the lit color bits of the last latch. every frame_latches latches
+ * are one frame, split into bins equal time slices by the logged cycle_counter() ticks
+ *
+ * @param sim simulator to replay, created with a capacity for a few frames
+ * @param frame_latches latches per frame, bit_depth * bcm_scan_rows()
+ * @param bins time slices per frame
+ * @return double coefficient of variation (stddev / mean) of the light in each slice, averaged over
+ * every complete lit frame. 0 for constant light, larger for more flicker. 0 if no frame is complete
+ */
+double gpio_sim_uniformity(const gpio_sim_t *sim, const uint32_t frame_latches, const uint16_t bins);
+
+#endif
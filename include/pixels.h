@@ -29,60 +29,250 @@
 
 
 /**
- * @brief function definition to function that maps RGB image data
- * to BCM data for shifting out to GPIO
+ * @brief per scene geometry for the bcm row kernels. built by bcm_build_row_args()
+ * whenever the scene configuration changes and only read by the kernels
+ */
+typedef struct {
+    /** @brief image bytes from a top pixel to its bottom pixel, and from one port to the next */
+    uint32_t panel_stride;
+    /** @brief distance in words between two bit planes of the same pixel. see bcm_plane_stride() */
+    uint32_t plane_stride;
+    /** @brief distance in words between two pixels of the same plane. see bcm_pixel_stride() */
+    uint32_t pixel_stride;
+    /** @brief distance in words between two rows of the same plane. see bcm_row_stride() */
+    uint32_t row_stride;
+    /** @brief number of pixels shifted out per row address, see bcm_shift_width() */
+    uint16_t width;
+    /** @brief bytes per image pixel (3 or 4 channels of 1 or 2 bytes). see image_pixel_bytes() */
+    uint8_t stride;
+    /** @brief the image_format_e the kernel was selected for */
+    uint8_t image_format;
+    /** @brief number of bit planes to encode */
+    uint8_t bit_depth;
+    /** @brief the pixel_order_e and port count the kernel was selected for */
+    uint8_t pixel_order;
+    uint8_t num_ports;
+    /** @brief true to select the pin spread kernels. see scene_info.bcm_pin_spread */
+    bool pin_spread;
+    /** @brief true to select the kernels that read the image through a bcm_build_remap() table */
+    bool remapped;
+    /** @brief true to select the kernels that dither through a bcm_build_dither() table */
+    bool dithered;
+    /** @brief dither strength the dither table is built for. see scene_info.dither */
+    float dither;
+    /** @brief remaining scene geometry the remap table is built from */
+    uint8_t panel_layout;
+    uint16_t panel_rotation;
+    uint16_t height;
+    uint16_t panel_width;
+    uint16_t panel_height;
+    /** @brief scene_info.scan_pattern, scan_rows is bcm_scan_rows() */
+    uint8_t scan_rows;
+    uint8_t scan_tile;
+    uint8_t scan_flags;
+    /**
+     * @brief scene_info.color_lut, NULL for none. rows are converted through it into
+     * RGB48 by the encoder and encoded by the IMAGE_FORMAT_RGB16 kernel
+     */
+    const color_lut_t *color_lut;
+    /** @brief true to bake the GPIO words of BCM_LAYOUT_STREAM after each row is encoded */
+    bool stream;
+    /** @brief true to bake every GPIO word as a GPSET / GPCLR pair, BCM_LAYOUT_SET_CLEAR */
+    bool set_clear;
+    /**
+     * @brief OE duty baked into the rows, see bcm_oe_clocks(). 255 with brightness in the
+     * lookup table. only set for BCM_LAYOUT_STREAM, the other layouts leave OE to render_forever.
+     * map_byte_image_to_bcm() tracks it apart from the other fields, a change only re-bakes the rows
+     */
+    uint8_t brightness;
+    /** @brief scene_info.bcm_fraction_bits, cuts the baked OE duty of the fraction planes short */
+    uint8_t fraction_bits;
+    /**
+     * @brief the plane on the display while plane j shifts in, [0][j] for the first row and
+     * [1][j] for the others. follows scene_info.bcm_plane_order, see bcm_plane_schedule()
+     */
+    uint8_t shown_before[2][MAX_BITS];
+} bcm_row_args;
+
+/**
+ * @brief every scene parameter the RGB to BCM lookup table is built from. built by
+ * bcm_build_tone_args() on every frame, the table is rebuilt whenever it changes
+ */
+typedef struct {
+    /** @brief scene_info.tone_version, bump it to force a rebuild */
+    uint32_t tone_version;
+    func_tone_mapper_t tone_mapper;
+    float tone_level;
+    /** @brief gamma of each channel (red, green, blue), scene gamma * channel gamma */
+    float gamma[3];
+    /** @brief linear offset of each channel (red, green, blue) */
+    Normal linear[3];
+    /** @brief 255 when brightness is applied with the OE duty (oe_brightness) */
+    uint8_t brightness;
+    uint8_t bit_depth;
+    /** @brief the image_format_e the table is indexed by */
+    uint8_t image_format;
+    /** @brief the bcm_weight_e of the planes, BCM_WEIGHT_BINARY entries are the level in binary */
+    uint8_t weight;
+    /** @brief scene_info.bcm_fraction_bits, the last planes of BCM_WEIGHT_LINEAR entries are fraction planes */
+    uint8_t fraction_bits;
+} bcm_tone_args;
+
+/**
+ * @brief function definition for a row kernel that maps one row of RGB image data
+ * to BCM data for shifting out to GPIO. one kernel is generated for every
+ * pixel order, port count (1-3), depth class (<= 32 or <= 64 bits) and image format
+ * 
+ * @param args scene geometry from bcm_build_row_args()
+ * @param bits RGB to BCM lookup table (uint32_t for bit_depth <= 32, else uint64_t). Red 0-255, Green 256-511, Blue 512-767.
+ * for IMAGE_FORMAT_RGB16 and IMAGE_FORMAT_RGB16F the table from tone_map_rgb_bits_deep(), BCM_DEEP_LEVELS entries per color.
+ * for the pin spread kernels the table from bcm_build_spread_lut()
+ * @param bcm_signal output for plane 0 of the first pixel in the row
+ * @param image pointer to the port 0 top pixel of the row. for the remapped kernels the start of the image
+ * @param remap remap table entry of the port 0 top pixel of the row, NULL for kernels that are not remapped
+ * @param dither dither table row for this row (see bcm_build_dither()), NULL for kernels that do not dither
+ */
+typedef void (*bcm_row_fn)(
+    const bcm_row_args *__restrict__ args,
+    const void *__restrict__ bits,
+    uint32_t *__restrict__ bcm_signal,
+    const uint8_t *__restrict__ image,
+    const uint32_t *__restrict__ remap,
+    const uint8_t *__restrict__ dither);
+
+/**
+ * @brief fill in the row kernel arguments for the scene geometry, pixel order and port count
+ * 
+ * @param scene 
+ * @param args output
  */
-typedef void (*update_bcm_signal_fn)(
-    const scene_info *scene,
-    const void *bits,  // Use void* to handle both uint32_t* and uint64_t*
-    uint32_t *bcm_signal,
-    const uint8_t *image);
-    // XXX FIX
-    //const uint8_t *image);
+void bcm_build_row_args(const scene_info *scene, bcm_row_args *args);
 
 /**
- * @brief update_bcm_signal_fn implementation for up to 64 bit BCM data
+ * @brief compile scene->panel_layout, scene->panel_rotation and scene->scan_pattern into a source
+ * offset table. entry [y * width + x] is the image byte offset of the pixel shifted out at clock x
+ * of row y (y = ((port * 2) + half) * scan rows + row address). the remapped row kernels read through it
  * 
- * @param scene  pointer to current scene info
- * @param void_bits RGB to BCM index data. Red 0-255, Green 256-511, Blue 512 - 768
- * @param bcm_signal the ouput buffer to write BCM data to
- * @param image the input RGB or RGBA image to render
- * @param offset offset into the bcm buffer
+ * @param args from bcm_build_row_args()
+ * @return uint32_t* width * panel_height * num_ports entries, free() when done.
+ * NULL if args->remapped is false (the image is read as is)
  */
-void update_bcm_signal_64(
-    const scene_info *scene,
-    const void *__restrict__ void_bits,
-    uint32_t *__restrict__ bcm_signal,
-    const uint8_t *__restrict__ images);
-    // XXX fix
-    //const uint8_t *__restrict__ image,
-    //const uint32_t offset);
+uint32_t *bcm_build_remap(const bcm_row_args *args);
 
+// lookup table index bits and entries per color for the 16 bit image formats
+#define BCM_DEEP_BITS 12
+#define BCM_DEEP_LEVELS (1 << BCM_DEEP_BITS)
+
+// bytes of the largest lookup table, BCM_DEEP_LEVELS uint64_t entries per color
+#define BCM_LUT_BYTES (3 * BCM_DEEP_LEVELS * sizeof(uint64_t))
 
 /**
- * @brief update_bcm_signal_fn implementation for up to 32 bit BCM data
+ * @brief fill in the lookup table parameters from the scene
  * 
  * @param scene 
- * @param void_bits 
- * @param bcm_signal 
- * @param image 
- * @param offset 
- */
-void update_bcm_signal_32(
-    const scene_info *scene,
-    const void *__restrict__ void_bits,
-    uint32_t *__restrict__ bcm_signal,
-    const uint8_t *__restrict__ image);
+ * @param args output
+ */
+void bcm_build_tone_args(const scene_info *scene, bcm_tone_args *args);
+
+/**
+ * @brief build the RGB to BCM lookup table in place. applies the linear offset and gamma
+ * of each channel, the tone mapper and brightness, then spreads the resulting level evenly
+ * over bit_depth bits, or stores it in binary for BCM_WEIGHT_BINARY. fast enough to run on
+ * every frame, no allocation and no powf
+ * 
+ * @param args from bcm_build_tone_args()
+ * @param bits output, uint32_t for bit_depth <= 32, else uint64_t. 256 entries per color for
+ * IMAGE_FORMAT_RGB8, BCM_DEEP_LEVELS for the 16 bit formats. at most BCM_LUT_BYTES
+ */
+void bcm_build_lut(const bcm_tone_args *args, void *bits);
+
+/**
+ * @brief a color_lut_t prepared for the encoder. the position of every lookup table index
+ * (see bcm_channel_index()) on each axis of the lut lattice is resolved up front, so a pixel
+ * costs 3 table reads and one tetrahedral interpolation
+ */
+typedef struct {
+    /** @brief color_lut_t.table */
+    const float *table;
+    /** @brief float offset of the lower lattice point on each axis, per lookup table index */
+    uint32_t offset[3][BCM_DEEP_LEVELS];
+    /** @brief position between the lower (0.0) and upper (1.0) lattice point, per lookup table index */
+    float frac[3][BCM_DEEP_LEVELS];
+    /** @brief float offset to the next lattice point on each axis */
+    uint32_t step[3];
+    /** @brief float offset of the second and third tetrahedron corner for each of the 8 fraction orders */
+    uint32_t walk[8][2];
+} bcm_cube;
+
+/**
+ * @brief prepare a color lut for the encoder
+ * 
+ * @param lut the color lut, must outlive the cube
+ * @param image_format image_format_e of the images the cube is applied to
+ * @param cube output
+ */
+void bcm_build_cube(const color_lut_t *lut, const uint8_t image_format, bcm_cube *cube);
+
+/**
+ * @brief load a 3D color lut from an Adobe / Resolve .cube file. LUT_3D_SIZE,
+ * DOMAIN_MIN, DOMAIN_MAX, LUT_3D_INPUT_RANGE and TITLE are supported. exit on any failure
+ * 
+ * @param filename path to the .cube file
+ * @return color_lut_t* free() lut->table and the lut when done
+ */
+color_lut_t *load_cube_lut(const char *filename);
+
+// size of the ordered dither tile (BCM_DITHER_TILE x BCM_DITHER_TILE)
+#define BCM_DITHER_TILE 8
+// bytes of dither table per tile row. [channel][tile column][value]
+#define BCM_DITHER_ROW (3 * BCM_DITHER_TILE * 256)
+
+/**
+ * @brief build the ordered (Bayer) dither table for the dithered row kernels.
+ * entry [tile row][channel][tile column][value] is the 8 bit value after adding the
+ * tile threshold, scaled to +/- args->dither. black stays black. the dithered kernels
+ * look the value up right before the bcm lookup, the image is never modified.
+ * encoder row y uses tile row (y % BCM_DITHER_TILE)
+ * 
+ * @param args from bcm_build_row_args()
+ * @return uint8_t* BCM_DITHER_TILE * BCM_DITHER_ROW bytes, free() when done.
+ * NULL if args->dithered is false
+ */
+uint8_t *bcm_build_dither(const bcm_row_args *args);
+
+/**
+ * @brief select the row kernel specialized for the pixel order, port count and bit depth
+ * in args. call once per scene configuration, not per frame
+ * 
+ * @param args from bcm_build_row_args()
+ * @return bcm_row_fn the row kernel
+ */
+bcm_row_fn bcm_select_row_kernel(const bcm_row_args *args);
+
+/**
+ * @brief build the pin spread lookup table for the pin spread row kernels.
+ * one table per (port, top/bottom row, color) slot, slot = port * 6 + row * 3 + image byte.
+ * entry [slot][value][plane] is the GPIO word that slot contributes to that plane,
+ * so the GPIO word of a plane is the OR of one entry per slot
+ * 
+ * @param args from bcm_build_row_args()
+ * @param bits RGB to BCM lookup table from tone_map_rgb_bits()
+ * @return uint32_t* num_ports * 6 * 256 * bit_depth words, free() when done
+ */
+uint32_t *bcm_build_spread_lut(const bcm_row_args *args, const void *bits);
 
 
 
 /**
  * @brief this function takes the image data and maps it to the bcm signal.
  * 
- * if scene->tone_mapper is updated, new bcm bit masks will be created.
+ * if scene->tone_mapper or scene->image_format is updated, new bcm bit masks will be created.
+ * with scene->color_lut set, each row is converted through the lut into a 16 bit row right
+ * before it is encoded, so there is no extra pass over the frame.
  * 
  * @param scene the scene information
- * @param image the image to map to the scene bcm data. if NULL scene->image will be used
+ * @param image the image to map to the scene bcm data, scene->stride channels per pixel in
+ * scene->image_format (IE: RGB48 or RGBA16F for the 16 bit formats). if NULL scene->image will be used
  */
 void map_byte_image_to_bcm(scene_info *scene, uint8_t *image);
 
@@ -268,13 +458,29 @@ void copy_tone_mapperF(const RGBF *__restrict__ in, RGBF *__restrict__ out, cons
 /**
  * @brief create a lookup table for the pwm values for each pixel value
  * applies gamma correction and tone mapping based on the settings passed in scene
- * scene->brightness, scene->gamma, scene->red_linear, scene->green_linear, scene->blue_linear
- * scene->tone_mapper
+ * scene->brightness, scene->gamma, scene->red_gamma, scene->green_gamma, scene->blue_gamma,
+ * scene->red_linear, scene->green_linear, scene->blue_linear, scene->tone_mapper.
+ * allocates the table, see bcm_build_lut() to rebuild one in place
  * 
  */
 __attribute__((cold))
 void *tone_map_rgb_bits(const scene_info *scene, const int num_bits, float *quant_errors);
 
+/**
+ * @brief create the lookup table for the 16 bit image formats. same gamma, tone mapping
+ * and brightness as tone_map_rgb_bits(), sampled at BCM_DEEP_LEVELS input levels per color
+ * and mapped to the bcm signal without rounding to a byte in between.
+ * IMAGE_FORMAT_RGB16 entries are linear (the top BCM_DEEP_BITS of each channel),
+ * IMAGE_FORMAT_RGB16F entries are the top BCM_DEEP_BITS of the half float up to 1.0,
+ * which spends most of the table on the dark end
+ * 
+ * @param scene scene->image_format selects the index encoding
+ * @param num_bits number of bits of BCM data (8-64)
+ * @return void* uint32_t* or uint64_t* as tone_map_rgb_bits(). red 0-4095, green 4096-8191, blue 8192-12287
+ */
+__attribute__((cold))
+void *tone_map_rgb_bits_deep(const scene_info *scene, const int num_bits);
+
 
 
 /**
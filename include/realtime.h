@@ -0,0 +1,74 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "rpihub75.h"
+
+#ifndef _HUB75_REALTIME_H
+#define _HUB75_REALTIME_H 1
+
+// gaps in the latency self test longer than this are counted as stalls
+#ifndef REALTIME_STALL_US
+    #define REALTIME_STALL_US 10
+#endif
+
+/**
+ * @brief what realtime_setup() managed to apply to the calling thread, and the latency self test
+ */
+typedef struct {
+    /** @brief core the thread is pinned to, -1 if pinning failed */
+    int16_t cpu;
+    /** @brief the core is in isolcpus (/sys/devices/system/cpu/isolated) */
+    bool isolated;
+    /** @brief the core is in nohz_full (/sys/devices/system/cpu/nohz_full) */
+    bool nohz;
+    /** @brief the thread runs SCHED_FIFO at realtime_config_t.priority */
+    bool fifo;
+    /** @brief every page of the process is locked */
+    bool locked;
+    /** @brief longest gap between two cycle counter reads of the self test in us, how long the core was taken away */
+    double latency_max_us;
+    /** @brief gaps longer than REALTIME_STALL_US */
+    uint32_t latency_stalls;
+} realtime_status_t;
+
+/**
+ * @brief test if a core is listed in a kernel cpu list file, IE: /sys/devices/system/cpu/isolated
+ * holding "2-3" or "1,3"
+ *
+ * @param path cpu list file
+ * @param cpu core number
+ * @return true if the file exists and lists cpu
+ */
+bool realtime_cpu_listed(const char *path, const int cpu);
+
+/**
+ * @brief the core the scanout thread should run on. SCANOUT_CPU_AUTO picks the first isolated
+ * core or the last core. a core that is not isolated while another one is moves to the isolated
+ * one, a core that is not online moves to the last core. both log a warning
+ *
+ * @param cpu realtime_config_t.cpu
+ * @return int16_t core number
+ */
+int16_t realtime_pick_cpu(const int16_t cpu);
+
+/**
+ * @brief spin on the cycle counter for ms milliseconds and record the longest gap between two
+ * reads. on an isolated core with SCHED_FIFO only hardware interrupts should show up
+ *
+ * @param ms length of the test
+ * @param status latency_max_us and latency_stalls are written
+ */
+void realtime_latency_test(const uint16_t ms, realtime_status_t *status);
+
+/**
+ * @brief pin the calling thread alone to a core, switch it to SCHED_FIFO and lock the process
+ * memory as configured, then log the result and the latency self test. failures are logged,
+ * the scanout still runs without them. the encoder workers are moved off the picked core,
+ * see workers_set_scanout_cpu()
+ *
+ * @param config zeroed for the defaults, see realtime_config_t
+ * @param status output, what was applied
+ */
+void realtime_setup(const realtime_config_t *config, realtime_status_t *status);
+
+#endif
@@ -8,6 +8,7 @@
 #include <sys/socket.h>
 #include <unistd.h>
 #include <stdatomic.h>
+#include <time.h>
 
 
 #ifndef _GPIO_H
@@ -72,15 +73,17 @@
 //  for all others use BIT_DEPTH_ALIGNMENT 1
 #define BIT_DEPTH_ALIGNMENT 4
 
-#define SERVER_PORT 22222
-
-// global OE jitter mask, should be a prime >1031 and <=4093
-// we don't want to make this too large, as it will consume memory
-// and decrease L1-L3 cache locality of other data
-#define JITTER_SIZE 32771 
+// encode with the vectorised bit transpose (NEON on the Pi, AVX2/SSE2 on x86 hosts)
+// compile with -DBCM_SIMD=0 to generate scalar row kernels
+#ifndef BCM_SIMD
+    #if defined(__ARM_NEON) || defined(__SSE2__)
+        #define BCM_SIMD 1
+    #else
+        #define BCM_SIMD 0
+    #endif
+#endif
 
-#define JITTER_MAX_RUN_LEN 4
-#define JITTER_PASSES 3
+#define SERVER_PORT 22222
 
 //////////////////////////////////////////////////////////
 
@@ -132,8 +135,6 @@
 /** @brief  CLEAR GPIO pins in bit mask (dont touch pins not in mask) */
 #define rioCLR ((rioregs *)(RIOBase + 0x3000 / 4))
 
-#define SLOW for (volatile int s=0;s<40;s++) { asm volatile ("" : : : "memory"); asm(""); }
-#define SLOW2 for (volatile int s=0;s<8;s++) { asm volatile ("" : : : "memory"); asm(""); }
 
 // helpers for timing things...
 #define PRE_TIME struct timeval start, end; gettimeofday(&start, NULL);
@@ -219,6 +220,9 @@
 #define PIN_LATCH (1 << ADDRESS_STROBE)
 #define PIN_CLK (1 << ADDRESS_CLK)
 
+// every pin configured as an output for hub75 operation (GPIO 2-27)
+#define GPIO_SCANOUT_MASK 0x0FFFFFFC
+
 
 // helpers for "boolean"
 #define TRUE 1
@@ -314,8 +318,312 @@ enum pixel_order_e {
     PIXEL_ORDER_BGR
 };
 
+/**
+ * @brief memory layout of the bcm_signalA/B buffers.
+ * the encoder writes the layout selected in scene->bcm_layout and render_forever reads it back
+ */
+enum bcm_layout_e {
+    /** @brief pixel-major: each pixel owns bit_depth + 1 consecutive words, one word per bit plane */
+    BCM_LAYOUT_PIXEL,
+    /** @brief plane-major: plane -> row -> x. each bit plane is width * half_height consecutive words */
+    BCM_LAYOUT_PLANE,
+    /**
+     * @brief plane-major with the final GPIO words baked in by the encoder: the row address
+     * and OE duty of every pixel, then BCM_STREAM_LATCH_WORDS latch words per row.
+     * render_forever writes each word as is, every frame is one linear run of words
+     */
+    BCM_LAYOUT_STREAM,
+    /**
+     * @brief BCM_LAYOUT_STREAM for boards that can only set and clear pins (pi 3 and 4). every
+     * word is baked as a GPSET / GPCLR pair, BCM_SET_CLEAR_WORDS words, so render_forever
+     * stores both as is without working out which pins changed
+     */
+    BCM_LAYOUT_SET_CLEAR
+};
+
+// words after every row of BCM_LAYOUT_STREAM, latch high (display off) then latch low
+#define BCM_STREAM_LATCH_WORDS 2
+// words per GPIO word of BCM_LAYOUT_SET_CLEAR, the pins to set then the pins to clear
+#define BCM_SET_CLEAR_WORDS 2
+
+/**
+ * @brief how long each bit plane is shown, scene->bcm_weight
+ */
+enum bcm_weight_e {
+    /**
+     * @brief every plane is shown for one row shift. a level lights level / 255 * bit_depth
+     * planes, so bit_depth planes give bit_depth + 1 levels
+     */
+    BCM_WEIGHT_LINEAR,
+    /**
+     * @brief binary code modulation. plane i holds bit i of the level and is shown for
+     * scene->bcm_lsb_ns << i, timed on the cycle counter. bit_depth planes give
+     * 2^bit_depth levels (8-16 planes)
+     */
+    BCM_WEIGHT_BINARY
+};
+
+// the largest BCM_WEIGHT_BINARY bit depth, the MSB plane holds every row for bcm_lsb_ns << 15
+#define BCM_BINARY_MAX_BITS 16
+// default time BCM_WEIGHT_BINARY shows the least significant plane of each row
+#ifndef BCM_LSB_NS
+    #define BCM_LSB_NS 130
+#endif
+// BCM_WEIGHT_LINEAR fraction planes. one plane per fraction bit, up to 2 planes shown for
+// 1 / 2^2 and 2 / 2^2 of a full plane. more bits than planes could not reach every step in between
+#define BCM_FRACTION_MAX_PLANES 2
+#define BCM_FRACTION_MAX_BITS BCM_FRACTION_MAX_PLANES
+
+/**
+ * @brief the order render_forever shows the bit planes in, scene->bcm_plane_order.
+ * the order is compiled into a schedule once (see bcm_plane_schedule()), the scanout only
+ * looks up the plane of each row, so every order costs the same per clock
+ */
+enum bcm_plane_order_e {
+    /** @brief planes 0 to bit_depth - 1 on every row, every row shows the same plane at once */
+    BCM_ORDER_SEQUENTIAL,
+    /**
+     * @brief planes alternate from both ends (0, n-1, 1, n-2 ...) and each row starts one
+     * plane later than the row above, so long and short binary planes alternate in time and
+     * the rows of one scan show different planes
+     */
+    BCM_ORDER_INTERLEAVED,
+    /**
+     * @brief planes in bit reversed order (0, n/2, n/4, 3n/4 ...) and each row starts one
+     * plane later than the row above, so any run of consecutive planes is spread over the frame
+     */
+    BCM_ORDER_BIT_REVERSED
+};
+
+/**
+ * @brief panel layout flags for scene->panel_layout. the encoder compiles the layout and
+ * scene->panel_rotation into one source offset table and reads the image through it,
+ * the image itself is never modified
+ */
+enum panel_layout_e {
+    /** @brief the image is read as is */
+    PANEL_LAYOUT_NONE   = 0,
+    /** @brief mirror the image left to right */
+    PANEL_LAYOUT_MIRROR = 1,
+    /** @brief flip the image top to bottom */
+    PANEL_LAYOUT_FLIP   = 2,
+    /**
+     * @brief U (serpentine) chains. the first half of each port's chain runs left to right,
+     * the second half runs back right to left below it with the panels mounted upside down.
+     * the image is read as (width / 2) x (height * 2)
+     */
+    PANEL_LAYOUT_U      = 4
+};
+
+/**
+ * @brief scan_pattern_t.flags
+ */
+enum scan_flags_e {
+    /** @brief the chain starts each tile in the lowest row the address lights, not the highest */
+    SCAN_BOTTOM_FIRST = 1,
+    /** @brief every other row of a tile is shifted right to left (zig-zag wiring) */
+    SCAN_ZIGZAG       = 2
+};
+
+/**
+ * @brief how a panel wires its rows to the row addresses and the shift register chain.
+ * standard panels scan 1/(panel_height / 2): each address lights one row of each half and
+ * the chain shifts one panel row. outdoor panels scan 1/4, 1/8 or 1/16, each address lights
+ * panel_height / 2 / scan rows of each half and the chain runs through all of them, tile_width
+ * pixels of one row at a time. the encoder compiles the pattern into its source offset table,
+ * so these panels encode at the same cost per pixel as standard ones. zeroed is the standard scan
+ */
+typedef struct {
+    /** @brief row addresses, 1/scan. 0 for panel_height / 2 */
+    uint8_t scan;
+    /** @brief pixels of one row the chain shifts before it moves to the next row, 0 for a whole panel row */
+    uint8_t tile_width;
+    /** @brief scan_flags_e */
+    uint8_t flags;
+} scan_pattern_t;
+
+/**
+ * @brief channel format of the images passed to the bcm mapper. 8 bit channels index a
+ * 256 entry lookup table, the deep formats are reduced to a 12 bit index into a
+ * BCM_DEEP_LEVELS entry table, so dark gradients do not band at the 8 bit steps
+ */
+enum image_format_e {
+    /** @brief 8 bits per channel, RGB24 or RGBA32 */
+    IMAGE_FORMAT_RGB8,
+    /** @brief 16 bit unsigned per channel in native byte order, RGB48 or RGBA64 */
+    IMAGE_FORMAT_RGB16,
+    /** @brief IEEE half float per channel (0.0 - 1.0, negative is black, above 1.0 is white), RGBA16F */
+    IMAGE_FORMAT_RGB16F
+};
+
+/**
+ * @brief a 3D color lookup table, IE: loaded from a .cube file by load_cube_lut().
+ * maps every RGB input color to an RGB output color by interpolating between the
+ * nearest lattice points
+ */
+typedef struct {
+    /** @brief lattice points per axis (2-65) */
+    uint16_t size;
+    /** @brief input value of the first and last lattice point of each axis (red, green, blue) */
+    float domain_min[3];
+    float domain_max[3];
+    /**
+     * @brief size^3 output colors (0.0 - 1.0), red changes fastest, then green, then blue.
+     * each color is padded to 4 floats so it loads as one vector, 16 byte aligned
+     */
+    float *table;
+} color_lut_t;
+
+// number of bcm buffers. one is on screen, one holds the newest finished frame and one is being encoded
+#define BCM_BUFFERS 3
+// bcm_swap_t.state is the index of the buffer waiting for the scanout | BCM_SWAP_FRESH
+#define BCM_SWAP_INDEX 0x3
+// set while the waiting buffer holds a frame the scanout has not picked up yet
+#define BCM_SWAP_FRESH 0x4
+
+/**
+ * @brief lock free triple buffer handoff between the bcm encoder (producer) and render_forever
+ * (scanout). the producer always encodes into a buffer that is neither on screen nor waiting,
+ * then swaps it with the waiting buffer in one atomic exchange. the scanout swaps its buffer
+ * with the waiting one only at a frame boundary, and only if a new frame is waiting.
+ * zero initialized: buffer 0 waits (empty), the scanout starts on buffer 2 and the first frame
+ * is encoded into buffer 1. see bcm_swap_target(), bcm_swap_publish() and bcm_swap_acquire()
+ */
+typedef struct {
+    /** @brief index of the waiting buffer | BCM_SWAP_FRESH. the only state both sides write */
+    atomic_uint_fast8_t state;
+    /** @brief producer only: the buffer to encode the next frame into */
+    uint8_t back;
+    /** @brief producer only: the buffer holding the last published frame */
+    uint8_t last;
+    /** @brief sequence number of the frame in each buffer. written by the producer before publishing it */
+    uint32_t sequence[BCM_BUFFERS];
+    /** @brief sequence number of the last published frame (1, 2, 3...). written by the producer */
+    uint32_t published;
+    /**
+     * @brief sequence number of the frame on screen, written by the scanout when it picks a frame up.
+     * frames are shown in order, so frame N was shown if shown >= N, unless it was dropped
+     */
+    atomic_uint shown;
+    /** @brief number of frames replaced by a newer frame before the scanout picked them up */
+    atomic_uint dropped;
+} bcm_swap_t;
+
+// buckets of the scanout timing histograms. 4 buckets per power of 2 counter ticks, see scanout_bucket()
+#define SCANOUT_HISTOGRAM_BUCKETS 128
+// a row that takes this many times the mean row time of the previous frame counts as a stall
+#ifndef SCANOUT_STALL_FACTOR
+    #define SCANOUT_STALL_FACTOR 4
+#endif
+// seconds between the show_fps scanout reports, and how often the reporter checks do_render
+#ifndef SCANOUT_REPORT_S
+    #define SCANOUT_REPORT_S 5
+#endif
+#ifndef SCANOUT_REPORT_POLL_MS
+    #define SCANOUT_REPORT_POLL_MS 100
+#endif
+
+/**
+ * @brief scanout timing measured by render_forever with the cycle counter (see cycle_counter()).
+ * every duration is in counter ticks, ticks_per_second converts them. counts since render_forever started
+ */
+typedef struct {
+    /** @brief frequency of the cycle counter */
+    uint64_t ticks_per_second;
+    /** @brief full frames (every bit plane of every row) and bit planes shifted out */
+    uint64_t frames;
+    uint64_t planes;
+    /** @brief duration of the last, the shortest and the longest frame, and the sum of all frames */
+    uint64_t frame_last;
+    uint64_t frame_min;
+    uint64_t frame_max;
+    uint64_t frame_sum;
+    /** @brief sum of the squared frame durations, for the refresh rate jitter */
+    double frame_sum_sq;
+    /** @brief duration of the last and the longest bit plane */
+    uint64_t plane_last;
+    uint64_t plane_max;
+    /** @brief duration of the longest row (shift and latch of one row of one plane) */
+    uint64_t row_max;
+    /** @brief rows longer than SCANOUT_STALL_FACTOR times the mean row of the previous frame */
+    uint64_t stalls;
+    /** @brief frame number of the longest row */
+    uint64_t row_max_frame;
+    /** @brief duration histograms, see scanout_bucket() */
+    uint64_t frame_histogram[SCANOUT_HISTOGRAM_BUCKETS];
+    uint64_t plane_histogram[SCANOUT_HISTOGRAM_BUCKETS];
+    uint64_t row_histogram[SCANOUT_HISTOGRAM_BUCKETS];
+} scanout_timing_t;
+
+/**
+ * @brief scanout timing shared with other threads or processes (see scanout_stats_open()).
+ * render_forever is the only writer and publishes a new copy at every frame boundary.
+ * readers never block it, they retry while a copy is in progress. see scanout_stats_read()
+ */
+typedef struct {
+    /** @brief seqlock, odd while render_forever is copying timing in */
+    atomic_uint sequence;
+    scanout_timing_t timing;
+} scanout_stats_t;
+
+/**
+ * @brief setup and hold times of the panel signals in nanoseconds, one set per panel profile.
+ * render_forever converts them to calibrated spin loops at startup (see spin_loops_per_us()).
+ * 0 skips the delay, so the clock can be pushed to the fastest rate the panel stays stable at.
+ * see panel_timing_profile() for the built in profiles
+ */
+typedef struct {
+    /** @brief profile name, NULL selects the default profile of the pi model ("pi4" or "pi5") */
+    const char *name;
+    /** @brief row address lines settle before the row is shown or shifted */
+    uint16_t address_setup_ns;
+    /** @brief clock low before the color pins change. only the pi 3 and 4 lower it separately */
+    uint16_t clock_low_ns;
+    /** @brief color pins stable before the clock rises */
+    uint16_t data_setup_ns;
+    /** @brief clock high, the color pins hold after the rising edge */
+    uint16_t clock_high_ns;
+    /** @brief latch pulse width */
+    uint16_t latch_ns;
+    /** @brief latch low before OE turns the display on */
+    uint16_t oe_setup_ns;
+} panel_timing_t;
+
+// core render_forever pins the scanout thread to, SCANOUT_CPU_AUTO picks the first isolated core
+#ifndef SCANOUT_CPU
+    #define SCANOUT_CPU 3
+#endif
+// SCHED_FIFO priority of the scanout thread (1-99), 0 keeps the default time sharing policy
+#ifndef SCANOUT_PRIORITY
+    #define SCANOUT_PRIORITY 90
+#endif
+// how long the latency self test spins on the scanout core at startup
+#ifndef SCANOUT_LATENCY_TEST_MS
+    #define SCANOUT_LATENCY_TEST_MS 200
+#endif
+#define SCANOUT_CPU_AUTO -1
+
+/**
+ * @brief how render_forever sets up the thread it scans out on, for the hardware backends only.
+ * the thread alone is pinned, the encoder and producer threads keep their own cores.
+ * a zeroed struct uses SCANOUT_CPU, SCANOUT_PRIORITY, locked memory and the latency self test.
+ * see realtime_setup()
+ */
+typedef struct {
+    /** @brief core to pin the scanout thread to, SCANOUT_CPU_AUTO for the first isolated core or the last core */
+    int16_t cpu;
+    /** @brief SCHED_FIFO priority 1-99, 0 to keep SCHED_OTHER */
+    uint8_t priority;
+    /** @brief true to mlockall() every current and future page, so the scanout never takes a page fault */
+    bool lock_memory;
+    /** @brief length of the cycle counter latency self test logged at startup in ms, 0 skips it */
+    uint16_t latency_test_ms;
+} realtime_config_t;
+
 // self referencing function pointers need this defined first
 struct scene_info;
+// see gpio.h
+struct gpio_backend_t;
 
 // void map_byte_image_to_pwm(uint8_t *image, const scene_info *scene, uint8_t fps_sync) {
 typedef void (*func_bcm_mapper_t)(struct scene_info *scene, uint8_t *image);
@@ -333,8 +641,13 @@ typedef struct scene_info {
     uint16_t width;
     /** @brief the total height of the image in pixels */
     uint16_t height;
-    /** @brief the number of bytes per pixel in the drawing buffers (3 for RGB, 4 for RGBA) */
+    /** @brief the number of channels per pixel in the drawing buffers (3 for RGB, 4 for RGBA) */
     uint8_t  stride;
+    /**
+     * @brief channel format of the images passed to bcm_mapper. the hub_* drawing functions
+     * and scene->image_mapper only handle IMAGE_FORMAT_RGB8. see image_pixel_bytes()
+     */
+    enum image_format_e image_format;
 
     /** @brief the order of pixels on panel */
     enum pixel_order_e pixel_order;
@@ -353,7 +666,7 @@ typedef struct scene_info {
 
     /** @brief brightness level (0-255) */
     uint8_t brightness;
-    /** @brief dithering strength. (0-10) 0 is off, improves simulated color in dark areas but reduces image sharpness */
+    /** @brief ordered dithering strength in 8 bit levels. (0-10) 0 is off, improves simulated color in dark areas but reduces image sharpness */
     float dither;
 
     /** 
@@ -362,18 +675,67 @@ typedef struct scene_info {
      */
     uint8_t num_chains;
 
-    /**
-     * @brief points to active buffer
-     * in update code use this to select the pwm buffer to render to: 
-     * (scene->buffer_ptr == 1)? scene->bcm_signalA : scene->bcm_signalB; 
-     */
+    /** @brief unused, the bcm buffers are handed off through bcm_swap */
     uint8_t buffer_ptr;
 
-    /** * @brief see buffer_ptr for usage */
+    /** @brief the BCM_BUFFERS bcm buffers, buffer 0, 1 and 2. see bcm_buffer() */
     uint32_t *restrict bcm_signalA __attribute__((aligned(16)));
     uint32_t *restrict bcm_signalB __attribute__((aligned(16)));
+    uint32_t *restrict bcm_signalC __attribute__((aligned(16)));
+
+    /** @brief triple buffer handoff between bcm_mapper and render_forever */
+    bcm_swap_t bcm_swap;
 
-    atomic_bool bcm_ptr;
+    /**
+     * @brief memory layout of the bcm buffers. BCM_LAYOUT_PLANE lets render_forever
+     * stream each bit plane linearly (1 sequential read per clock). BCM_LAYOUT_STREAM
+     * moves the address, OE and latch words into the encoder, render_forever only stores.
+     * BCM_LAYOUT_SET_CLEAR does the same for the pi 3 and 4.
+     * set before the bcm buffers are allocated, they are sized for the layout
+     */
+    enum bcm_layout_e bcm_layout;
+
+    /**
+     * @brief BCM_WEIGHT_LINEAR shows every bit plane for the same time, BCM_WEIGHT_BINARY
+     * shows plane i for bcm_lsb_ns << i, so 8-16 planes give 256-65536 levels.
+     * BCM_WEIGHT_BINARY applies brightness in the lookup table, not with the OE duty
+     */
+    enum bcm_weight_e bcm_weight;
+    /** @brief BCM_WEIGHT_BINARY display time of the least significant plane, in nanoseconds */
+    uint16_t bcm_lsb_ns;
+    /**
+     * @brief BCM_WEIGHT_LINEAR extra levels below each full plane (0-2 bits). the last 1-2 planes
+     * of every frame are shown for 1 / 2^bits and 2 / 2^bits of a full plane by cutting their
+     * OE pulse short, so the darkest levels get finer steps without shifting more planes.
+     * see bcm_plane_oe_shift()
+     */
+    uint8_t bcm_fraction_bits;
+    /**
+     * @brief order the bit planes are shown in on each row, see bcm_plane_order_e. spreading
+     * the on time of each level over the refresh reduces banding on cameras and flicker at
+     * the same refresh rate
+     */
+    enum bcm_plane_order_e bcm_plane_order;
+
+    /**
+     * @brief number of threads that encode each frame in row bands (0-8). the calling thread
+     * encodes the first band, the rest run on a persistent pool kept off the scanout core.
+     * 0 or 1 encodes on the calling thread only. read once when the first frame is mapped
+     */
+    uint8_t encode_threads;
+
+    /**
+     * @brief encode with pin spread lookup tables (one table per port, row and color with every
+     * entry already shifted to its GPIO pin) instead of bit transposing the bcm lookup table.
+     * trades table memory (num_ports * 6 * 256 * bit_depth words) for a plain OR per plane
+     */
+    bool bcm_pin_spread;
+
+    /**
+     * @brief statistic: number of rows (of panel_height / 2) in the last mapped frame whose
+     * image data had not changed, so they were not re-encoded. written by map_byte_image_to_bcm
+     */
+    uint16_t bcm_rows_skipped;
 
     /** * @brief see buffer_ptr for usage */
     //uint8_t *image __attribute__((aligned(16)));
@@ -396,11 +758,20 @@ typedef struct scene_info {
     func_tone_mapper_t tone_mapper;
 
 	/** 
-     * @brief the tone mapping function to use, if null no tone mapping applied
-     * @see aces_tone_map
+     * @brief optional image mapper, called on the image before each frame is encoded.
+     * the returned image is encoded. prefer panel_layout, which costs no extra pass
      */
     func_image_mapper_t image_mapper;
 
+    /** @brief panel_layout_e flags, IE: PANEL_LAYOUT_U | PANEL_LAYOUT_MIRROR */
+    uint8_t panel_layout;
+
+    /** @brief clockwise rotation of every panel in degrees (0, 90, 180, 270). 90 and 270 need square panels */
+    uint16_t panel_rotation;
+
+    /** @brief multiplex scan of the panels, zeroed for the standard 1/(panel_height / 2) scan */
+    scan_pattern_t scan_pattern;
+
     /**
      * @brief  the target frame rate:
      * maximum frame rate is: 9600 / bpp / (panel_width / 16)
@@ -417,7 +788,11 @@ typedef struct scene_info {
      */
     float tone_level;
 
-    bool jitter_brightness;
+    /**
+     * @brief true to apply brightness as the OE duty of every row, false to scale the pixel
+     * values in the lookup table. BCM_WEIGHT_BINARY always uses the lookup table
+     */
+    bool oe_brightness;
 
     uint8_t motion_blur_frames;
 
@@ -428,13 +803,54 @@ typedef struct scene_info {
     Normal green_linear;
     Normal blue_linear;
 
+    /**
+     * @brief lookup table version. the encoder rebuilds the lookup table on the next frame
+     * whenever gamma, red/green/blue_gamma, red/green/blue_linear, brightness, tone_mapper,
+     * tone_level, bit_depth or image_format change. increment this to force a rebuild for
+     * anything else, IE: state inside a custom tone mapper
+     */
+    uint32_t tone_version;
+
+    /**
+     * @brief optional 3D color lut (IE: from load_cube_lut()) applied to every pixel while
+     * encoding, ahead of gamma and tone mapping. NULL for none. rows are converted to 16 bit
+     * color, so the lut output is not quantized back to 8 bits. increment tone_version after
+     * changing the table in place
+     */
+    color_lut_t *color_lut;
+
+    /**
+     * @brief scanout timing published by render_forever. allocated by render_forever if NULL,
+     * see scanout_stats_open() to share it with other processes
+     */
+    scanout_stats_t *scanout_stats;
+
+    /**
+     * @brief GPIO backend render_forever drives (see gpio.h). NULL detects the pi model,
+     * point it at gpio_sim_create()->backend to run the scanout without a pi
+     */
+    const struct gpio_backend_t *gpio_backend;
+
+    /**
+     * @brief setup and hold times of the panel signals. a zeroed struct (name NULL) uses the
+     * default profile of the pi model. see panel_timing_profile()
+     */
+    panel_timing_t panel_timing;
+
+    /**
+     * @brief core, SCHED_FIFO priority and memory locking of the scanout thread. zeroed uses
+     * the defaults, see realtime_config_t
+     */
+    realtime_config_t realtime;
+
     /**
      * @brief boolean flag to indicate that render_forever should exit.
      */
     bool do_render;
 
     /**
-     * set to true to show the FPS on the screen
+     * set to true to show the FPS on the screen. render_forever also prints the panel refresh
+     * rate every SCANOUT_REPORT_S seconds, from a reporter thread reading scanout_stats
      */
     bool show_fps;
     
@@ -442,9 +858,285 @@ typedef struct scene_info {
 
 
 
+/**
+ * @brief row addresses the scanout cycles through, and rows of bcm data per bit plane
+ * 
+ * @param scene 
+ * @return uint8_t scene->scan_pattern.scan, or panel_height / 2 for the standard scan
+ */
+static inline uint8_t bcm_scan_rows(const scene_info *scene) {
+    return (scene->scan_pattern.scan != 0) ? scene->scan_pattern.scan : scene->panel_height / 2;
+}
+
+/**
+ * @brief clocks shifted out for each row address. the chain runs through every row of a half
+ * the address lights, so 1/8 scan on a 32 row panel shifts 2 rows per address
+ * 
+ * @param scene 
+ * @return uint16_t scene->width * panel_height / 2 / bcm_scan_rows()
+ */
+static inline uint16_t bcm_shift_width(const scene_info *scene) {
+    return scene->width * ((scene->panel_height / 2) / bcm_scan_rows(scene));
+}
+
+/**
+ * @brief true for the layouts that hold the final GPIO words, see BCM_LAYOUT_STREAM
+ */
+static inline bool bcm_layout_stream(const enum bcm_layout_e layout) {
+    return layout == BCM_LAYOUT_STREAM || layout == BCM_LAYOUT_SET_CLEAR;
+}
+
+/**
+ * @brief distance in words between row y and y+1 of the same bit plane in the bcm buffers
+ * 
+ * @param scene 
+ * @return uint32_t shift width * (bit_depth + 1) for BCM_LAYOUT_PIXEL, shift width for BCM_LAYOUT_PLANE,
+ * shift width + BCM_STREAM_LATCH_WORDS for BCM_LAYOUT_STREAM, twice that for BCM_LAYOUT_SET_CLEAR
+ */
+static inline uint32_t bcm_row_stride(const scene_info *scene) {
+    const uint32_t width = bcm_shift_width(scene);
+    return (scene->bcm_layout == BCM_LAYOUT_SET_CLEAR) ? (width + BCM_STREAM_LATCH_WORDS) * BCM_SET_CLEAR_WORDS :
+           (scene->bcm_layout == BCM_LAYOUT_STREAM)    ? width + BCM_STREAM_LATCH_WORDS :
+           (scene->bcm_layout == BCM_LAYOUT_PLANE)     ? width :
+                                                         width * (scene->bit_depth + 1);
+}
+
+/**
+ * @brief distance in words between bit plane N and N+1 of the same pixel in the bcm buffers
+ * 
+ * @param scene 
+ * @return uint32_t 1 for BCM_LAYOUT_PIXEL, bcm_row_stride() * bcm_scan_rows() for the plane-major layouts
+ */
+static inline uint32_t bcm_plane_stride(const scene_info *scene) {
+    return (scene->bcm_layout == BCM_LAYOUT_PIXEL) ? 1 : bcm_row_stride(scene) * bcm_scan_rows(scene);
+}
+
+/**
+ * @brief distance in words between pixel x and x+1 of the same bit plane in the bcm buffers
+ * 
+ * @param scene 
+ * @return uint32_t bit_depth + 1 for BCM_LAYOUT_PIXEL, BCM_SET_CLEAR_WORDS for BCM_LAYOUT_SET_CLEAR,
+ * 1 for the other plane-major layouts
+ */
+static inline uint32_t bcm_pixel_stride(const scene_info *scene) {
+    return (scene->bcm_layout == BCM_LAYOUT_PIXEL)     ? scene->bit_depth + 1 :
+           (scene->bcm_layout == BCM_LAYOUT_SET_CLEAR) ? BCM_SET_CLEAR_WORDS : 1;
+}
+
+/**
+ * @brief size of each bcm buffer in words. BCM_LAYOUT_PIXEL pads every pixel to bit_depth + 1
+ * words, BCM_LAYOUT_PLANE uses bit_depth words per pixel, so this fits both layouts.
+ * BCM_LAYOUT_STREAM adds the latch words to every row of every plane
+ * 
+ * @param scene 
+ * @return size_t width * panel_height / 2 * (bit_depth + 1), or bit_depth planes of
+ * bcm_plane_stride() words for BCM_LAYOUT_STREAM and BCM_LAYOUT_SET_CLEAR
+ */
+static inline size_t bcm_buffer_words(const scene_info *scene) {
+    if (bcm_layout_stream(scene->bcm_layout)) {
+        return (size_t)bcm_plane_stride(scene) * scene->bit_depth;
+    }
+    return (size_t)scene->width * (scene->panel_height / 2) * (scene->bit_depth + 1);
+}
+
+/**
+ * @brief one of the BCM_BUFFERS bcm buffers
+ * 
+ * @param scene 
+ * @param index 0 - 2
+ * @return uint32_t* bcm_signalA, bcm_signalB or bcm_signalC
+ */
+static inline uint32_t *bcm_buffer(const scene_info *scene, const uint8_t index) {
+    return (index == 0) ? scene->bcm_signalA : ((index == 1) ? scene->bcm_signalB : scene->bcm_signalC);
+}
+
+/**
+ * @brief producer side of the handoff. the buffer to encode the next frame into, it is
+ * neither on screen nor waiting to be shown. never blocks
+ * 
+ * @param swap 
+ * @return uint8_t buffer index
+ */
+static inline uint8_t bcm_swap_target(const bcm_swap_t *swap) {
+    return (swap->published == 0) ? 1 : swap->back;
+}
+
+/**
+ * @brief producer side of the handoff. publish the frame encoded into target, the scanout
+ * shows it from its next frame boundary. the waiting buffer becomes the next target
+ * 
+ * @param swap 
+ * @param target buffer from bcm_swap_target()
+ * @return true if the previously published frame was replaced before the scanout picked it up
+ */
+static inline bool bcm_swap_publish(bcm_swap_t *swap, const uint8_t target) {
+    swap->sequence[target] = ++swap->published;
+    // release the frame (and its sequence number) to the scanout, acquire the buffer it gave back
+    const uint_fast8_t waiting = atomic_exchange_explicit(&swap->state, target | BCM_SWAP_FRESH, memory_order_acq_rel);
+    swap->back = waiting & BCM_SWAP_INDEX;
+    swap->last = target;
+
+    const bool dropped = (waiting & BCM_SWAP_FRESH) != 0;
+    if (dropped) {
+        atomic_fetch_add_explicit(&swap->dropped, 1, memory_order_relaxed);
+    }
+    return dropped;
+}
+
+/**
+ * @brief scanout side of the handoff. call at every frame boundary. no locks and no syscalls,
+ * a plain load while no new frame is waiting
+ * 
+ * @param swap 
+ * @param front the buffer on screen, BCM_BUFFERS - 1 for the first frame
+ * @return uint8_t the buffer to show next frame, front if there is no new frame
+ */
+static inline uint8_t bcm_swap_acquire(bcm_swap_t *swap, const uint8_t front) {
+    if (LIKELY((atomic_load_explicit(&swap->state, memory_order_relaxed) & BCM_SWAP_FRESH) == 0)) {
+        return front;
+    }
+
+    // only the producer writes state in between, and it always sets BCM_SWAP_FRESH
+    const uint8_t next = atomic_exchange_explicit(&swap->state, front, memory_order_acq_rel) & BCM_SWAP_INDEX;
+    atomic_store_explicit(&swap->shown, swap->sequence[next], memory_order_relaxed);
+    return next;
+}
+
+/**
+ * @brief number of clocks at the start of a row shift the display stays on for, the OE
+ * duty that applies scene->brightness. the fraction of a clock brightness * width / 255
+ * leaves is carried from row to row, so every frame averages to brightness / 255 with
+ * the same pattern each frame and no per pixel table
+ * 
+ * @param brightness 0-255, 255 keeps the display on for the whole shift
+ * @param width clocks per row
+ * @param row index of the row in the frame, plane * half_height + y
+ * @param shift bcm_plane_oe_shift() of the plane on the display, 0 for a full plane
+ * @return uint16_t 0 - width
+ */
+static inline uint16_t bcm_oe_clocks(const uint8_t brightness, const uint16_t width, const uint32_t row, const uint8_t shift) {
+    const uint64_t on  = (uint64_t)brightness * width;
+    const uint64_t div = 255ULL << shift;
+    return (uint16_t)(((row + 1) * on) / div - (row * on) / div);
+}
+
+/**
+ * @brief how much shorter than a full plane the OE pulse of a plane is. the last plane
+ * (bit_depth - 1) is shown for 1 / 2^fraction_bits of a full plane, with 2 or more fraction bits
+ * the plane before it for 2 / 2^fraction_bits, wherever bcm_plane_order puts them in the frame.
+ * see scene_info.bcm_fraction_bits
+ * 
+ * @param bit_depth planes per frame
+ * @param fraction_bits scene_info.bcm_fraction_bits
+ * @param plane 0 - bit_depth-1
+ * @return uint8_t the pulse is 1 / 2^shift of a full plane, 0 for full planes
+ */
+static inline uint8_t bcm_plane_oe_shift(const uint8_t bit_depth, const uint8_t fraction_bits, const uint8_t plane) {
+    const uint8_t planes   = (fraction_bits < BCM_FRACTION_MAX_PLANES) ? fraction_bits : BCM_FRACTION_MAX_PLANES;
+    const uint8_t from_end = bit_depth - 1 - plane;
+    return (from_end < planes) ? fraction_bits - from_end : 0;
+}
+
+/**
+ * @brief bytes per channel of an image_format_e
+ * 
+ * @param format 
+ * @return uint8_t 1 for IMAGE_FORMAT_RGB8, 2 for the 16 bit formats
+ */
+static inline uint8_t image_channel_bytes(const enum image_format_e format) {
+    return (format == IMAGE_FORMAT_RGB8) ? 1 : 2;
+}
+
+/**
+ * @brief bytes per pixel of the images passed to scene->bcm_mapper
+ * 
+ * @param scene 
+ * @return uint8_t scene->stride channels of scene->image_format
+ */
+static inline uint8_t image_pixel_bytes(const scene_info *scene) {
+    return scene->stride * image_channel_bytes(scene->image_format);
+}
+
+/**
+ * @brief read the free running cycle counter. CNTVCT on ARM, the TSC on x86, else the
+ * monotonic clock in ns. see cycle_counter_frequency() for the ticks per second
+ * 
+ * @return uint64_t counter ticks
+ */
+static inline __attribute__((always_inline)) uint64_t cycle_counter(void) {
+#if defined(__aarch64__)
+    uint64_t ticks;
+    asm volatile ("mrs %0, cntvct_el0" : "=r" (ticks));
+    return ticks;
+#elif defined(__arm__)
+    uint32_t low, high;
+    asm volatile ("mrrc p15, 1, %0, %1, c14" : "=r" (low), "=r" (high));
+    return ((uint64_t)high << 32) | low;
+#elif defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+/**
+ * @brief busy wait for loops iterations of a 2 instruction count down, so the compiler can not
+ * unroll or merge it and every call site spins at the same rate. render_forever converts the
+ * panel_timing_t delays to iterations with spin_loops_per_us(), 0 returns at once
+ * 
+ * @param loops iterations to spin
+ */
+static inline __attribute__((always_inline)) void spin_delay(uint32_t loops) {
+    if (loops == 0) {
+        return;
+    }
+#if defined(__aarch64__)
+    asm volatile ("1: subs %w0, %w0, #1\n\tb.ne 1b" : "+r" (loops) : : "cc", "memory");
+#elif defined(__arm__)
+    asm volatile ("1: subs %0, %0, #1\n\tbne 1b" : "+r" (loops) : : "cc", "memory");
+#elif defined(__x86_64__) || defined(__i386__)
+    asm volatile ("1: dec %0\n\tjnz 1b" : "+r" (loops) : : "cc", "memory");
+#else
+    for (volatile uint32_t i=0; i<loops; i++) {
+    }
+#endif
+}
+
+/**
+ * @brief histogram bucket of a duration in counter ticks. durations below 4 ticks have a
+ * bucket each, above that every power of 2 is split into 4 buckets (within 25%)
+ * 
+ * @param ticks duration
+ * @return uint8_t bucket, 0 - SCANOUT_HISTOGRAM_BUCKETS-1
+ */
+static inline __attribute__((always_inline)) uint8_t scanout_bucket(const uint64_t ticks) {
+    if (ticks < 4) {
+        return ticks;
+    }
+    const uint8_t msb = 63 - __builtin_clzll(ticks);
+    const uint32_t bucket = msb * 4 + ((ticks >> (msb - 2)) & 3) - 4;
+    return (bucket < SCANOUT_HISTOGRAM_BUCKETS) ? bucket : SCANOUT_HISTOGRAM_BUCKETS - 1;
+}
+
+/**
+ * @brief shortest duration in counter ticks that falls into a histogram bucket
+ * 
+ * @param bucket from scanout_bucket()
+ * @return uint64_t ticks
+ */
+static inline uint64_t scanout_bucket_ticks(const uint8_t bucket) {
+    if (bucket < 4) {
+        return bucket;
+    }
+    const uint8_t msb = (bucket + 4) / 4;
+    return (uint64_t)(4 + (bucket + 4) % 4) << (msb - 2);
+}
+
 /**
  * @brief map an image of RGB or RGBA pixels to a pwm signal
- * handles double buffering and tone mapping for you
+ * handles triple buffering and tone mapping for you
  * 
  * @param image pointer to the image data
  * @param scene scene configuration
@@ -507,15 +1199,34 @@ void apply_noise_dithering(uint8_t *image, int width, int height);
  */
 void check_scene(const scene_info *scene);
 
+/**
+ * @brief calculate an address line pin mask for panel row y
+ * 
+ * @param y the panel row number to calculate the mask for
+ * @param half_height rows addressed on the panel (panel_height / 2)
+ * @return uint32_t the bitmask for the address lines at row y
+ */
+uint32_t row_to_address(const int y, uint8_t half_height);
+
+/**
+ * @brief compile scene->bcm_plane_order into the plane every row shows at every step of the frame
+ * 
+ * @param scene 
+ * @param schedule output, bit_depth * bcm_scan_rows() entries. [step * bcm_scan_rows() + y] is the
+ * plane row y shows at step 0 - bit_depth-1
+ */
+void bcm_plane_schedule(const scene_info *scene, uint8_t *schedule);
+
 
 uint8_t *u_mapper_impl(uint8_t *image_in, uint8_t *image_out, const struct scene_info *scene);
 uint8_t *flip_mapper_impl(const uint8_t *image_in, uint8_t *image_out, const struct scene_info *scene);
 
 /**
  * @brief render the PWM signal to the GPIO pins forever...
+ * picks up new frames from scene->bcm_swap at frame boundaries, the only part of scene it writes
  * 
  * @param scene 
  */
-void render_forever(const scene_info *scene);
+void render_forever(scene_info *scene);
 
 #endif
@@ -48,14 +48,61 @@ void debug(const char *format, ...);
 
 
 /**
- * @brief  calculate a jitter mask for the OE pin that should randomly toggle the OE pin on/off acording to brightness
- * TODO: look for rows of > 3 bits that are all the same and spread these bits out. this will reduce flicker on the display
+ * @brief allocate a zero filled buffer for the real time path (bcm and image buffers).
+ * backed by explicit huge pages if any are reserved (vm.nr_hugepages), else by transparent
+ * huge pages if the kernel has them, then prefaulted and locked in memory so neither page
+ * faults nor swapping reach the scanout core. prints the size and backing. exit on failure
  * 
- * @param jitter_size  prime number > 1024 < 4096
- * @param brightness   larger values produce brighter output, max 255
- * @return uint32_t*   a pointer to the jitter mask. caller must release memory
+ * @param bytes size of the buffer
+ * @param name name of the buffer for the report
+ * @return void* at least page aligned, never freed
  */
-uint32_t *create_jitter_mask(const uint16_t jitter_size, const uint8_t brightness);
+void *alloc_realtime_buffer(const size_t bytes, const char *name);
+
+/**
+ * @brief ticks per second of cycle_counter(). read from CNTFRQ on ARM, measured
+ * against the monotonic clock once (10 ms) everywhere else
+ * 
+ * @return uint64_t counter frequency in Hz
+ */
+uint64_t cycle_counter_frequency(void);
+
+/**
+ * @brief iterations of spin_delay() per microsecond. measured against the cycle counter
+ * once (a few ms), call it from the thread and core that will spin
+ * 
+ * @return double spin_delay() iterations per microsecond
+ */
+double spin_loops_per_us(void);
+
+/**
+ * @brief find a built in panel timing profile. "pi4" and "pi5" are the delays the scanout
+ * loops of each model always used, "fast" suits most shift register panels driven by a pi 5
+ * 
+ * @param name profile name
+ * @return const panel_timing_t* NULL if there is no such profile
+ */
+const panel_timing_t *panel_timing_profile(const char *name);
+
+/**
+ * @brief map a scanout stats block in shared memory (/dev/shm/<name>) so other processes
+ * can read the scanout timing. render_forever creates it, readers attach to it. exit on failure
+ * 
+ * @param name shared memory object name, IE: "/rpihub75"
+ * @param create true to create (and zero) the block for render_forever, false to attach read only
+ * @return scanout_stats_t* set as scene->scanout_stats when creating
+ */
+scanout_stats_t *scanout_stats_open(const char *name, const bool create);
+
+/**
+ * @brief copy a consistent snapshot of the scanout timing. never blocks render_forever,
+ * retries while a frame is being published
+ * 
+ * @param stats from scene->scanout_stats or scanout_stats_open()
+ * @param timing receives the snapshot
+ * @return bool false if render_forever has not published a frame yet
+ */
+bool scanout_stats_read(const scanout_stats_t *stats, scanout_timing_t *timing);
 
 /**
  * @brief write data to a file, exit on any failure
@@ -95,15 +142,6 @@ void binary32(FILE *fd, const uint32_t number);
  */
 void binary64(FILE *fd, const uint64_t number);
 
-/**
- * @brief read size random data from /dev/urandom into the buffer
- * 
- * @param buffer 
- * @param size 
- * @return int - always 0
- */
-int rnd(unsigned char *buffer, const size_t size);
-
 /**
  * @brief count number of times this function is called, 1 every second output
  * the number of times called and reset the counter. This function can not
@@ -0,0 +1,54 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifndef _HUB75_WORKERS_H
+#define _HUB75_WORKERS_H 1
+
+// maximum number of threads that can encode a frame (including the calling thread)
+#define MAX_ENCODE_THREADS 8
+
+/**
+ * @brief a job that can be split into row bands. called once per band with [row_start, row_end)
+ */
+typedef void (*worker_band_fn)(void *arg, const uint16_t row_start, const uint16_t row_end);
+
+/**
+ * @brief start the persistent worker pool. the calling thread always encodes the first band, 
+ * so num_threads - 1 worker threads are created. calling this again is a no-op while the pool is running.
+ * 
+ * @param num_threads total number of threads to split each job over (1-MAX_ENCODE_THREADS)
+ */
+void workers_start(const uint8_t num_threads);
+
+/**
+ * @brief keep the worker threads off the core the scanout thread runs on. the workers are pinned
+ * to every other online core, the ones already running are pinned again. realtime_setup()
+ * calls this with the core it picked, until then the workers may run on any core
+ *
+ * @param cpu scanout core, -1 for none
+ */
+void workers_set_scanout_cpu(const int16_t cpu);
+
+/**
+ * @brief split num_rows into one band per thread, run fn on every band and wait for all
+ * of them to finish. does not allocate. not re-entrant, only one thread may call this.
+ * 
+ * @param fn function to run for each band
+ * @param arg passed through to fn
+ * @param num_rows total number of rows to split
+ */
+void workers_run(worker_band_fn fn, void *arg, const uint16_t num_rows);
+
+/**
+ * @brief number of threads jobs are currently split over. 1 if the pool is not running
+ * 
+ * @return uint8_t 
+ */
+uint8_t workers_count(void);
+
+/**
+ * @brief stop and join all worker threads
+ */
+void workers_stop(void);
+
+#endif
@@ -0,0 +1,300 @@
+/**
+ * GPIO backends for render_forever. the pi 3, 4 and 5 backends write to the mmaped
+ * registers (see map_gpio() and configure_gpio()), the simulator records every write
+ * in memory so the scanout loop runs on any linux host.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/param.h>
+#include <math.h>
+
+#include "rpihub75.h"
+#include "util.h"
+#include "gpio.h"
+
+
+static void *gpio_hw_map(const gpio_backend_t *backend) {
+    return map_gpio(0, backend->version);
+}
+
+static void gpio_hw_configure(const gpio_backend_t *backend, void *gpio) {
+    configure_gpio((uint32_t *)gpio, backend->version);
+}
+
+// out of line copies of the register ops for the backend tables
+static void gpio_pi5_write_fn(void *gpio, const uint32_t pins) { gpio_pi5_write(gpio, pins); }
+static void gpio_pi5_set_fn(void *gpio, const uint32_t mask) { gpio_pi5_set(gpio, mask); }
+static void gpio_pi5_clear_fn(void *gpio, const uint32_t mask) { gpio_pi5_clear(gpio, mask); }
+static void gpio_pi4_write_fn(void *gpio, const uint32_t pins) { gpio_pi4_write(gpio, pins); }
+static void gpio_pi4_set_fn(void *gpio, const uint32_t mask) { gpio_pi4_set(gpio, mask); }
+static void gpio_pi4_clear_fn(void *gpio, const uint32_t mask) { gpio_pi4_clear(gpio, mask); }
+
+const gpio_backend_t gpio_backend_pi3 = {
+    .name = "pi3", .version = 3, .hardware = true,
+    .map = gpio_hw_map, .configure = gpio_hw_configure,
+    .write = gpio_pi4_write_fn, .set = gpio_pi4_set_fn, .clear = gpio_pi4_clear_fn
+};
+
+const gpio_backend_t gpio_backend_pi4 = {
+    .name = "pi4", .version = 4, .hardware = true,
+    .map = gpio_hw_map, .configure = gpio_hw_configure,
+    .write = gpio_pi4_write_fn, .set = gpio_pi4_set_fn, .clear = gpio_pi4_clear_fn
+};
+
+const gpio_backend_t gpio_backend_pi5 = {
+    .name = "pi5", .version = 5, .hardware = true,
+    .map = gpio_hw_map, .configure = gpio_hw_configure,
+    .write = gpio_pi5_write_fn, .set = gpio_pi5_set_fn, .clear = gpio_pi5_clear_fn
+};
+
+
+/**
+ * @brief detect the pi model from /proc/cpuinfo
+ * will die() if this is not a pi 3, 4 or 5
+ */
+const gpio_backend_t *gpio_detect_backend(void) {
+    // note one cannot use file_get_contents as this file is zero length...
+    FILE *file = fopen("/proc/cpuinfo", "rb");
+    if (file == NULL) {
+        die("Could not open file /proc/cpuinfo\n");
+    }
+
+    const gpio_backend_t *backend = NULL;
+    char *line = NULL;
+    size_t line_sz = 0;
+    while (backend == NULL && getline(&line, &line_sz, file) != -1) {
+        if (strstr(line, "Pi 5") != NULL) {
+            backend = &gpio_backend_pi5;
+        } else if (strstr(line, "Pi 4") != NULL) {
+            backend = &gpio_backend_pi4;
+        } else if (strstr(line, "Pi 3") != NULL) {
+            backend = &gpio_backend_pi3;
+        }
+    }
+    free(line);
+    fclose(file);
+
+    if (backend == NULL) {
+        die("Only Pi5, Pi4 and Pi3 are currently supported, set scene->gpio_backend to a gpio_sim_create() backend to run on other hosts\n");
+    }
+    return backend;
+}
+
+
+
+static void *gpio_sim_map(const gpio_backend_t *backend) {
+    return backend->context;
+}
+
+static void gpio_sim_configure(const gpio_backend_t *backend, void *gpio) {
+    gpio_sim_t *sim = (gpio_sim_t *)gpio;
+    debug("%s gpio, recording %zu writes\n", backend->name, sim->capacity);
+}
+
+/**
+ * @brief apply one write to the pin levels and record it if the log has room
+ */
+static inline void gpio_sim_record(gpio_sim_t *sim, const uint8_t op, const uint32_t value, const uint32_t pins) {
+    sim->pins = pins;
+    if (sim->writes < sim->capacity) {
+        gpio_sim_event_t *event = &sim->log[sim->writes];
+        event->value = value;
+        event->pins = pins;
+        event->op = op;
+        event->ticks = cycle_counter();
+    }
+    sim->writes++;
+}
+
+static void gpio_sim_write(void *gpio, const uint32_t pins) {
+    gpio_sim_t *sim = (gpio_sim_t *)gpio;
+    gpio_sim_record(sim, GPIO_OP_WRITE, pins, pins);
+}
+
+static void gpio_sim_set(void *gpio, const uint32_t mask) {
+    gpio_sim_t *sim = (gpio_sim_t *)gpio;
+    gpio_sim_record(sim, GPIO_OP_SET, mask, sim->pins | mask);
+}
+
+static void gpio_sim_clear(void *gpio, const uint32_t mask) {
+    gpio_sim_t *sim = (gpio_sim_t *)gpio;
+    gpio_sim_record(sim, GPIO_OP_CLEAR, mask, sim->pins & ~mask);
+}
+
+
+gpio_sim_t *gpio_sim_create(const uint8_t version, const size_t capacity) {
+    if (version < 3 || version > 5) {
+        die("simulated gpio supports pi versions 3-5, not %d\n", version);
+    }
+
+    gpio_sim_t *sim = (gpio_sim_t *)calloc(1, sizeof(gpio_sim_t));
+    if (sim == NULL) {
+        die("unable to allocate simulated gpio\n");
+    }
+    if (capacity > 0) {
+        sim->log = (gpio_sim_event_t *)malloc(capacity * sizeof(gpio_sim_event_t));
+        if (sim->log == NULL) {
+            die("unable to allocate %zu bytes for the gpio waveform log\n", capacity * sizeof(gpio_sim_event_t));
+        }
+    }
+    sim->capacity = capacity;
+
+    sim->backend = (gpio_backend_t) {
+        .name = (version == 5) ? "simulated pi5" : (version == 4) ? "simulated pi4" : "simulated pi3",
+        .version = version,
+        .hardware = false,
+        .map = gpio_sim_map,
+        .configure = gpio_sim_configure,
+        .write = gpio_sim_write,
+        .set = gpio_sim_set,
+        .clear = gpio_sim_clear,
+        .context = sim
+    };
+    return sim;
+}
+
+void gpio_sim_reset(gpio_sim_t *sim) {
+    sim->writes = 0;
+    sim->pins = 0;
+}
+
+void gpio_sim_free(gpio_sim_t *sim) {
+    if (sim != NULL) {
+        free(sim->log);
+        free(sim);
+    }
+}
+
+
+/**
+ * @brief replay the waveform log through a model of the HUB75 shift registers
+ * color pins are sampled on every rising edge of the clock pin, the row address
+ * on every rising edge of the latch pin
+ */
+uint32_t gpio_sim_decode(const gpio_sim_t *sim, gpio_latch_fn latch, void *arg) {
+    const size_t events = MIN(sim->writes, sim->capacity);
+    uint32_t *shifted = NULL;
+    uint32_t count = 0, allocated = 0, latches = 0;
+    uint32_t pins = 0;
+
+    for (size_t i=0; i<events; i++) {
+        const uint32_t next = sim->log[i].pins;
+        const uint32_t rising = next & ~pins;
+        pins = next;
+
+        if (rising & PIN_CLK) {
+            if (count == allocated) {
+                allocated = (allocated == 0) ? 256 : allocated * 2;
+                shifted = (uint32_t *)realloc(shifted, allocated * sizeof(uint32_t));
+                if (shifted == NULL) {
+                    die("unable to allocate the gpio decode shift register\n");
+                }
+            }
+            shifted[count++] = pins;
+        }
+        if (rising & PIN_LATCH) {
+            const uint8_t address =
+                ((pins >> ADDRESS_A) & 1) |
+                (((pins >> ADDRESS_B) & 1) << 1) |
+                (((pins >> ADDRESS_C) & 1) << 2) |
+                (((pins >> ADDRESS_D) & 1) << 3) |
+                (((pins >> ADDRESS_E) & 1) << 4);
+            latch(arg, address, shifted, count);
+            count = 0;
+            latches++;
+        }
+    }
+
+    free(shifted);
+    return latches;
+}
+
+
+double gpio_sim_uniformity(const gpio_sim_t *sim, const uint32_t frame_latches, const uint16_t bins) {
+    const size_t events = MIN(sim->writes, sim->capacity);
+    const uint32_t color_mask = GPIO_SCANOUT_MASK & ~(ADDRESS_LINES_MASK | PIN_OE | PIN_LATCH | PIN_CLK);
+    if (frame_latches == 0 || bins == 0) {
+        return 0;
+    }
+
+    // ticks of every frame boundary, a frame starts at every frame_latches'th latch
+    size_t allocated = 64, frames = 0;
+    uint64_t *start = (uint64_t *)malloc(allocated * sizeof(uint64_t));
+    double *light = (double *)calloc(bins, sizeof(double));
+    if (start == NULL || light == NULL) {
+        die("unable to allocate the gpio uniformity frames\n");
+    }
+    uint32_t pins = 0, latches = 0;
+    for (size_t i=0; i<events; i++) {
+        const uint32_t rising = sim->log[i].pins & ~pins;
+        pins = sim->log[i].pins;
+        if ((rising & PIN_LATCH) && (latches++ % frame_latches) == 0) {
+            if (frames == allocated) {
+                allocated *= 2;
+                start = (uint64_t *)realloc(start, allocated * sizeof(uint64_t));
+                if (start == NULL) {
+                    die("unable to allocate the gpio uniformity frames\n");
+                }
+            }
+            start[frames++] = sim->log[i].ticks;
+        }
+    }
+
+    // replay the log, the light of the latched row is lit color bits * ticks with OE low
+    double cv_sum = 0;
+    uint32_t cv_frames = 0;
+    uint32_t shifting = 0, latched = 0;
+    size_t frame = 0;
+    pins = 0;
+    for (size_t i=0; i+1<events && frame+1<frames; i++) {
+        const uint32_t rising = sim->log[i].pins & ~pins;
+        pins = sim->log[i].pins;
+        if (rising & PIN_CLK) {
+            shifting += __builtin_popcount(pins & color_mask);
+        }
+        if (rising & PIN_LATCH) {
+            latched  = shifting;
+            shifting = 0;
+        }
+
+        uint64_t from = sim->log[i].ticks;
+        const uint64_t to = sim->log[i + 1].ticks;
+        while (from < to && frame+1 < frames) {
+            // split the interval at the slice and frame boundaries
+            const uint64_t length = start[frame + 1] - start[frame];
+            if (from < start[frame]) {
+                from = MIN(to, start[frame]);
+                continue;
+            }
+            const uint16_t bin = MIN(((from - start[frame]) * bins) / MAX(length, 1), bins - 1);
+            const uint64_t end = MIN(to, start[frame] + ((((uint64_t)bin + 1) * length) + bins - 1) / bins);
+            if (!(pins & PIN_OE)) {
+                light[bin] += (double)latched * (end - from);
+            }
+            from = end;
+
+            if (from >= start[frame + 1]) {
+                double sum = 0, sum_sq = 0;
+                for (uint16_t b=0; b<bins; b++) {
+                    sum += light[b];
+                    sum_sq += light[b] * light[b];
+                }
+                const double mean = sum / bins;
+                if (mean > 0) {
+                    cv_sum += sqrt(MAX(sum_sq / bins - mean * mean, 0)) / mean;
+                    cv_frames++;
+                }
+                memset(light, 0, bins * sizeof(double));
+                frame++;
+            }
+        }
+    }
+
+    free(start);
+    free(light);
+    return (cv_frames > 0) ? cv_sum / cv_frames : 0;
+}
@@ -298,13 +298,41 @@ void *render_shader(void *arg) {
     glEnableVertexAttribArray(posAttrib);
     glVertexAttribPointer(posAttrib, 3, GL_FLOAT, GL_FALSE, 0, 0);
 
+    // 16 bit images render to a GL_RGBA16F framebuffer and are read back as half floats.
+    // the window surface only has 8 bits per channel
+    const bool half_float = scene->image_format != IMAGE_FORMAT_RGB8;
+    GLuint fbo = 0, fbo_texture = 0;
+    if (half_float) {
+        if (scene->motion_blur_frames > 0) {
+            die("motion blur is only supported for 8 bit images\n");
+        }
+        scene->image_format = IMAGE_FORMAT_RGB16F;
+
+        glGenTextures(1, &fbo_texture);
+        glBindTexture(GL_TEXTURE_2D, fbo_texture);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA16F, scene->width, scene->height);
+        glGenFramebuffers(1, &fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, fbo_texture, 0);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            die("GL_RGBA16F framebuffer is not supported by this GPU\n");
+        }
+
+        GLint read_format = 0, read_type = 0;
+        glGetIntegerv(GL_IMPLEMENTATION_COLOR_READ_FORMAT, &read_format);
+        glGetIntegerv(GL_IMPLEMENTATION_COLOR_READ_TYPE, &read_type);
+        if (read_format != GL_RGBA || read_type != GL_HALF_FLOAT) {
+            die("GL_RGBA16F framebuffer can not be read back as GL_HALF_FLOAT\n");
+        }
+    }
+
 
     // setup the timers for frame delays
     struct timespec start_time, end_time, orig_time;
     // uint32_t frame_time_us = 1000000 / scene->fps;
-    size_t image_buf_sz = scene->width * (scene->height) * sizeof(uint32_t);
+    size_t image_buf_sz = scene->width * (scene->height) * sizeof(uint32_t) * image_channel_bytes(scene->image_format);
 
-    // RGBA format (4 bytes per pixel)
+    // RGBA format (4 bytes per pixel, 8 for half float)
     GLubyte *restrict pixelsA __attribute__((aligned(16))) = (GLubyte*)malloc(image_buf_sz*(MAX(scene->motion_blur_frames+1,10)));
     if (pixelsA == NULL) {
         die("unable to allocate %d bytes memory for shader frames...\n", image_buf_sz * (MAX(scene->motion_blur_frames+1,10)));
@@ -402,7 +430,7 @@ void *render_shader(void *arg) {
 
         // switch between pixels buffers A-F based on frame number
         pixels = pixelsA + (frame_num * image_buf_sz);
-        glReadPixels(0, 0, scene->width, scene->height, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+        glReadPixels(0, 0, scene->width, scene->height, GL_RGBA, (half_float) ? GL_HALF_FLOAT : GL_UNSIGNED_BYTE, pixels);
 
         // apply motion blur in the CPU
         if (scene->motion_blur_frames > 0) {
@@ -430,6 +458,10 @@ void *render_shader(void *arg) {
 
     // Cleanup
     glDeleteBuffers(1, &vbo);
+    if (half_float) {
+        glDeleteFramebuffers(1, &fbo);
+        glDeleteTextures(1, &fbo_texture);
+    }
     eglDestroySurface(display, egl_surface);
     eglDestroyContext(display, context);
     eglTerminate(display);
@@ -20,6 +20,15 @@
 #include "rpihub75.h"
 #include "util.h"
 #include "pixels.h"
+#include "workers.h"
+
+#if defined(__ARM_NEON)
+    #include <arm_neon.h>
+#elif defined(__AVX2__)
+    #include <immintrin.h>
+#elif defined(__SSE2__)
+    #include <emmintrin.h>
+#endif
 
 
 
@@ -506,709 +515,1110 @@ uint64_t byte_to_bcm64(const uint8_t input, const uint8_t num_bits) {
     return bcm_signal;
 }
 
-
-
 /**
- * @brief map 6 pixels of to bcm data. supports 3 output ports with 2 pixels per port. RGB pixel order version.
+ * @brief convert a positive IEEE half float to float
  * 
- * @param scene the scene information
- * @param void_bits pointer to the gamma corrected tone mapped pwm data for each RGB value. (uint32_t !)
- * @param pwm_signal pointer to the bcm data for current X/Y. (y = 0 - panel_height/2), scene->bit_depth bytes will be updated here
- * @param image pointer to 24bpp RGB or 32bpp RGBA image data at the current pixel offset. IE: image[offset]
+ * @param half sign bit clear
+ * @return float 
  */
-__attribute__((hot))
-void update_bcm_signal_32_rgb(
-    const scene_info *scene,
-    const void *__restrict__ void_bits,
-    uint32_t *__restrict__ bcm_signal,
-    const uint8_t *__restrict__ image) {
-
-    const uint32_t *bits_red = (const uint32_t*)void_bits;
-    const uint32_t *bits_green = bits_red+256;
-    const uint32_t *bits_blue = bits_red+512;
-
-    // offset to the Port0 top pixel image
-    //uint32_t img_idx = offset;
-    // offset from top pixel to lower pixel in image data. 
-    static uint32_t panel_stride = 0;
-    // offsets for each pixel on each port
-    static uint32_t p0t = 0, p0b = 0, p1t = 0, p1b = 0, p2t = 0, p2b =0;
-
-    // calculate the image index to all 3 ports. we only need to do this once ever
-    if (UNLIKELY(panel_stride == 0)) {
-        panel_stride = scene->width * (scene->panel_height / 2) * scene->stride;
-        p0b = p0t + panel_stride;
-        p1t = p0b + panel_stride;
-        p1b = p1t + panel_stride;
-        p2t = p1b + panel_stride;
-        p2b = p2t + panel_stride;
-    }
-
-    // inform compiler that bit depth is aligned, improves compiler optimization
-    // BIT_DEPTH_ALIGNMENT should be multiple of 4, ideally 16. 
-    uint8_t bit_depth __attribute__((aligned(BIT_DEPTH_ALIGNMENT))) = scene->bit_depth;
-
-    ASSERT(bit_depth % BIT_DEPTH_ALIGNMENT == 0);
-    ASSERT(bit_depth <= 32);
-
-
-    uint8_t bcm_offset = 0;
-    for (int j=0; j<bit_depth; j++) {
-        // mask off just this bit plane's data
-        const uint32_t mask = 1 << j;
-
-        // this works by first finding the index into the red byte (+0) of the 24bpp source image
-        // looking up the bcm bit mask value at that red color value (128 = 1010101010101..), logical AND with
-        // the current bit position we are calculating (1<<j) and then shifting that bit (0 or 1) to the correct pin (ADDRESS_Px_CX)
-        // and logical OR that value for the current bcm_signal offset.
-        // repeat this for green (+1), blue (+2), and once for each pixel on each port
+static inline float half_to_float(const uint16_t half) {
+    const uint32_t exponent = (half >> 10) & 0x1F;
+    // rebias the exponent from 15 to 127. inf and NaN stay inf and NaN
+    const uint32_t bits = ((uint32_t)(half & 0x7FFF) << 13) + ((exponent == 0x1F) ? (0xFFu - 0x1F) << 23 : (127u - 15) << 23);
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    // zero and subnormals are mantissa * 2^-24
+    return (exponent == 0) ? (float)(half & 0x3FF) * 5.9604644775e-8f : value;
+}
 
-        // !! - first ! turns 00100000 into 0000000, second ! turns 000000 into 00000001
-        // !! - first ! turns 00000000 into 0000001, second ! turns 000001 into 00000000
-        // this way we get a 1 value for the mask of the (bcm_bits & mask) so we can << the correct number of bits
 
-        bcm_signal[bcm_offset++] =
-            // PORT 0, top pixel
-            (!!(bits_red[image[0]] & mask)) << ADDRESS_P0_R1 |
-            (!!(bits_green[image[1]] & mask)) << ADDRESS_P0_G1 |
-            (!!(bits_blue[image[2]] & mask)) << ADDRESS_P0_B1 |
 
-            // PORT 0, bottom pixel
-            (!!(bits_red[image[p0b+0]] & mask)) << ADDRESS_P0_R2 |
-            (!!(bits_green[image[p0b+1]] & mask)) << ADDRESS_P0_G2 |
-            (!!(bits_blue[image[p0b+2]] & mask)) << ADDRESS_P0_B2 |
+// number of (port, top/bottom row, color) combinations shifted out on each clock
+#define BCM_SLOTS 18
+// most rows the encoder tracks, panel_height / 2 is held in a uint8_t
+#define BCM_MAX_ROWS 256
 
-            // PORT 1, bottom pixel
-            (!!(bits_red[image[p1t+0]] & mask)) << ADDRESS_P1_R1 |
-            (!!(bits_green[image[p1t+1]] & mask)) << ADDRESS_P1_G1 |
-            (!!(bits_blue[image[p1t+2]] & mask)) << ADDRESS_P1_B1 |
+/**
+ * @brief pin numbers for each (port, top/bottom row, color) of the HUB75 connector.
+ * indexed as [port][0 = top (R1/G1/B1), 1 = bottom (R2/G2/B2)][0 = red, 1 = green, 2 = blue]
+ */
+static const uint8_t bcm_port_pins[3][2][3] = {
+    {{ADDRESS_P0_R1, ADDRESS_P0_G1, ADDRESS_P0_B1}, {ADDRESS_P0_R2, ADDRESS_P0_G2, ADDRESS_P0_B2}},
+    {{ADDRESS_P1_R1, ADDRESS_P1_G1, ADDRESS_P1_B1}, {ADDRESS_P1_R2, ADDRESS_P1_G2, ADDRESS_P1_B2}},
+    {{ADDRESS_P2_R1, ADDRESS_P2_G1, ADDRESS_P2_B1}, {ADDRESS_P2_R2, ADDRESS_P2_G2, ADDRESS_P2_B2}}
+};
 
-            // PORT 1, bottom pixel
-            (!!(bits_red[image[p1b+0]] & mask)) << ADDRESS_P1_R2 |
-            (!!(bits_green[image[p1b+1]] & mask)) << ADDRESS_P1_G2 |
-            (!!(bits_blue[image[p1b+2]] & mask)) << ADDRESS_P1_B2 |
+/**
+ * @brief which panel color (0 = red, 1 = green, 2 = blue) each image byte (+0, +1, +2) is wired to
+ * for every pixel_order_e
+ */
+static const uint8_t bcm_order_colors[3][3] = {
+    [PIXEL_ORDER_RGB] = {0, 1, 2},
+    [PIXEL_ORDER_RBG] = {0, 2, 1},
+    [PIXEL_ORDER_BGR] = {2, 1, 0}
+};
 
-            // PORT 2, bottom pixel
-            (!!(bits_red[image[p2t+0]] & mask)) << ADDRESS_P2_R1 |
-            (!!(bits_green[image[p2t+1]] & mask)) << ADDRESS_P2_G1 |
-            (!!(bits_blue[image[p2t+2]] & mask)) << ADDRESS_P2_B1 |
+/**
+ * vector helpers for the bit transpose encoder. each lane holds one pixel column of a row,
+ * so one vector store writes BCM_VEC_LANES neighboring pixels of the same bit plane.
+ * with BCM_SIMD 0 the same code is generated with one scalar lane.
+ */
+#if BCM_SIMD && defined(__ARM_NEON)
+    typedef uint32x4_t bcm_vec;
+    #define BCM_VEC_LANES 4
+    #define bcm_vload(p)        vld1q_u32(p)
+    #define bcm_vstore(p, v)    vst1q_u32((p), (v))
+    #define bcm_vset1(x)        vdupq_n_u32(x)
+    #define bcm_vor(a, b)       vorrq_u32((a), (b))
+    // vtst sets a lane to all 1s if (v & bit) != 0, then select the pin mask for that lane
+    #define bcm_vselect(v, bit, pin) vandq_u32(vtstq_u32((v), (bit)), (pin))
+#elif BCM_SIMD && defined(__AVX2__)
+    typedef __m256i bcm_vec;
+    #define BCM_VEC_LANES 8
+    #define bcm_vload(p)        _mm256_load_si256((const __m256i *)(p))
+    #define bcm_vstore(p, v)    _mm256_storeu_si256((__m256i *)(p), (v))
+    #define bcm_vset1(x)        _mm256_set1_epi32(x)
+    #define bcm_vor(a, b)       _mm256_or_si256((a), (b))
+    #define bcm_vselect(v, bit, pin) _mm256_and_si256(_mm256_cmpeq_epi32(_mm256_and_si256((v), (bit)), (bit)), (pin))
+#elif BCM_SIMD && defined(__SSE2__)
+    typedef __m128i bcm_vec;
+    #define BCM_VEC_LANES 4
+    #define bcm_vload(p)        _mm_load_si128((const __m128i *)(p))
+    #define bcm_vstore(p, v)    _mm_storeu_si128((__m128i *)(p), (v))
+    #define bcm_vset1(x)        _mm_set1_epi32(x)
+    #define bcm_vor(a, b)       _mm_or_si128((a), (b))
+    #define bcm_vselect(v, bit, pin) _mm_and_si128(_mm_cmpeq_epi32(_mm_and_si128((v), (bit)), (bit)), (pin))
+#else
+    typedef uint32_t bcm_vec;
+    #define BCM_VEC_LANES 1
+    #define bcm_vload(p)        (*(p))
+    #define bcm_vstore(p, v)    (*(p) = (v))
+    #define bcm_vset1(x)        (x)
+    #define bcm_vor(a, b)       ((a) | (b))
+    #define bcm_vselect(v, bit, pin) (((v) & (bit)) ? (pin) : 0)
+#endif
+
+// half float 1.0, brighter values (and inf, NaN) are encoded as 1.0
+#define BCM_HALF_ONE 0x3C00
 
-            // PORT 2, bottom pixel
-            (!!(bits_red[image[p2b+0]] & mask)) << ADDRESS_P2_R2 |
-            (!!(bits_green[image[p2b+1]] & mask)) << ADDRESS_P2_G2 |
-            (!!(bits_blue[image[p2b+2]] & mask)) << ADDRESS_P2_B2;
+/**
+ * @brief lookup table index of one image channel. 8 bit channels index the 256 entry
+ * table directly, 16 bit channels are reduced to a BCM_DEEP_BITS index
+ * 
+ * @param channel first byte of the channel
+ * @param format image_format_e, compile time constant
+ * @return uint16_t 
+ */
+__attribute__((always_inline))
+static inline uint16_t bcm_channel_index(const uint8_t *__restrict__ channel, const enum image_format_e format) {
+    if (format == IMAGE_FORMAT_RGB8) {
+        return channel[0];
+    }
 
+    uint16_t value;
+    memcpy(&value, channel, sizeof(value));
+    if (format == IMAGE_FORMAT_RGB16F) {
+        // positive half floats sort as integers, so the bits below the sign and the exponent
+        // msb (both clear up to 1.0) are a log scale index. negative is black
+        return (value & 0x8000) ? 0 : (MIN(value, BCM_HALF_ONE) >> (14 - BCM_DEEP_BITS));
     }
-    // bcm_signal is now bit mask of length bit_depth for these 6 pixels that can be iterated through to light
-    // the LEDS to the correct brightness levels
+    return value >> (16 - BCM_DEEP_BITS);
 }
 
 /**
- * @brief See update_bcm_signal_32_rgb. RBG pixel order version.
+ * @brief transpose num_slots x BCM_VEC_LANES bcm words into num_planes x BCM_VEC_LANES GPIO words.
+ * GPIO word (plane j, pixel k) is the OR of pin[s] for every slot s with bit j set in words[s][k]
+ * 
+ * @param words [slot][pixel] bcm words, 32 byte aligned
+ * @param pins one broadcast pin mask per slot
+ * @param num_slots number of used slots
+ * @param bcm_signal output for plane 0 of the first pixel
+ * @param num_planes number of planes to output (1-32)
+ * @param plane_stride distance in words between two bit planes
+ * @param pixel_stride distance in words between two pixels of the same plane
  */
 __attribute__((hot))
-void update_bcm_signal_32_rbg(
-    const scene_info *scene,
-    const void *__restrict__ void_bits,
+static inline void bcm_transpose_planes(
+    const uint32_t (*__restrict__ words)[BCM_VEC_LANES],
+    const bcm_vec *__restrict__ pins,
+    const uint8_t num_slots,
     uint32_t *__restrict__ bcm_signal,
-    const uint8_t *__restrict__ image) {
+    const uint8_t num_planes,
+    const uint32_t plane_stride,
+    const uint32_t pixel_stride) {
 
-    const uint32_t *bits_red = (const uint32_t*)void_bits;
-    const uint32_t *bits_green = bits_red+256;
-    const uint32_t *bits_blue = bits_red+512;
-
-    // offset to the Port0 top pixel image
-    //uint32_t img_idx = offset;
-    // offset from top pixel to lower pixel in image data. 
-    static uint32_t panel_stride = 0;
-    // offsets for each pixel on each port
-    static uint32_t p0t = 0, p0b = 0, p1t = 0, p1b = 0, p2t = 0, p2b =0;
-
-    // calculate the image index to all 3 ports. we only need to do this once ever
-    if (UNLIKELY(panel_stride == 0)) {
-        panel_stride = scene->width * (scene->panel_height / 2) * scene->stride;
-        p0b = p0t + panel_stride;
-        p1t = p0b + panel_stride;
-        p1b = p1t + panel_stride;
-        p2t = p1b + panel_stride;
-        p2b = p2t + panel_stride;
+    bcm_vec val[BCM_SLOTS];
+    for (uint8_t s = 0; s < num_slots; s++) {
+        val[s] = bcm_vload(words[s]);
     }
 
-    // inform compiler that bit depth is aligned, improves compiler optimization
-    // BIT_DEPTH_ALIGNMENT should be multiple of 4, ideally 16. 
-    uint8_t bit_depth __attribute__((aligned(BIT_DEPTH_ALIGNMENT))) = scene->bit_depth;
+    for (uint8_t j = 0; j < num_planes; j++) {
+        const bcm_vec bit = bcm_vset1(1u << j);
+        bcm_vec acc = bcm_vselect(val[0], bit, pins[0]);
+        for (uint8_t s = 1; s < num_slots; s++) {
+            acc = bcm_vor(acc, bcm_vselect(val[s], bit, pins[s]));
+        }
 
-    ASSERT(bit_depth % BIT_DEPTH_ALIGNMENT == 0);
-    ASSERT(bit_depth <= 32);
+        uint32_t *out = bcm_signal + (j * plane_stride);
+        if (LIKELY(pixel_stride == 1)) {
+            // BCM_LAYOUT_PLANE, the pixels of one plane are contiguous
+            bcm_vstore(out, acc);
+        } else {
+            _Alignas(32) uint32_t lanes[BCM_VEC_LANES];
+            bcm_vstore(lanes, acc);
+            for (uint8_t k = 0; k < BCM_VEC_LANES; k++) {
+                out[k * pixel_stride] = lanes[k];
+            }
+        }
+    }
+}
 
+void bcm_build_row_args(const scene_info *scene, bcm_row_args *args) {
+    // zero the padding too, callers compare args with memcmp to detect configuration changes
+    memset(args, 0, sizeof(bcm_row_args));
+
+    args->panel_stride = scene->width * (scene->panel_height / 2) * image_pixel_bytes(scene);
+    args->plane_stride = bcm_plane_stride(scene);
+    args->pixel_stride = bcm_pixel_stride(scene);
+    args->row_stride   = bcm_row_stride(scene);
+    args->width        = bcm_shift_width(scene);
+    args->stride       = image_pixel_bytes(scene);
+    args->image_format = scene->image_format;
+    args->bit_depth    = scene->bit_depth;
+    args->pixel_order  = scene->pixel_order;
+    args->num_ports    = scene->num_ports;
+    // the pin spread and dither tables are indexed by 8 bit values, the 12 bit lookup
+    // table of the 16 bit formats already resolves the levels dithering would simulate.
+    // color lut rows are encoded as 16 bit
+    const bool byte_image = scene->image_format == IMAGE_FORMAT_RGB8 && scene->color_lut == NULL;
+    args->pin_spread   = scene->bcm_pin_spread && byte_image;
+    args->remapped     = (scene->panel_layout != PANEL_LAYOUT_NONE) || (scene->panel_rotation != 0) ||
+                         (bcm_scan_rows(scene) != scene->panel_height / 2);
+    args->dithered     = scene->dither > 0.1f && byte_image;
+    args->dither       = (args->dithered) ? scene->dither : 0.0f;
+    args->panel_layout   = scene->panel_layout;
+    args->panel_rotation = scene->panel_rotation;
+    args->height       = scene->height;
+    args->panel_width  = scene->panel_width;
+    args->panel_height = scene->panel_height;
+    args->scan_rows    = bcm_scan_rows(scene);
+    args->scan_tile    = scene->scan_pattern.tile_width;
+    args->scan_flags   = scene->scan_pattern.flags;
+    args->color_lut    = scene->color_lut;
+    args->stream       = bcm_layout_stream(scene->bcm_layout);
+    args->set_clear    = scene->bcm_layout == BCM_LAYOUT_SET_CLEAR;
+    if (args->stream) {
+        args->brightness    = (scene->oe_brightness) ? scene->brightness : 255;
+        args->fraction_bits = scene->bcm_fraction_bits;
+
+        // the row latched before each row in the schedule. every row starts the same number
+        // of planes after the row above, so all rows but the first have the same predecessors
+        const uint8_t rows = bcm_scan_rows(scene);
+        uint8_t schedule[scene->bit_depth * rows];
+        bcm_plane_schedule(scene, schedule);
+        for (uint8_t step = 0; step < scene->bit_depth; step++) {
+            const uint8_t last = (step + scene->bit_depth - 1) % scene->bit_depth;
+            args->shown_before[0][schedule[step * rows]] = schedule[(last * rows) + rows - 1];
+            args->shown_before[1][schedule[(step * rows) + 1]] = schedule[step * rows];
+        }
+    }
+}
 
-    uint8_t bcm_offset = 0;
-    for (int j=0; j<bit_depth; j++) {
-        // mask off just this bit plane's data
-        const uint32_t mask = 1 << j;
+uint32_t *bcm_build_remap(const bcm_row_args *args) {
+    if (!args->remapped) {
+        return NULL;
+    }
 
-        // this works by first finding the index into the red byte (+0) of the 24bpp source image
-        // looking up the bcm bit mask value at that red color value (128 = 1010101010101..), logical AND with
-        // the current bit position we are calculating (1<<j) and then shifting that bit (0 or 1) to the correct pin (ADDRESS_Px_CX)
-        // and logical OR that value for the current bcm_signal offset.
-        // repeat this for green (+1), blue (+2), and once for each pixel on each port
+    const uint16_t width  = args->width;
+    const uint16_t pw     = args->panel_width;
+    const uint16_t ph     = args->panel_height;
+    const uint16_t rows   = args->scan_rows * 2 * args->num_ports;
+    // panel rows each row address lights in each half, and the chain length in panel pixels
+    const uint16_t group  = (ph / 2) / args->scan_rows;
+    const uint16_t chain  = width / group;
+    const uint16_t chains = chain / pw;
+    const uint16_t tile   = (args->scan_tile != 0) ? args->scan_tile : pw;
+    const bool u_chain    = args->panel_layout & PANEL_LAYOUT_U;
+
+    // the image as drawn. U chains fold each port's chain into two panel rows
+    const uint16_t image_width  = (u_chain) ? chain / 2 : chain;
+    const uint16_t image_height = (u_chain) ? args->height * 2 : args->height;
+    // panels per row and image rows per port
+    const uint16_t row_panels   = (u_chain) ? chains / 2 : chains;
+    const uint16_t port_rows    = (u_chain) ? ph * 2 : ph;
+
+    ASSERT(chain % pw == 0);
+    ASSERT(pw % tile == 0);
+    ASSERT(image_height >= port_rows * args->num_ports);
+    ASSERT(args->panel_rotation % 180 == 0 || pw == ph);
+
+    const size_t bytes = (size_t)width * rows * sizeof(uint32_t);
+    uint32_t *remap = (uint32_t*)aligned_alloc(32, bytes);
+    if (remap == NULL) {
+        die("unable to allocate %zu bytes for the panel layout table\n", bytes);
+    }
 
-        // !! - first ! turns 00100000 into 0000000, second ! turns 000000 into 00000001
-        // !! - first ! turns 00000000 into 0000001, second ! turns 000001 into 00000000
-        // this way we get a 1 value for the mask of the (bcm_bits & mask) so we can << the correct number of bits
+    for (uint16_t y = 0; y < rows; y++) {
+        const uint16_t port    = y / (args->scan_rows * 2);
+        const uint16_t half    = (y / args->scan_rows) % 2;
+        const uint16_t address = y % args->scan_rows;
+        for (uint16_t x = 0; x < width; x++) {
+            // the scan pattern: each panel shifts group * pw clocks per address, tile pixels
+            // of one lit row at a time. the standard scan is a single group of one tile
+            const uint16_t panel   = x / (pw * group);
+            const uint16_t clock   = x % (pw * group);
+            const uint16_t segment = (clock % (tile * group)) / tile;
+            const uint16_t lit     = (args->scan_flags & SCAN_BOTTOM_FIRST) ? group - 1 - segment : segment;
+            const bool reversed    = (args->scan_flags & SCAN_ZIGZAG) && (segment & 1);
+            const uint16_t px      = ((clock / (tile * group)) * tile) + ((reversed) ? tile - 1 - (clock % tile) : clock % tile);
+            const uint16_t py      = (half * (ph / 2)) + (lit * args->scan_rows) + address;
+
+            // position on the panel after rotating it
+            uint16_t lx = px, ly = py;
+            switch (args->panel_rotation) {
+            case 90:
+                lx = ph - 1 - py;
+                ly = px;
+                break;
+            case 180:
+                lx = pw - 1 - px;
+                ly = ph - 1 - py;
+                break;
+            case 270:
+                lx = py;
+                ly = pw - 1 - px;
+                break;
+            }
 
-        bcm_signal[bcm_offset++] =
-            // PORT 0, top pixel
-            (!!(bits_red[image[0]] & mask)) << ADDRESS_P0_R1 |
-            (!!(bits_green[image[1]] & mask)) << ADDRESS_P0_B1 |
-            (!!(bits_blue[image[2]] & mask)) << ADDRESS_P0_G1 |
+            // where the panel sits in the image. the returning half of a U chain is upside down
+            uint16_t column = panel, row = 0;
+            if (u_chain && panel >= row_panels) {
+                column = chains - 1 - panel;
+                row    = 1;
+                lx     = pw - 1 - lx;
+                ly     = ph - 1 - ly;
+            }
 
-            // PORT 0, bottom pixel
-            (!!(bits_red[image[p0b+0]] & mask)) << ADDRESS_P0_R2 |
-            (!!(bits_green[image[p0b+1]] & mask)) << ADDRESS_P0_B2 |
-            (!!(bits_blue[image[p0b+2]] & mask)) << ADDRESS_P0_G2 |
+            uint16_t ix = (column * pw) + lx;
+            uint16_t iy = (port * port_rows) + (row * ph) + ly;
+            if (args->panel_layout & PANEL_LAYOUT_MIRROR) {
+                ix = image_width - 1 - ix;
+            }
+            if (args->panel_layout & PANEL_LAYOUT_FLIP) {
+                iy = image_height - 1 - iy;
+            }
 
-            // PORT 1, bottom pixel
-            (!!(bits_red[image[p1t+0]] & mask)) << ADDRESS_P1_R1 |
-            (!!(bits_green[image[p1t+1]] & mask)) << ADDRESS_P1_B1 |
-            (!!(bits_blue[image[p1t+2]] & mask)) << ADDRESS_P1_G1 |
+            remap[(y * width) + x] = ((iy * image_width) + ix) * args->stride;
+        }
+    }
 
-            // PORT 1, bottom pixel
-            (!!(bits_red[image[p1b+0]] & mask)) << ADDRESS_P1_R2 |
-            (!!(bits_green[image[p1b+1]] & mask)) << ADDRESS_P1_B2 |
-            (!!(bits_blue[image[p1b+2]] & mask)) << ADDRESS_P1_G2 |
+    return remap;
+}
 
-            // PORT 2, bottom pixel
-            (!!(bits_red[image[p2t+0]] & mask)) << ADDRESS_P2_R1 |
-            (!!(bits_green[image[p2t+1]] & mask)) << ADDRESS_P2_B1 |
-            (!!(bits_blue[image[p2t+2]] & mask)) << ADDRESS_P2_G1 |
+uint8_t *bcm_build_dither(const bcm_row_args *args) {
+    if (!args->dithered) {
+        return NULL;
+    }
 
-            // PORT 2, bottom pixel
-            (!!(bits_red[image[p2b+0]] & mask)) << ADDRESS_P2_R2 |
-            (!!(bits_green[image[p2b+1]] & mask)) << ADDRESS_P2_B2 |
-            (!!(bits_blue[image[p2b+2]] & mask)) << ADDRESS_P2_G2;
+    uint8_t *dither = (uint8_t*)malloc(BCM_DITHER_TILE * BCM_DITHER_ROW);
+    if (dither == NULL) {
+        die("unable to allocate memory for the dither table\n");
+    }
 
+    for (uint8_t y = 0; y < BCM_DITHER_TILE; y++) {
+        for (uint8_t channel = 0; channel < 3; channel++) {
+            for (uint8_t x = 0; x < BCM_DITHER_TILE; x++) {
+                // offset the tile for each channel so the colors do not dither in lock step
+                const uint8_t tx = (x + (channel * 3)) % BCM_DITHER_TILE;
+                const uint8_t ty = (y + (channel * 5)) % BCM_DITHER_TILE;
+
+                // 8x8 bayer threshold, bit interleave of x ^ y and y (0 - 63)
+                const uint8_t xy = tx ^ ty;
+                const uint8_t level = ((xy & 1) << 5) | ((ty & 1) << 4) | ((xy & 2) << 2) |
+                                      ((ty & 2) << 1) | ((xy & 4) >> 1) | ((ty & 4) >> 2);
+
+                // centered threshold scaled to +/- dither
+                const int16_t offset = lroundf((((level * 2) + 1 - 64) / 64.0f) * args->dither);
+                uint8_t *values = dither + (y * BCM_DITHER_ROW) + (((channel * BCM_DITHER_TILE) + x) * 256);
+                values[0] = 0;
+                for (uint16_t value = 1; value < 256; value++) {
+                    values[value] = (uint8_t)MIN(MAX(value + offset, 1), 255);
+                }
+            }
+        }
     }
-    // bcm_signal is now bit mask of length bit_depth for these 6 pixels that can be iterated through to light
-    // the LEDS to the correct brightness levels
+
+    return dither;
 }
 
 /**
- * @brief See update_bcm_signal_32_rgb. BGR pixel order version.
+ * vector helpers for the color lut interpolation. one vector holds the padded RGB of one
+ * lattice point, so each of the 4 tetrahedron corners is one load and one multiply-add.
+ * with BCM_SIMD 0 the compiler lowers the same code to whatever the target has
  */
-__attribute__((hot))
-void update_bcm_signal_32_bgr(
-    const scene_info *scene,
-    const void *__restrict__ void_bits,
-    uint32_t *__restrict__ bcm_signal,
-    const uint8_t *__restrict__ image) {
-
-    const uint32_t *bits_red = (const uint32_t*)void_bits;
-    const uint32_t *bits_green = bits_red+256;
-    const uint32_t *bits_blue = bits_red+512;
-
-    // offset to the Port0 top pixel image
-    //uint32_t img_idx = offset;
-    // offset from top pixel to lower pixel in image data.
-    static uint32_t panel_stride = 0;
-    // offsets for each pixel on each port
-    static uint32_t p0t = 0, p0b = 0, p1t = 0, p1b = 0, p2t = 0, p2b =0;
-
-    // calculate the image index to all 3 ports. we only need to do this once ever
-    if (UNLIKELY(panel_stride == 0)) {
-        panel_stride = scene->width * (scene->panel_height / 2) * scene->stride;
-        p0b = p0t + panel_stride;
-        p1t = p0b + panel_stride;
-        p1b = p1t + panel_stride;
-        p2t = p1b + panel_stride;
-        p2b = p2t + panel_stride;
+#if BCM_SIMD && defined(__ARM_NEON)
+    typedef float32x4_t cube_vec;
+    #define cube_vload(p)           vld1q_f32(p)
+    #define cube_vmul(a, w)         vmulq_n_f32((a), (w))
+    #define cube_vmla(acc, a, w)    vmlaq_n_f32((acc), (a), (w))
+    // clamp to 0.0 - 1.0 and store as 4 rounded 16 bit levels in uint32_t lanes
+    #define cube_vstore_levels(p, v) vst1q_u32((p), vcvtq_u32_f32(vmlaq_n_f32(vdupq_n_f32(0.5f), \
+        vminq_f32(vmaxq_f32((v), vdupq_n_f32(0.0f)), vdupq_n_f32(1.0f)), 65535.0f)))
+#elif BCM_SIMD && defined(__SSE2__)
+    typedef __m128 cube_vec;
+    #define cube_vload(p)           _mm_load_ps(p)
+    #define cube_vmul(a, w)         _mm_mul_ps((a), _mm_set1_ps(w))
+    #define cube_vmla(acc, a, w)    _mm_add_ps((acc), _mm_mul_ps((a), _mm_set1_ps(w)))
+    #define cube_vstore_levels(p, v) _mm_store_si128((__m128i *)(p), _mm_cvttps_epi32(_mm_add_ps(_mm_set1_ps(0.5f), \
+        _mm_mul_ps(_mm_min_ps(_mm_max_ps((v), _mm_setzero_ps()), _mm_set1_ps(1.0f)), _mm_set1_ps(65535.0f)))))
+#else
+    typedef float cube_vec __attribute__((vector_size(16)));
+    #define cube_vload(p)           (*(const cube_vec *)(p))
+    #define cube_vmul(a, w)         ((a) * (w))
+    #define cube_vmla(acc, a, w)    ((acc) + ((a) * (w)))
+    #define cube_vstore_levels(p, v) do { \
+        for (uint8_t lane = 0; lane < 4; lane++) { \
+            (p)[lane] = (uint32_t)((MIN(MAX((v)[lane], 0.0f), 1.0f) * 65535.0f) + 0.5f); \
+        } \
+    } while (0)
+#endif
+
+void bcm_build_cube(const color_lut_t *lut, const uint8_t image_format, bcm_cube *cube) {
+    ASSERT(lut->size >= 2);
+    const uint16_t levels = (image_format == IMAGE_FORMAT_RGB8) ? 256 : BCM_DEEP_LEVELS;
+    const float last      = (float)(lut->size - 1);
+
+    cube->table   = lut->table;
+    cube->step[0] = 4;
+    cube->step[1] = 4 * lut->size;
+    cube->step[2] = 4 * lut->size * lut->size;
+
+    // the tetrahedron of a cell is selected by which fractions are larger, case bits are
+    // (r > g) << 2 | (g > b) << 1 | (r > b). walk from the lower corner along the axis with the
+    // largest fraction, then the second largest. cases 1 and 6 can not happen
+    static const uint8_t axis_order[8][2] = {
+        {2, 0}, {2, 2}, {1, 0}, {1, 2}, {2, 1}, {0, 1}, {2, 2}, {0, 2}
+    };
+    const uint32_t diagonal = cube->step[0] + cube->step[1] + cube->step[2];
+    for (uint8_t i = 0; i < 8; i++) {
+        cube->walk[i][0] = cube->step[axis_order[i][0]];
+        cube->walk[i][1] = diagonal - cube->step[axis_order[i][1]];
     }
 
-    // inform compiler that bit depth is aligned, improves compiler optimization
-    // BIT_DEPTH_ALIGNMENT should be multiple of 4, ideally 16.
-    uint8_t bit_depth __attribute__((aligned(BIT_DEPTH_ALIGNMENT))) = scene->bit_depth;
-
-    ASSERT(bit_depth % BIT_DEPTH_ALIGNMENT == 0);
-    ASSERT(bit_depth <= 32);
-
-
-    uint8_t bcm_offset = 0;
-    for (int j=0; j<bit_depth; j++) {
-        // mask off just this bit plane's data
-        const uint32_t mask = 1 << j;
-
-        // this works by first finding the index into the red byte (+0) of the 24bpp source image
-        // looking up the bcm bit mask value at that red color value (128 = 1010101010101..), logical AND with
-        // the current bit position we are calculating (1<<j) and then shifting that bit (0 or 1) to the correct pin (ADDRESS_Px_CX)
-        // and logical OR that value for the current bcm_signal offset.
-        // repeat this for green (+1), blue (+2), and once for each pixel on each port
-
-        // !! - first ! turns 00100000 into 0000000, second ! turns 000000 into 00000001
-        // !! - first ! turns 00000000 into 0000001, second ! turns 000001 into 00000000
-        // this way we get a 1 value for the mask of the (bcm_bits & mask) so we can << the correct number of bits
-
-        bcm_signal[bcm_offset++] =
-            // PORT 0, top pixel
-            (!!(bits_red[image[0]] & mask)) << ADDRESS_P0_B1 |
-            (!!(bits_green[image[1]] & mask)) << ADDRESS_P0_G1 |
-            (!!(bits_blue[image[2]] & mask)) << ADDRESS_P0_R1 |
-
-            // PORT 0, bottom pixel
-            (!!(bits_red[image[p0b+0]] & mask)) << ADDRESS_P0_B2 |
-            (!!(bits_green[image[p0b+1]] & mask)) << ADDRESS_P0_G2 |
-            (!!(bits_blue[image[p0b+2]] & mask)) << ADDRESS_P0_R2 |
-
-            // PORT 1, bottom pixel
-            (!!(bits_red[image[p1t+0]] & mask)) << ADDRESS_P1_B1 |
-            (!!(bits_green[image[p1t+1]] & mask)) << ADDRESS_P1_G1 |
-            (!!(bits_blue[image[p1t+2]] & mask)) << ADDRESS_P1_R1 |
-
-            // PORT 1, bottom pixel
-            (!!(bits_red[image[p1b+0]] & mask)) << ADDRESS_P1_B2 |
-            (!!(bits_green[image[p1b+1]] & mask)) << ADDRESS_P1_G2 |
-            (!!(bits_blue[image[p1b+2]] & mask)) << ADDRESS_P1_R2 |
-
-            // PORT 2, bottom pixel
-            (!!(bits_red[image[p2t+0]] & mask)) << ADDRESS_P2_B1 |
-            (!!(bits_green[image[p2t+1]] & mask)) << ADDRESS_P2_G1 |
-            (!!(bits_blue[image[p2t+2]] & mask)) << ADDRESS_P2_R1 |
-
-            // PORT 2, bottom pixel
-            (!!(bits_red[image[p2b+0]] & mask)) << ADDRESS_P2_B2 |
-            (!!(bits_green[image[p2b+1]] & mask)) << ADDRESS_P2_G2 |
-            (!!(bits_blue[image[p2b+2]] & mask)) << ADDRESS_P2_R2;
-
+    for (uint8_t c = 0; c < 3; c++) {
+        const float scale = 1.0f / (lut->domain_max[c] - lut->domain_min[c]);
+        for (uint16_t i = 0; i < levels; i++) {
+            // the value bcm_channel_index() returns index i for
+            const float value = (image_format == IMAGE_FORMAT_RGB16F)
+                ? MIN(half_to_float(i << (14 - BCM_DEEP_BITS)), 1.0f)
+                : (float)i / (float)(levels - 1);
+
+            // the upper lattice point of the last cell is the last point, frac 1.0
+            const float position = MIN(MAX((value - lut->domain_min[c]) * scale, 0.0f), 1.0f) * last;
+            const uint16_t lower = MIN((uint16_t)position, lut->size - 2);
+            cube->offset[c][i] = lower * cube->step[c];
+            cube->frac[c][i]   = position - (float)lower;
+        }
     }
-    // bcm_signal is now bit mask of length bit_depth for these 6 pixels that can be iterated through to light
-    // the LEDS to the correct brightness levels
 }
 
+/**
+ * @brief convert the top and bottom image row of every port through the color lut
+ * into RGB48 rows of width pixels, one after the other
+ * 
+ * always inlined with a constant format, see bcm_cube_row()
+ * 
+ * @param cube from bcm_build_cube()
+ * @param args scene geometry of the image
+ * @param image pointer to the port 0 top pixel of the row, or the image if remap is set
+ * @param remap remap table entry of the port 0 top pixel of the row, or NULL
+ * @param out num_ports * 2 * width RGB48 pixels
+ * @param format image_format_e of the image, compile time constant
+ */
+__attribute__((hot, always_inline))
+static inline void bcm_cube_row_generic(
+    const bcm_cube *__restrict__ cube,
+    const bcm_row_args *__restrict__ args,
+    const uint8_t *__restrict__ image,
+    const uint32_t *__restrict__ remap,
+    uint16_t *__restrict__ out,
+    const enum image_format_e format) {
+
+    const uint8_t channel_bytes  = image_channel_bytes(format);
+    const uint32_t panel_pixels  = args->panel_stride / args->stride;
+    const uint32_t diagonal      = cube->step[0] + cube->step[1] + cube->step[2];
+
+    for (uint8_t k = 0; k < args->num_ports * 2; k++) {
+        for (uint16_t x = 0; x < args->width; x++) {
+            const uint8_t *pixel = (remap != NULL)
+                ? image + remap[(k * panel_pixels) + x]
+                : image + (k * args->panel_stride) + (x * args->stride);
+            const uint16_t ir = bcm_channel_index(pixel, format);
+            const uint16_t ig = bcm_channel_index(pixel + channel_bytes, format);
+            const uint16_t ib = bcm_channel_index(pixel + (2 * channel_bytes), format);
+            const float fr = cube->frac[0][ir];
+            const float fg = cube->frac[1][ig];
+            const float fb = cube->frac[2][ib];
+
+            // tetrahedral interpolation from the lower to the upper corner of the cell. the
+            // corners are picked with a table, not branches, noisy images mispredict them
+            const uint8_t tetra = ((fr > fg) << 2) | ((fg > fb) << 1) | (fr > fb);
+            const float f1 = MAX(fr, MAX(fg, fb));
+            const float f3 = MIN(fr, MIN(fg, fb));
+            const float f2 = (fr + fg + fb) - f1 - f3;
+
+            const float *c0 = cube->table + cube->offset[0][ir] + cube->offset[1][ig] + cube->offset[2][ib];
+            cube_vec acc = cube_vmul(cube_vload(c0), 1.0f - f1);
+            acc = cube_vmla(acc, cube_vload(c0 + cube->walk[tetra][0]), f1 - f2);
+            acc = cube_vmla(acc, cube_vload(c0 + cube->walk[tetra][1]), f2 - f3);
+            acc = cube_vmla(acc, cube_vload(c0 + diagonal), f3);
+
+            _Alignas(16) uint32_t levels[4];
+            cube_vstore_levels(levels, acc);
+            uint16_t *dst = out + (((k * args->width) + x) * 3);
+            for (uint8_t c = 0; c < 3; c++) {
+                dst[c] = (uint16_t)levels[c];
+            }
+        }
+    }
+}
 
+/**
+ * @brief convert the top and bottom image row of every port through the color lut. see bcm_cube_row_generic()
+ */
 __attribute__((hot))
-void update_bcm_signal_dither_32_rgb(
-    const scene_info *scene,
-    const void *__restrict__ void_bits,
-    uint32_t *__restrict__ bcm_signal,
-    const uint8_t *__restrict__ image) {
-
-    const uint32_t *bits_red = (const uint32_t*)void_bits;
-    const uint32_t *bits_green = &bits_red[256];
-    const uint32_t *bits_blue = &bits_red[512];
-
-    // offset to the Port0 top pixel image
-    //uint32_t img_idx = offset;
-    // offset from top pixel to lower pixel in image data. 
-    static uint32_t panel_stride = 0;
-    // offsets for each pixel on each port
-    static uint32_t p0t = 0, p0b = 0, p1t = 0, p1b = 0, p2t = 0, p2b =0;
-
-    // calculate the image index to all 3 ports. we only need to do this once ever
-    if (UNLIKELY(panel_stride == 0)) {
-        panel_stride = scene->width * (scene->panel_height / 2) * scene->stride;
-        p0b = p0t + panel_stride;
-        p1t = p0b + panel_stride;
-        p1b = p1t + panel_stride;
-        p2t = p1b + panel_stride;
-        p2b = p2t + panel_stride;
+static void bcm_cube_row(const bcm_cube *cube, const bcm_row_args *args, const uint8_t *image, const uint32_t *remap, uint16_t *out) {
+    switch (args->image_format) {
+    case IMAGE_FORMAT_RGB16:
+        bcm_cube_row_generic(cube, args, image, remap, out, IMAGE_FORMAT_RGB16);
+        break;
+    case IMAGE_FORMAT_RGB16F:
+        bcm_cube_row_generic(cube, args, image, remap, out, IMAGE_FORMAT_RGB16F);
+        break;
+    default:
+        bcm_cube_row_generic(cube, args, image, remap, out, IMAGE_FORMAT_RGB8);
+        break;
     }
+}
 
-    // inform compiler that bit depth is aligned, improves compiler optimization
-    // BIT_DEPTH_ALIGNMENT should be multiple of 4, ideally 16. 
-    uint8_t bit_depth __attribute__((aligned(BIT_DEPTH_ALIGNMENT))) = scene->bit_depth;
-
-    ASSERT(bit_depth % BIT_DEPTH_ALIGNMENT == 0);
-    ASSERT(bit_depth <= 32);
-
-    uint8_t bcm_offset = 0;
-    for (int j=0; j<bit_depth; j++) {
-        // mask off just this bit plane's data
-        const uint32_t mask = 1 << j;
-
-        // this works by first finding the index into the red byte (+0) of the 24bpp source image
-        // looking up the bcm bit mask value at that red color value (128 = 1010101010101..), logical AND with
-        // the current bit position we are calculating (1<<j) and then shifting that bit (0 or 1) to the correct pin (ADDRESS_Px_CX)
-        // and logical OR that value for the current bcm_signal offset.
-        // repeat this for green (+1), blue (+2), and once for each pixel on each port
-
-        // !! - first ! turns 00100000 into 0000000, second ! turns 000000 into 00000001
-        // !! - first ! turns 00000000 into 0000001, second ! turns 000001 into 00000000
-        // this way we get a 1 value for the mask of the (bcm_bits & mask) so we can << the correct number of bits
-
-        bcm_signal[bcm_offset++] =
-            // PORT 0, top pixel
-            (!!(bits_red[image[0]] & mask)) << ADDRESS_P0_R1 |
-            (!!(bits_green[image[1]] & mask)) << ADDRESS_P0_G1 |
-            (!!(bits_blue[image[2]] & mask)) << ADDRESS_P0_B1 |
-
-            // PORT 0, bottom pixel
-            (!!(bits_red[image[p0b+0]] & mask)) << ADDRESS_P0_R2 |
-            (!!(bits_green[image[p0b+1]] & mask)) << ADDRESS_P0_G2 |
-            (!!(bits_blue[image[p0b+2]] & mask)) << ADDRESS_P0_B2 |
-
-            // PORT 1, bottom pixel
-            (!!(bits_red[image[p1t+0]] & mask)) << ADDRESS_P1_R1 |
-            (!!(bits_green[image[p1t+1]] & mask)) << ADDRESS_P1_G1 |
-            (!!(bits_blue[image[p1t+2]] & mask)) << ADDRESS_P1_B1 |
+/**
+ * @brief row kernel arguments for the RGB48 rows written by bcm_cube_row(). the plain
+ * IMAGE_FORMAT_RGB16 kernel for the same geometry
+ * 
+ * @param args from bcm_build_row_args(), describes the source image
+ * @param cube_args output
+ */
+static void bcm_build_cube_args(const bcm_row_args *args, bcm_row_args *cube_args) {
+    *cube_args = *args;
+    cube_args->stride       = 3 * sizeof(uint16_t);
+    cube_args->panel_stride = args->width * cube_args->stride;
+    cube_args->image_format = IMAGE_FORMAT_RGB16;
+    cube_args->remapped     = false;
+    cube_args->dithered     = false;
+    cube_args->pin_spread   = false;
+}
 
-            // PORT 1, bottom pixel
-            (!!(bits_red[image[p1b+0]] & mask)) << ADDRESS_P1_R2 |
-            (!!(bits_green[image[p1b+1]] & mask)) << ADDRESS_P1_G2 |
-            (!!(bits_blue[image[p1b+2]] & mask)) << ADDRESS_P1_B2 |
+color_lut_t *load_cube_lut(const char *filename) {
+    long filesize = 0;
+    char *src = file_get_contents(filename, &filesize);
 
-            // PORT 2, bottom pixel
-            (!!(bits_red[image[p2t+0]] & mask)) << ADDRESS_P2_R1 |
-            (!!(bits_green[image[p2t+1]] & mask)) << ADDRESS_P2_G1 |
-            (!!(bits_blue[image[p2t+2]] & mask)) << ADDRESS_P2_B1 |
+    color_lut_t *lut = (color_lut_t*)calloc(1, sizeof(color_lut_t));
+    if (lut == NULL) {
+        die("unable to allocate memory for the color lut\n");
+    }
+    for (uint8_t c = 0; c < 3; c++) {
+        lut->domain_max[c] = 1.0f;
+    }
 
-            // PORT 2, bottom pixel
-            (!!(bits_red[image[p2b+0]] & mask)) << ADDRESS_P2_R2 |
-            (!!(bits_green[image[p2b+1]] & mask)) << ADDRESS_P2_G2 |
-            (!!(bits_blue[image[p2b+2]] & mask)) << ADDRESS_P2_B2;
+    uint32_t entries = 0;
+    uint32_t count   = 0;
+    char *save       = NULL;
+    for (char *line = strtok_r(src, "\r\n", &save); line != NULL; line = strtok_r(NULL, "\r\n", &save)) {
+        line += strspn(line, " \t");
+        if (*line == '\0' || *line == '#' || strncmp(line, "TITLE", 5) == 0) {
+            continue;
+        }
 
+        float r, g, b;
+        unsigned int size;
+        if (sscanf(line, "LUT_3D_SIZE %u", &size) == 1) {
+            if (size < 2 || size > 65 || lut->table != NULL) {
+                die("%s: LUT_3D_SIZE must be set once, 2-65, got %u\n", filename, size);
+            }
+            lut->size = size;
+            entries   = size * size * size;
+            lut->table = (float*)aligned_alloc(16, entries * 4 * sizeof(float));
+            if (lut->table == NULL) {
+                die("unable to allocate %u entries for the color lut\n", entries);
+            }
+        } else if (strncmp(line, "LUT_1D_SIZE", 11) == 0) {
+            die("%s: 1D luts are not supported, use the channel gamma and linear offsets\n", filename);
+        } else if (sscanf(line, "DOMAIN_MIN %f %f %f", &r, &g, &b) == 3) {
+            lut->domain_min[0] = r;
+            lut->domain_min[1] = g;
+            lut->domain_min[2] = b;
+        } else if (sscanf(line, "DOMAIN_MAX %f %f %f", &r, &g, &b) == 3) {
+            lut->domain_max[0] = r;
+            lut->domain_max[1] = g;
+            lut->domain_max[2] = b;
+        } else if (sscanf(line, "LUT_3D_INPUT_RANGE %f %f", &r, &g) == 2) {
+            for (uint8_t c = 0; c < 3; c++) {
+                lut->domain_min[c] = r;
+                lut->domain_max[c] = g;
+            }
+        } else if (sscanf(line, "%f %f %f", &r, &g, &b) == 3) {
+            if (count >= entries) {
+                die("%s: color before LUT_3D_SIZE or more than %u colors\n", filename, entries);
+            }
+            float *entry = lut->table + (count * 4);
+            entry[0] = r;
+            entry[1] = g;
+            entry[2] = b;
+            entry[3] = 0.0f;
+            count++;
+        } else {
+            die("%s: unknown line: %s\n", filename, line);
+        }
     }
-    // bcm_signal is now bit mask of length bit_depth for these 6 pixels that can be iterated through to light
-    // the LEDS to the correct brightness levels
-}
+    free(src);
 
+    if (entries == 0 || count != entries) {
+        die("%s: expected %u colors, found %u\n", filename, entries, count);
+    }
+    for (uint8_t c = 0; c < 3; c++) {
+        if (!(lut->domain_max[c] > lut->domain_min[c])) {
+            die("%s: DOMAIN_MAX must be above DOMAIN_MIN\n", filename);
+        }
+    }
 
+    debug("loaded %dx%dx%d color lut from %s\n", lut->size, lut->size, lut->size, filename);
+    return lut;
+}
 
-__attribute__((hot))
-void update_bcm_signal_dither_32_rbg(
-    const scene_info *scene,
+/**
+ * @brief encode one row. every (port, top/bottom row, color) slot of BCM_VEC_LANES neighboring
+ * pixels is looked up once, then bit transposed into GPIO words.
+ * 
+ * always inlined into the generated kernels below with constant order, num_ports, wide,
+ * remapped, dithered and format, so the slot loops unroll, the pin masks fold to constants and
+ * ports that are not connected are never loaded.
+ * 
+ * @param args scene geometry
+ * @param void_bits RGB to BCM lookup table
+ * @param bcm_signal output for plane 0 of the first pixel in the row
+ * @param image pointer to the port 0 top pixel of the row, or the image if remapped
+ * @param remap remap table entry of the port 0 top pixel of the row, if remapped
+ * @param dither dither table row, if dithered
+ * @param order pixel_order_e, compile time constant
+ * @param num_ports 1-3, compile time constant
+ * @param wide true for bit_depth > 32 (uint64_t lookup table), compile time constant
+ * @param remapped true to read the image through remap, compile time constant
+ * @param dithered true to dither each value through dither, compile time constant
+ * @param format image_format_e of the image, compile time constant
+ */
+__attribute__((hot, always_inline))
+static inline void bcm_encode_row(
+    const bcm_row_args *__restrict__ args,
     const void *__restrict__ void_bits,
     uint32_t *__restrict__ bcm_signal,
-    const uint8_t *__restrict__ image) {
-
-    const uint32_t *bits_red = (const uint32_t*)void_bits;
-    const uint32_t *bits_green = &bits_red[256];
-    const uint32_t *bits_blue = &bits_red[512];
-
-    // offset to the Port0 top pixel image
-    //uint32_t img_idx = offset;
-    // offset from top pixel to lower pixel in image data. 
-    static uint32_t panel_stride = 0;
-    // offsets for each pixel on each port
-    static uint32_t p0t = 0, p0b = 0, p1t = 0, p1b = 0, p2t = 0, p2b =0;
-
-    // calculate the image index to all 3 ports. we only need to do this once ever
-    if (UNLIKELY(panel_stride == 0)) {
-        panel_stride = scene->width * (scene->panel_height / 2) * scene->stride;
-        p0b = p0t + panel_stride;
-        p1t = p0b + panel_stride;
-        p1b = p1t + panel_stride;
-        p2t = p1b + panel_stride;
-        p2b = p2t + panel_stride;
+    const uint8_t *__restrict__ image,
+    const uint32_t *__restrict__ remap,
+    const uint8_t *__restrict__ dither,
+    const enum pixel_order_e order,
+    const uint8_t num_ports,
+    const bool wide,
+    const bool remapped,
+    const bool dithered,
+    const enum image_format_e format) {
+
+    const uint8_t num_slots     = num_ports * 6;
+    const uint16_t width        = args->width;
+    const uint8_t stride        = args->stride;
+    const uint8_t bit_depth     = args->bit_depth;
+    const uint32_t plane_stride = args->plane_stride;
+    const uint32_t pixel_stride = args->pixel_stride;
+    ASSERT(width % BCM_VEC_LANES == 0);
+    ASSERT(wide ? (bit_depth > 32 && bit_depth <= 64) : (bit_depth <= 32));
+    ASSERT(!dithered || format == IMAGE_FORMAT_RGB8);
+    const uint8_t channel_bytes = image_channel_bytes(format);
+    const uint16_t levels       = (format == IMAGE_FORMAT_RGB8) ? 256 : BCM_DEEP_LEVELS;
+
+    // slot = port * 6 + row * 3 + image channel
+    bcm_vec pins[BCM_SLOTS];
+    uint32_t offset[BCM_SLOTS];
+    uint16_t lut[BCM_SLOTS];
+    // remap entries from the port 0 top pixel to this slot's row
+    const uint32_t panel_pixels = args->panel_stride / stride;
+    uint32_t remap_row[BCM_SLOTS];
+    for (uint8_t port = 0; port < num_ports; port++) {
+        for (uint8_t half = 0; half < 2; half++) {
+            for (uint8_t channel = 0; channel < 3; channel++) {
+                const uint8_t slot = (port * 6) + (half * 3) + channel;
+                pins[slot]      = bcm_vset1(1u << bcm_port_pins[port][half][bcm_order_colors[order][channel]]);
+                offset[slot]    = ((port * 2) + half) * args->panel_stride + (channel * channel_bytes);
+                remap_row[slot] = ((port * 2) + half) * panel_pixels;
+                lut[slot]       = channel * levels;
+            }
+        }
     }
 
-    // inform compiler that bit depth is aligned, improves compiler optimization
-    // BIT_DEPTH_ALIGNMENT should be multiple of 4, ideally 16. 
-    uint8_t bit_depth __attribute__((aligned(BIT_DEPTH_ALIGNMENT))) = scene->bit_depth;
-
-    ASSERT(bit_depth % BIT_DEPTH_ALIGNMENT == 0);
-    ASSERT(bit_depth <= 32);
-
-    uint8_t bcm_offset = 0;
-    for (int j=0; j<bit_depth; j++) {
-        // mask off just this bit plane's data
-        const uint32_t mask = 1 << j;
-
-        // this works by first finding the index into the red byte (+0) of the 24bpp source image
-        // looking up the bcm bit mask value at that red color value (128 = 1010101010101..), logical AND with
-        // the current bit position we are calculating (1<<j) and then shifting that bit (0 or 1) to the correct pin (ADDRESS_Px_CX)
-        // and logical OR that value for the current bcm_signal offset.
-        // repeat this for green (+1), blue (+2), and once for each pixel on each port
-
-        // !! - first ! turns 00100000 into 0000000, second ! turns 000000 into 00000001
-        // !! - first ! turns 00000000 into 0000001, second ! turns 000001 into 00000000
-        // this way we get a 1 value for the mask of the (bcm_bits & mask) so we can << the correct number of bits
-
-        bcm_signal[bcm_offset++] =
-            // PORT 0, top pixel
-            (!!(bits_red[image[0]] & mask)) << ADDRESS_P0_R1 |
-            (!!(bits_green[image[1]] & mask)) << ADDRESS_P0_B1 |
-            (!!(bits_blue[image[2]] & mask)) << ADDRESS_P0_G1 |
-
-            // PORT 0, bottom pixel
-            (!!(bits_red[image[p0b+0]] & mask)) << ADDRESS_P0_R2 |
-            (!!(bits_green[image[p0b+1]] & mask)) << ADDRESS_P0_B2 |
-            (!!(bits_blue[image[p0b+2]] & mask)) << ADDRESS_P0_G2 |
-
-            // PORT 1, bottom pixel
-            (!!(bits_red[image[p1t+0]] & mask)) << ADDRESS_P1_R1 |
-            (!!(bits_green[image[p1t+1]] & mask)) << ADDRESS_P1_B1 |
-            (!!(bits_blue[image[p1t+2]] & mask)) << ADDRESS_P1_G1 |
-
-            // PORT 1, bottom pixel
-            (!!(bits_red[image[p1b+0]] & mask)) << ADDRESS_P1_R2 |
-            (!!(bits_green[image[p1b+1]] & mask)) << ADDRESS_P1_B2 |
-            (!!(bits_blue[image[p1b+2]] & mask)) << ADDRESS_P1_G2 |
-
-            // PORT 2, bottom pixel
-            (!!(bits_red[image[p2t+0]] & mask)) << ADDRESS_P2_R1 |
-            (!!(bits_green[image[p2t+1]] & mask)) << ADDRESS_P2_B1 |
-            (!!(bits_blue[image[p2t+2]] & mask)) << ADDRESS_P2_G1 |
-
-            // PORT 2, bottom pixel
-            (!!(bits_red[image[p2b+0]] & mask)) << ADDRESS_P2_R2 |
-            (!!(bits_green[image[p2b+1]] & mask)) << ADDRESS_P2_B2 |
-            (!!(bits_blue[image[p2b+2]] & mask)) << ADDRESS_P2_G2;
+    _Alignas(32) uint32_t lo[BCM_SLOTS][BCM_VEC_LANES];
+    _Alignas(32) uint32_t hi[BCM_SLOTS][BCM_VEC_LANES];
+
+    for (uint16_t x = 0; x < width; x += BCM_VEC_LANES) {
+        const uint8_t *pixel = image + (x * stride);
+        uint32_t *out = bcm_signal + (x * pixel_stride);
+
+        // fetch each LUT word exactly once per subpixel
+        if (!wide) {
+            const uint32_t *bits = (const uint32_t*)void_bits;
+            for (uint8_t s = 0; s < num_slots; s++) {
+                const uint8_t *sub = pixel + offset[s];
+                for (uint8_t k = 0; k < BCM_VEC_LANES; k++) {
+                    // remap is NULL for the direct kernels, only index it when remapped
+                    const uint8_t *channel = (remapped) ? image + remap[remap_row[s] + x + k] + ((s % 3) * channel_bytes) : sub + (k * stride);
+                    uint16_t value = bcm_channel_index(channel, format);
+                    if (dithered) {
+                        value = dither[((((s % 3) * BCM_DITHER_TILE) + ((x + k) % BCM_DITHER_TILE)) * 256) + value];
+                    }
+                    lo[s][k] = bits[lut[s] + value];
+                }
+            }
+            bcm_transpose_planes(lo, pins, num_slots, out, bit_depth, plane_stride, pixel_stride);
+            continue;
+        }
 
+        // 64 bit bcm data is transposed as two 32 bit halves, planes 0-31 then planes 32-63
+        const uint64_t *bits = (const uint64_t*)void_bits;
+        for (uint8_t s = 0; s < num_slots; s++) {
+            const uint8_t *sub = pixel + offset[s];
+            for (uint8_t k = 0; k < BCM_VEC_LANES; k++) {
+                // remap is NULL for the direct kernels, only index it when remapped
+                const uint8_t *channel = (remapped) ? image + remap[remap_row[s] + x + k] + ((s % 3) * channel_bytes) : sub + (k * stride);
+                uint16_t value = bcm_channel_index(channel, format);
+                if (dithered) {
+                    value = dither[((((s % 3) * BCM_DITHER_TILE) + ((x + k) % BCM_DITHER_TILE)) * 256) + value];
+                }
+                const uint64_t word = bits[lut[s] + value];
+                lo[s][k] = (uint32_t)word;
+                hi[s][k] = (uint32_t)(word >> 32);
+            }
+        }
+        bcm_transpose_planes(lo, pins, num_slots, out, 32, plane_stride, pixel_stride);
+        bcm_transpose_planes(hi, pins, num_slots, out + (32 * plane_stride), bit_depth - 32, plane_stride, pixel_stride);
     }
-    // bcm_signal is now bit mask of length bit_depth for these 6 pixels that can be iterated through to light
-    // the LEDS to the correct brightness levels
 }
 
-
-__attribute__((hot))
-void update_bcm_signal_64_rgb(
-    const scene_info *scene,
-    const void *__restrict__ void_bits,
-    uint32_t *__restrict__ bcm_signal,
-    const uint8_t *__restrict__ image) {
-
-    const uint64_t *bits = (const uint64_t*)void_bits;
-    // offset from top pixel to lower pixel in image data. 
-    static int32_t panel_stride = 0;
-    // offsets for each pixel on each port
-    static uint32_t p0t = 0, p0b = 0, p1t = 0, p1b = 0, p2t = 0, p2b =0;
-
-    // calculate the image index to all 3 ports. we only need to do this once ever
-    if (UNLIKELY(panel_stride == 0)) {
-        panel_stride = scene->width * (scene->panel_height / 2) * scene->stride;
-        p0b = p0t + panel_stride;
-        p1t = p0b + panel_stride;
-        p1b = p1t + panel_stride;
-        p2t = p1b + panel_stride;
-        p2b = p2t + panel_stride;
+/**
+ * generate a bcm_row_fn for every depth class, pixel order and port count, reading the image
+ * directly or through the remap table, with or without dithering. 16 bit images are never dithered.
+ * named bcm_row_<bits>_<order>_<ports>p[_rgb16|_rgb16f][_remap][_dither], IE: bcm_row_32_rgb_3p
+ */
+#define BCM_ROW_VARIANT(bits, name, order, ports, suffix, remapped, dithered, format) \
+    __attribute__((hot)) \
+    static void bcm_row_##bits##_##name##_##ports##p##suffix( \
+        const bcm_row_args *__restrict__ args, const void *__restrict__ void_bits, \
+        uint32_t *__restrict__ bcm_signal, const uint8_t *__restrict__ image, \
+        const uint32_t *__restrict__ remap, const uint8_t *__restrict__ dither) { \
+        bcm_encode_row(args, void_bits, bcm_signal, image, remap, dither, order, ports, bits > 32, remapped, dithered, format); \
     }
 
+#define BCM_ROW_KERNEL(bits, name, order, ports) \
+    BCM_ROW_VARIANT(bits, name, order, ports, , false, false, IMAGE_FORMAT_RGB8) \
+    BCM_ROW_VARIANT(bits, name, order, ports, _remap, true, false, IMAGE_FORMAT_RGB8) \
+    BCM_ROW_VARIANT(bits, name, order, ports, _dither, false, true, IMAGE_FORMAT_RGB8) \
+    BCM_ROW_VARIANT(bits, name, order, ports, _remap_dither, true, true, IMAGE_FORMAT_RGB8) \
+    BCM_ROW_VARIANT(bits, name, order, ports, _rgb16, false, false, IMAGE_FORMAT_RGB16) \
+    BCM_ROW_VARIANT(bits, name, order, ports, _rgb16_remap, true, false, IMAGE_FORMAT_RGB16) \
+    BCM_ROW_VARIANT(bits, name, order, ports, _rgb16f, false, false, IMAGE_FORMAT_RGB16F) \
+    BCM_ROW_VARIANT(bits, name, order, ports, _rgb16f_remap, true, false, IMAGE_FORMAT_RGB16F)
+
+#define BCM_ROW_KERNELS(bits, name, order) \
+    BCM_ROW_KERNEL(bits, name, order, 1) \
+    BCM_ROW_KERNEL(bits, name, order, 2) \
+    BCM_ROW_KERNEL(bits, name, order, 3)
+
+#define BCM_ROW_KERNEL_PORTS(bits, name, suffix) \
+    { bcm_row_##bits##_##name##_1p##suffix, bcm_row_##bits##_##name##_2p##suffix, bcm_row_##bits##_##name##_3p##suffix }
+
+#define BCM_ROW_KERNEL_TABLE(suffix) { \
+        { \
+            [PIXEL_ORDER_RGB] = BCM_ROW_KERNEL_PORTS(32, rgb, suffix), \
+            [PIXEL_ORDER_RBG] = BCM_ROW_KERNEL_PORTS(32, rbg, suffix), \
+            [PIXEL_ORDER_BGR] = BCM_ROW_KERNEL_PORTS(32, bgr, suffix) \
+        }, \
+        { \
+            [PIXEL_ORDER_RGB] = BCM_ROW_KERNEL_PORTS(64, rgb, suffix), \
+            [PIXEL_ORDER_RBG] = BCM_ROW_KERNEL_PORTS(64, rbg, suffix), \
+            [PIXEL_ORDER_BGR] = BCM_ROW_KERNEL_PORTS(64, bgr, suffix) \
+        } \
+    }
 
-    // inform compiler that bit depth is aligned, improves compiler optimization
-    // BIT_DEPTH_ALIGNMENT should be multiple of 4, ideally 16. 
-    uint8_t bit_depth __attribute__((aligned(BIT_DEPTH_ALIGNMENT))) = scene->bit_depth;
-
-    ASSERT(bit_depth % BIT_DEPTH_ALIGNMENT == 0);
-    ASSERT(bit_depth <= 32);
-
-    uint8_t bcm_offset = 0;
-    for (int j=0; j<bit_depth; j++) {
-        // mask off just this bit plane's data
-        const uint64_t mask = 1ULL << j;
-
-        // this works by first finding the index into the red byte (+0) of the 24bpp source image
-        // looking up the bcm bit mask value at that red color value (128 = 1010101010101..), logical AND with
-        // the current bit position we are calculating (1<<j) and then shifting that bit (0 or 1) to the correct pin (ADDRESS_Px_CX)
-        // and logical OR that value for the current bcm_signal offset.
-        // repeat this for green (+1), blue (+2), and once for each pixel on each port
-
-        // !! - first ! turns 00100000 into 0000000, second ! turns 000000 into 00000001
-        // !! - first ! turns 00000000 into 0000001, second ! turns 000001 into 00000000
-        // this way we get a 1 value for the mask of the (bcm_bits & mask) so we can << the correct number of bits
-
-        bcm_signal[bcm_offset++] =
-            // PORT 0, top pixel
-            (!!(bits[image[0]] & mask)) << ADDRESS_P0_R1 |
-            (!!(bits[image[1]] & mask)) << ADDRESS_P0_G1 |
-            (!!(bits[image[2]] & mask)) << ADDRESS_P0_B1 |
-
-            // PORT 0, bottom pixel
-            (!!(bits[image[p0b+0]] & mask)) << ADDRESS_P0_R2 |
-            (!!(bits[image[p0b+1]] & mask)) << ADDRESS_P0_G2 |
-            (!!(bits[image[p0b+2]] & mask)) << ADDRESS_P0_B2 |
-
-            // PORT 1, bottom pixel
-            (!!(bits[image[p1t+0]] & mask)) << ADDRESS_P1_R1 |
-            (!!(bits[image[p1t+1]] & mask)) << ADDRESS_P1_G1 |
-            (!!(bits[image[p1t+2]] & mask)) << ADDRESS_P1_B1 |
-
-            // PORT 1, bottom pixel
-            (!!(bits[image[p1b+0]] & mask)) << ADDRESS_P1_R2 |
-            (!!(bits[image[p1b+1]] & mask)) << ADDRESS_P1_G2 |
-            (!!(bits[image[p1b+2]] & mask)) << ADDRESS_P1_B2 |
-
-            // PORT 2, bottom pixel
-            (!!(bits[image[p2t+0]] & mask)) << ADDRESS_P1_R1 |
-            (!!(bits[image[p2t+1]] & mask)) << ADDRESS_P1_G1 |
-            (!!(bits[image[p2t+2]] & mask)) << ADDRESS_P1_B1 |
-
-            // PORT 2, bottom pixel
-            (!!(bits[image[p2b+0]] & mask)) << ADDRESS_P2_R2 |
-            (!!(bits[image[p2b+1]] & mask)) << ADDRESS_P2_G2 |
-            (!!(bits[image[p2b+2]] & mask)) << ADDRESS_P2_B2;
+BCM_ROW_KERNELS(32, rgb, PIXEL_ORDER_RGB)
+BCM_ROW_KERNELS(32, rbg, PIXEL_ORDER_RBG)
+BCM_ROW_KERNELS(32, bgr, PIXEL_ORDER_BGR)
+BCM_ROW_KERNELS(64, rgb, PIXEL_ORDER_RGB)
+BCM_ROW_KERNELS(64, rbg, PIXEL_ORDER_RBG)
+BCM_ROW_KERNELS(64, bgr, PIXEL_ORDER_BGR)
+
+uint32_t *bcm_build_spread_lut(const bcm_row_args *args, const void *bits) {
+    const uint8_t bit_depth    = args->bit_depth;
+    const uint32_t table_words = 256 * bit_depth;
+    const size_t bytes         = (size_t)args->num_ports * 6 * table_words * sizeof(uint32_t);
+    uint32_t *spread           = (uint32_t*)aligned_alloc(32, bytes);
+    if (spread == NULL) {
+        die("unable to allocate %zu bytes for the pin spread lookup table\n", bytes);
+    }
 
+    for (uint8_t port = 0; port < args->num_ports; port++) {
+        for (uint8_t half = 0; half < 2; half++) {
+            for (uint8_t channel = 0; channel < 3; channel++) {
+                const uint8_t slot = (port * 6) + (half * 3) + channel;
+                const uint8_t pin  = bcm_port_pins[port][half][bcm_order_colors[args->pixel_order][channel]];
+                uint32_t *table    = spread + (slot * table_words);
+
+                for (uint16_t value = 0; value < 256; value++) {
+                    const uint64_t word = (bit_depth > 32)
+                        ? ((const uint64_t*)bits)[(channel * 256) + value]
+                        : ((const uint32_t*)bits)[(channel * 256) + value];
+                    for (uint8_t j = 0; j < bit_depth; j++) {
+                        table[(value * bit_depth) + j] = (uint32_t)((word >> j) & 1) << pin;
+                    }
+                }
+            }
+        }
     }
-    // bcm_signal is now bit mask of length bit_depth for these 6 pixels that can be iterated through to light
-    // the LEDS to the correct brightness levels
-}
 
+    return spread;
+}
 
-__attribute__((hot))
-void update_bcm_signal_64_rbg(
-    const scene_info *scene,
-    const void *__restrict__ void_bits,
+/**
+ * @brief encode one row from the pin spread lookup table. the GPIO word of each plane is
+ * the OR of one pre-shifted table entry per slot, no bit extraction or pin routing.
+ * 
+ * always inlined into the generated kernels below with constant num_ports, remapped and dithered.
+ * pixel order and bit depth are baked into the table, so there is no depth class or order variant.
+ * 
+ * @param args scene geometry
+ * @param void_spread table from bcm_build_spread_lut()
+ * @param bcm_signal output for plane 0 of the first pixel in the row
+ * @param image pointer to the port 0 top pixel of the row, or the image if remapped
+ * @param remap remap table entry of the port 0 top pixel of the row, if remapped
+ * @param dither dither table row, if dithered
+ * @param num_ports 1-3, compile time constant
+ * @param remapped true to read the image through remap, compile time constant
+ * @param dithered true to dither each value through dither, compile time constant
+ */
+__attribute__((hot, always_inline))
+static inline void bcm_encode_row_spread(
+    const bcm_row_args *__restrict__ args,
+    const void *__restrict__ void_spread,
     uint32_t *__restrict__ bcm_signal,
-    const uint8_t *__restrict__ image) {
-
-    const uint64_t *bits = (const uint64_t*)void_bits;
-    // offset from top pixel to lower pixel in image data. 
-    static int32_t panel_stride = 0;
-    // offsets for each pixel on each port
-    static uint32_t p0t = 0, p0b = 0, p1t = 0, p1b = 0, p2t = 0, p2b =0;
-
-    // calculate the image index to all 3 ports. we only need to do this once ever
-    if (UNLIKELY(panel_stride == 0)) {
-        panel_stride = scene->width * (scene->panel_height / 2) * scene->stride;
-        p0b = p0t + panel_stride;
-        p1t = p0b + panel_stride;
-        p1b = p1t + panel_stride;
-        p2t = p1b + panel_stride;
-        p2b = p2t + panel_stride;
+    const uint8_t *__restrict__ image,
+    const uint32_t *__restrict__ remap,
+    const uint8_t *__restrict__ dither,
+    const uint8_t num_ports,
+    const bool remapped,
+    const bool dithered) {
+
+    const uint32_t *spread      = (const uint32_t*)void_spread;
+    const uint8_t num_slots     = num_ports * 6;
+    const uint16_t width        = args->width;
+    const uint8_t stride        = args->stride;
+    const uint8_t bit_depth     = args->bit_depth;
+    const uint32_t plane_stride = args->plane_stride;
+    const uint32_t pixel_stride = args->pixel_stride;
+    const uint32_t table_words  = 256 * bit_depth;
+
+    const uint32_t panel_pixels = args->panel_stride / stride;
+    uint32_t offset[BCM_SLOTS];
+    uint32_t remap_row[BCM_SLOTS];
+    for (uint8_t slot = 0; slot < num_slots; slot++) {
+        offset[slot]    = ((slot / 3) * args->panel_stride) + (slot % 3);
+        remap_row[slot] = (slot / 3) * panel_pixels;
     }
 
+    for (uint16_t x = 0; x < width; x++) {
+        const uint8_t *pixel = image + (x * stride);
+        uint32_t *out        = bcm_signal + (x * pixel_stride);
 
-    // inform compiler that bit depth is aligned, improves compiler optimization
-    // BIT_DEPTH_ALIGNMENT should be multiple of 4, ideally 16. 
-    uint8_t bit_depth __attribute__((aligned(BIT_DEPTH_ALIGNMENT))) = scene->bit_depth;
-
-    ASSERT(bit_depth % BIT_DEPTH_ALIGNMENT == 0);
-    ASSERT(bit_depth <= 32);
-
-    uint8_t bcm_offset = 0;
-    for (int j=0; j<bit_depth; j++) {
-        // mask off just this bit plane's data
-        const uint64_t mask = 1ULL << j;
-
-        // this works by first finding the index into the red byte (+0) of the 24bpp source image
-        // looking up the bcm bit mask value at that red color value (128 = 1010101010101..), logical AND with
-        // the current bit position we are calculating (1<<j) and then shifting that bit (0 or 1) to the correct pin (ADDRESS_Px_CX)
-        // and logical OR that value for the current bcm_signal offset.
-        // repeat this for green (+1), blue (+2), and once for each pixel on each port
+        const uint32_t *entry[BCM_SLOTS];
+        for (uint8_t s = 0; s < num_slots; s++) {
+            uint8_t value = (remapped) ? image[remap[remap_row[s] + x] + (s % 3)] : pixel[offset[s]];
+            if (dithered) {
+                value = dither[((((s % 3) * BCM_DITHER_TILE) + (x % BCM_DITHER_TILE)) * 256) + value];
+            }
+            entry[s] = spread + (s * table_words) + (value * bit_depth);
+        }
 
-        // !! - first ! turns 00100000 into 0000000, second ! turns 000000 into 00000001
-        // !! - first ! turns 00000000 into 0000001, second ! turns 000001 into 00000000
-        // this way we get a 1 value for the mask of the (bcm_bits & mask) so we can << the correct number of bits
+        if (plane_stride == 1) {
+            // BCM_LAYOUT_PIXEL, the planes of one pixel are contiguous. this loop vectorises
+            for (uint8_t j = 0; j < bit_depth; j++) {
+                uint32_t word = entry[0][j];
+                for (uint8_t s = 1; s < num_slots; s++) {
+                    word |= entry[s][j];
+                }
+                out[j] = word;
+            }
+        } else {
+            for (uint8_t j = 0; j < bit_depth; j++) {
+                uint32_t word = entry[0][j];
+                for (uint8_t s = 1; s < num_slots; s++) {
+                    word |= entry[s][j];
+                }
+                out[j * plane_stride] = word;
+            }
+        }
+    }
+}
 
-        bcm_signal[bcm_offset++] =
-            // PORT 0, top pixel
-            (!!(bits[image[0]] & mask)) << ADDRESS_P0_R1 |
-            (!!(bits[image[1]] & mask)) << ADDRESS_P0_B1 |
-            (!!(bits[image[2]] & mask)) << ADDRESS_P0_G1 |
+#define BCM_SPREAD_VARIANT(ports, suffix, remapped, dithered) \
+    __attribute__((hot)) \
+    static void bcm_row_spread_##ports##p##suffix( \
+        const bcm_row_args *__restrict__ args, const void *__restrict__ void_spread, \
+        uint32_t *__restrict__ bcm_signal, const uint8_t *__restrict__ image, \
+        const uint32_t *__restrict__ remap, const uint8_t *__restrict__ dither) { \
+        bcm_encode_row_spread(args, void_spread, bcm_signal, image, remap, dither, ports, remapped, dithered); \
+    }
 
-            // PORT 0, bottom pixel
-            (!!(bits[image[p0b+0]] & mask)) << ADDRESS_P0_R2 |
-            (!!(bits[image[p0b+1]] & mask)) << ADDRESS_P0_B2 |
-            (!!(bits[image[p0b+2]] & mask)) << ADDRESS_P0_G2 |
+#define BCM_SPREAD_KERNEL(ports) \
+    BCM_SPREAD_VARIANT(ports, , false, false) \
+    BCM_SPREAD_VARIANT(ports, _remap, true, false) \
+    BCM_SPREAD_VARIANT(ports, _dither, false, true) \
+    BCM_SPREAD_VARIANT(ports, _remap_dither, true, true)
 
-            // PORT 1, bottom pixel
-            (!!(bits[image[p1t+0]] & mask)) << ADDRESS_P1_R1 |
-            (!!(bits[image[p1t+1]] & mask)) << ADDRESS_P1_B1 |
-            (!!(bits[image[p1t+2]] & mask)) << ADDRESS_P1_G1 |
+#define BCM_SPREAD_KERNEL_PORTS(suffix) \
+    { bcm_row_spread_1p##suffix, bcm_row_spread_2p##suffix, bcm_row_spread_3p##suffix }
 
-            // PORT 1, bottom pixel
-            (!!(bits[image[p1b+0]] & mask)) << ADDRESS_P1_R2 |
-            (!!(bits[image[p1b+1]] & mask)) << ADDRESS_P1_B2 |
-            (!!(bits[image[p1b+2]] & mask)) << ADDRESS_P1_G2 |
+BCM_SPREAD_KERNEL(1)
+BCM_SPREAD_KERNEL(2)
+BCM_SPREAD_KERNEL(3)
 
-            // PORT 2, bottom pixel
-            (!!(bits[image[p2t+0]] & mask)) << ADDRESS_P1_R1 |
-            (!!(bits[image[p2t+1]] & mask)) << ADDRESS_P1_B1 |
-            (!!(bits[image[p2t+2]] & mask)) << ADDRESS_P1_G1 |
+/**
+ * @brief pin spread row kernels indexed as [remapped][dithered][num_ports - 1]
+ */
+static const bcm_row_fn bcm_spread_kernels[2][2][3] = {
+    { BCM_SPREAD_KERNEL_PORTS(), BCM_SPREAD_KERNEL_PORTS(_dither) },
+    { BCM_SPREAD_KERNEL_PORTS(_remap), BCM_SPREAD_KERNEL_PORTS(_remap_dither) }
+};
 
-            // PORT 2, bottom pixel
-            (!!(bits[image[p2b+0]] & mask)) << ADDRESS_P2_R2 |
-            (!!(bits[image[p2b+1]] & mask)) << ADDRESS_P2_B2 |
-            (!!(bits[image[p2b+2]] & mask)) << ADDRESS_P2_G2;
+/**
+ * @brief row kernels indexed as [remapped][dithered][0 = bit_depth <= 32, 1 = bit_depth <= 64][pixel_order][num_ports - 1]
+ */
+static const bcm_row_fn bcm_row_kernels[2][2][2][3][3] = {
+    { BCM_ROW_KERNEL_TABLE(), BCM_ROW_KERNEL_TABLE(_dither) },
+    { BCM_ROW_KERNEL_TABLE(_remap), BCM_ROW_KERNEL_TABLE(_remap_dither) }
+};
 
+/**
+ * @brief row kernels for the 16 bit image formats indexed as
+ * [0 = IMAGE_FORMAT_RGB16, 1 = IMAGE_FORMAT_RGB16F][remapped][depth class][pixel_order][num_ports - 1]
+ */
+static const bcm_row_fn bcm_deep_kernels[2][2][2][3][3] = {
+    { BCM_ROW_KERNEL_TABLE(_rgb16), BCM_ROW_KERNEL_TABLE(_rgb16_remap) },
+    { BCM_ROW_KERNEL_TABLE(_rgb16f), BCM_ROW_KERNEL_TABLE(_rgb16f_remap) }
+};
+
+bcm_row_fn bcm_select_row_kernel(const bcm_row_args *args) {
+    ASSERT(args->pixel_order <= PIXEL_ORDER_BGR);
+    ASSERT(args->num_ports >= 1 && args->num_ports <= 3);
+    ASSERT(args->bit_depth <= 64);
+    ASSERT(args->image_format <= IMAGE_FORMAT_RGB16F);
+
+    if (args->image_format != IMAGE_FORMAT_RGB8) {
+        return bcm_deep_kernels[args->image_format == IMAGE_FORMAT_RGB16F][args->remapped][args->bit_depth > 32][args->pixel_order][args->num_ports - 1];
+    }
+    if (args->pin_spread) {
+        return bcm_spread_kernels[args->remapped][args->dithered][args->num_ports - 1];
     }
-    // bcm_signal is now bit mask of length bit_depth for these 6 pixels that can be iterated through to light
-    // the LEDS to the correct brightness levels
+    return bcm_row_kernels[args->remapped][args->dithered][args->bit_depth > 32][args->pixel_order][args->num_ports - 1];
 }
 
 
-__attribute__((hot))
-void update_bcm_signal_64_bgr(
-    const scene_info *scene,
-    const void *__restrict__ void_bits,
-    uint32_t *__restrict__ bcm_signal,
-    const uint8_t *__restrict__ image) {
+ 
+/**
+ * @brief x^y for x in [0, 1] and y > 0 without powf. log2 from an atanh series of the
+ * mantissa, exp2 from a polynomial centered on 0.5. about 1e-6 relative error, far below
+ * one bcm level, and cheap enough to rebuild the lookup tables on every frame.
+ * branch free, so loops over it vectorize
+ * 
+ * @param x 0.0 - 1.0
+ * @param y exponent
+ * @return float 
+ */
+__attribute__((const))
+static inline float fast_powf(const float x, const float y) {
+    // x = m * 2^e with m in [1, 2). log2(m) = 2 / ln(2) * atanh((m - 1) / (m + 1))
+    uint32_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    const int32_t e = (int32_t)(bits >> 23) - 127;
+    bits = (bits & 0x007FFFFF) | 0x3F800000;
+    float m;
+    memcpy(&m, &bits, sizeof(m));
+    const float t  = (m - 1.0f) / (m + 1.0f);
+    const float t2 = t * t;
+    const float log2_x = e + (2.8853900818f * t * (1.0f + t2 * (0.3333333333f + t2 * (0.2f + t2 * (0.1428571429f + t2 * 0.1111111111f)))));
+
+    // 2^p = 2^i * sqrt(2) * 2^(f - 0.5) with f in [0, 1)
+    const float p = MAX(y * log2_x, -126.0f);
+    // floor without floorf, which does not vectorize on every target
+    int32_t i = (int32_t)p;
+    i -= ((float)i > p);
+    const float g = (p - i - 0.5f) * 0.6931471806f;
+    const float exp_g = 1.0f + g * (1.0f + g * (0.5f + g * (0.1666666667f + g * (0.0416666667f + g * (0.0083333333f + g * 0.0013888889f)))));
+    const uint32_t scale_bits = (uint32_t)(i + 127) << 23;
+    float scale;
+    memcpy(&scale, &scale_bits, sizeof(scale));
+    const float result = scale * 1.4142135624f * exp_g;
+
+    // y == 1 keeps levels that land exactly on a byte exact
+    return (x <= 0.0f) ? 0.0f : ((y == 1.0f) ? x : result);
+}
 
-    const uint64_t *bits = (const uint64_t*)void_bits;
-    // offset from top pixel to lower pixel in image data.
-    static int32_t panel_stride = 0;
-    // offsets for each pixel on each port
-    static uint32_t p0t = 0, p0b = 0, p1t = 0, p1b = 0, p2t = 0, p2b =0;
+void bcm_build_tone_args(const scene_info *scene, bcm_tone_args *args) {
+    // zero the padding too, the encoder compares args with memcmp to detect parameter changes
+    memset(args, 0, sizeof(bcm_tone_args));
+
+    args->tone_version = scene->tone_version;
+    args->tone_mapper  = scene->tone_mapper;
+    args->tone_level   = scene->tone_level;
+    // gamma 0 (or the calibration marker, < 0) applies no gamma
+    const float gamma  = (scene->gamma > 0.0f) ? scene->gamma : 1.0f;
+    args->gamma[0]     = gamma * scene->red_gamma;
+    args->gamma[1]     = gamma * scene->green_gamma;
+    args->gamma[2]     = gamma * scene->blue_gamma;
+    args->linear[0]    = scene->red_linear;
+    args->linear[1]    = scene->green_linear;
+    args->linear[2]    = scene->blue_linear;
+    // with oe_brightness the brightness is applied with the OE duty, not in the table.
+    // binary planes are timed exactly, cutting their OE short would distort their weights
+    const bool oe_duty = scene->oe_brightness && scene->bcm_weight == BCM_WEIGHT_LINEAR;
+    args->brightness   = (oe_duty) ? 255 : scene->brightness;
+    args->bit_depth    = scene->bit_depth;
+    args->weight       = scene->bcm_weight;
+    args->fraction_bits = (scene->bcm_weight == BCM_WEIGHT_LINEAR) ? scene->bcm_fraction_bits : 0;
+    // color lut rows are encoded from 16 bit
+    args->image_format = (scene->color_lut != NULL) ? IMAGE_FORMAT_RGB16 : scene->image_format;
+}
 
-    // calculate the image index to all 3 ports. we only need to do this once ever
-    if (UNLIKELY(panel_stride == 0)) {
-        panel_stride = scene->width * (scene->panel_height / 2) * scene->stride;
-        p0b = p0t + panel_stride;
-        p1t = p0b + panel_stride;
-        p1b = p1t + panel_stride;
-        p2t = p1b + panel_stride;
-        p2b = p2t + panel_stride;
+void bcm_build_lut(const bcm_tone_args *args, void *bits) {
+    const uint8_t num_bits = args->bit_depth;
+    const bool wide        = num_bits > 32;
+    const bool deep        = args->image_format != IMAGE_FORMAT_RGB8;
+    const uint16_t levels  = (deep) ? BCM_DEEP_LEVELS : 256;
+    const bool binary      = args->weight == BCM_WEIGHT_BINARY;
+    // the highest level of a binary table, every plane on
+    const float binary_max = (float)((1u << MIN(num_bits, 31)) - 1);
+    ASSERT(num_bits <= 64);
+    ASSERT(!binary || num_bits <= 32);
+
+    // fraction planes are the last planes, one per fraction bit. the 1 bits of a level are spread
+    // over the full planes before them
+    const uint8_t fraction_bits = (binary) ? 0 : MIN(args->fraction_bits, BCM_FRACTION_MAX_PLANES);
+    const uint8_t full_bits     = num_bits - fraction_bits;
+
+    // the bcm signal only depends on the number of 1 bits, spread them evenly once per count.
+    // 64 bit signals get one extra 1 bit for any non black input, 32 bit signals do not
+    uint64_t signals[MAX_BITS + 2];
+    for (uint8_t num_ones = 0; num_ones <= num_bits + 1; num_ones++) {
+        signals[num_ones] = 0;
+        const float step = (float)full_bits / (float)num_ones;
+        for (uint16_t i = 0; i < num_ones && (wide || i < 32); i++) {
+            signals[num_ones] |= 1ULL << (int)(i * step);
+        }
     }
 
+    uint32_t *bits32 = (uint32_t *)bits;
+    uint64_t *bits64 = (uint64_t *)bits;
+    const bool tone_map = args->tone_mapper != NULL && args->tone_mapper != copy_tone_mapperF;
+
+    // blocks of 256 levels, so the gamma and bit count loops vectorize around the tone mapper calls
+    _Alignas(32) float input[256];
+    _Alignas(32) float channel[3][256];
+    for (uint16_t block = 0; block < levels; block += 256) {
+        // the input level of every index, see bcm_channel_index()
+        if (args->image_format == IMAGE_FORMAT_RGB16F) {
+            for (uint16_t k = 0; k < 256; k++) {
+                input[k] = MIN(half_to_float((block + k) << (14 - BCM_DEEP_BITS)), 1.0f);
+            }
+        } else {
+            for (uint16_t k = 0; k < 256; k++) {
+                input[k] = (float)(block + k) / (levels - 1);
+            }
+        }
 
-    // inform compiler that bit depth is aligned, improves compiler optimization
-    // BIT_DEPTH_ALIGNMENT should be multiple of 4, ideally 16.
-    uint8_t bit_depth __attribute__((aligned(BIT_DEPTH_ALIGNMENT))) = scene->bit_depth;
-
-    ASSERT(bit_depth % BIT_DEPTH_ALIGNMENT == 0);
-    ASSERT(bit_depth <= 32);
-
-    uint8_t bcm_offset = 0;
-    for (int j=0; j<bit_depth; j++) {
-        // mask off just this bit plane's data
-        const uint64_t mask = 1ULL << j;
-
-        // this works by first finding the index into the red byte (+0) of the 24bpp source image
-        // looking up the bcm bit mask value at that red color value (128 = 1010101010101..), logical AND with
-        // the current bit position we are calculating (1<<j) and then shifting that bit (0 or 1) to the correct pin (ADDRESS_Px_CX)
-        // and logical OR that value for the current bcm_signal offset.
-        // repeat this for green (+1), blue (+2), and once for each pixel on each port
-
-        // !! - first ! turns 00100000 into 0000000, second ! turns 000000 into 00000001
-        // !! - first ! turns 00000000 into 0000001, second ! turns 000001 into 00000000
-        // this way we get a 1 value for the mask of the (bcm_bits & mask) so we can << the correct number of bits
-
-        bcm_signal[bcm_offset++] =
-            // PORT 0, top pixel
-            (!!(bits[image[0]] & mask)) << ADDRESS_P0_B1 |
-            (!!(bits[image[1]] & mask)) << ADDRESS_P0_G1 |
-            (!!(bits[image[2]] & mask)) << ADDRESS_P0_R1 |
-
-            // PORT 0, bottom pixel
-            (!!(bits[image[p0b+0]] & mask)) << ADDRESS_P0_B2 |
-            (!!(bits[image[p0b+1]] & mask)) << ADDRESS_P0_G2 |
-            (!!(bits[image[p0b+2]] & mask)) << ADDRESS_P0_R2 |
+        // linear offset then gamma per channel. black stays black
+        for (uint8_t c = 0; c < 3; c++) {
+            for (uint16_t k = 0; k < 256; k++) {
+                const Normal shifted = MIN(MAX(input[k] + args->linear[c], 0.0f), 1.0f);
+                const Normal offset = (input[k] > 0.0f) ? shifted : 0.0f;
+                channel[c][k] = fast_powf(offset, args->gamma[c]);
+            }
+        }
 
-            // PORT 1, bottom pixel
-            (!!(bits[image[p1t+0]] & mask)) << ADDRESS_P1_B1 |
-            (!!(bits[image[p1t+1]] & mask)) << ADDRESS_P1_G1 |
-            (!!(bits[image[p1t+2]] & mask)) << ADDRESS_P1_R1 |
+        if (tone_map) {
+            for (uint16_t k = 0; k < 256; k++) {
+                RGBF gamma_pixel = {channel[0][k], channel[1][k], channel[2][k]};
+                RGBF tone_pixel;
+                args->tone_mapper(&gamma_pixel, &tone_pixel, args->tone_level);
+                channel[0][k] = tone_pixel.r;
+                channel[1][k] = tone_pixel.g;
+                channel[2][k] = tone_pixel.b;
+            }
+        }
 
-            // PORT 1, bottom pixel
-            (!!(bits[image[p1b+0]] & mask)) << ADDRESS_P1_B2 |
-            (!!(bits[image[p1b+1]] & mask)) << ADDRESS_P1_G2 |
-            (!!(bits[image[p1b+2]] & mask)) << ADDRESS_P1_R2 |
+        for (uint8_t c = 0; c < 3; c++) {
+            for (uint16_t k = 0; k < 256; k++) {
+                float value = MIN(MAX(channel[c][k] * args->brightness, 0.0f), 255.0f);
+                const uint32_t index = (c * levels) + block + k;
+                if (binary) {
+                    // the level in binary, bit i is shown for 2^i time units. keeps the
+                    // precision the gamma curve adds to 8 bit input
+                    bits32[index] = (uint32_t)((value * binary_max / 255.0f) + 0.5f);
+                    continue;
+                }
 
-            // PORT 2, bottom pixel
-            (!!(bits[image[p2t+0]] & mask)) << ADDRESS_P1_B1 |
-            (!!(bits[image[p2t+1]] & mask)) << ADDRESS_P1_G1 |
-            (!!(bits[image[p2t+2]] & mask)) << ADDRESS_P1_R1 |
+                if (fraction_bits > 0) {
+                    // the level in steps of the shortest fraction plane, rounded down. keeps the
+                    // precision the gamma curve adds to 8 bit input. non black input lights at least
+                    // the shortest pulse, so near black neither collapses to black nor jumps to a whole plane
+                    uint32_t steps = (uint32_t)((value * full_bits * (1u << fraction_bits)) / 255.0f);
+                    if (steps == 0 && value > 0.0f) {
+                        steps = 1;
+                    }
+                    const uint32_t fraction = steps & ((1u << fraction_bits) - 1);
+                    uint64_t signal = signals[steps >> fraction_bits];
+                    // bit num_bits - 1 is the shortest plane, num_bits - 2 twice as long
+                    for (uint8_t f = 0; f < fraction_bits; f++) {
+                        signal |= (uint64_t)((fraction >> f) & 1) << (num_bits - 1 - f);
+                    }
+                    if (wide) {
+                        bits64[index] = signal;
+                    } else {
+                        bits32[index] = (uint32_t)signal;
+                    }
+                    continue;
+                }
 
-            // PORT 2, bottom pixel
-            (!!(bits[image[p2b+0]] & mask)) << ADDRESS_P2_B2 |
-            (!!(bits[image[p2b+1]] & mask)) << ADDRESS_P2_G2 |
-            (!!(bits[image[p2b+2]] & mask)) << ADDRESS_P2_R2;
+                // 8 bit tables round each level down to a byte like the original byte_to_bcm32/64
+                if (!deep) {
+                    value = floorf(value);
+                }
+                uint8_t num_ones = (uint8_t)((value * num_bits) / 255.0f);
+                if (wide && value >= 1.0f) {
+                    num_ones++;
+                }
 
+                if (wide) {
+                    bits64[index] = signals[num_ones];
+                } else {
+                    bits32[index] = (uint32_t)signals[num_ones];
+                }
+            }
+        }
     }
-    // bcm_signal is now bit mask of length bit_depth for these 6 pixels that can be iterated through to light
-    // the LEDS to the correct brightness levels
 }
 
-
- 
 /**
  * @brief create a bcm signal map from linear sRGB space to the bcm(pwm) signal.
  * the returned pointer will be either uint32_t* or uint64_t* depending on the size
@@ -1218,169 +1628,380 @@ void update_bcm_signal_64_bgr(
  * 
  * looking up any linear 8 bit value in the map will return a BCM bit mask of length num_bits
  * 
- * @param scene contains reference to jitter_brightness, gamma, 
+ * @param scene contains reference to oe_brightness, gamma, 
  * brightness, red_linear, green_linear, blue_linear, red_gamma, green_gamma, blue_gamma, 
- * bit_depth, tone_mapper.
+ * tone_mapper.
  * @param num_bits  number of bits of BCM data (good values from 8-64) try to make them multiples of 4 or 8
+ * @param quant_errors optional, 768 quantization errors of the red channel for error diffusion dithering
  * @return void* pointer to the bcm signal map. 0-255 red, 256-511 green, 512-767 blue
  */
 void *tone_map_rgb_bits(const scene_info *scene, const int num_bits, float *quant_errors) {
     ASSERT(num_bits <= 64);
 
-    
-    //size_t bytes = 3 * 257 * sizeof(uint64_t);
-    //_Alignas(64) uint64_t *bits = (uint64_t*)aligned_alloc(64, bytes);
-    size_t bytes = 3 * 257 * sizeof(uint64_t);
-    _Alignas(32) uint32_t *bits = (uint32_t*)aligned_alloc(32, bytes);
-    memset(bits, 0, bytes);
+    bcm_tone_args args;
+    bcm_build_tone_args(scene, &args);
+    args.bit_depth    = num_bits;
+    args.image_format = IMAGE_FORMAT_RGB8;
 
-    uint64_t *bits64 = (uint64_t *)bits;
-    uint32_t *bits32 = (uint32_t *)bits;
-    uint8_t brightness = (scene->jitter_brightness) ? 255 : scene->brightness;
-    for (uint16_t i=0; i<=255; i++) {
-        RGBF tone_pixel = {0, 0 , 0};
-        RGBF gamma_pixel = {
-            //normal_gamma_correct(normalize8(i) + scene->red_linear, scene->gamma*scene->red_gamma),
-            //normal_gamma_correct(normalize8(i) + scene->green_linear, scene->gamma*scene->green_gamma),
-            //normal_gamma_correct(normalize8(i) + scene->blue_linear, scene->gamma*scene->blue_gamma)
-            normal_gamma_correct(normalize8(i), scene->gamma),
-            normal_gamma_correct(normalize8(i), scene->gamma),
-            normal_gamma_correct(normalize8(i), scene->gamma)
-        };
-        // debug("i: %d: R:%f  G:%f B:%f\n", i, (double)gamma_pixel.r, (double)gamma_pixel.g, (double)gamma_pixel.b);
-
-        // tone map the value ...
-        if (scene->tone_mapper != NULL) {
-            scene->tone_mapper(&gamma_pixel, &tone_pixel, scene->tone_level);
-        } else {
-            tone_pixel.r = gamma_pixel.r;
-            tone_pixel.g = gamma_pixel.g;
-            tone_pixel.b = gamma_pixel.b;
+    size_t bytes = 3 * 256 * sizeof(uint64_t);
+    uint32_t *bits = (uint32_t*)aligned_alloc(32, bytes);
+    if (bits == NULL) {
+        die("unable to allocate %zu bytes for the lookup table\n", bytes);
+    }
+    bcm_build_lut(&args, bits);
+
+    if (quant_errors != NULL) {
+        for (uint16_t i = 0; i < 256; i++) {
+            quant_errors[i]     = byte_to_dither(fast_powf(normalize8(i), args.gamma[0]), num_bits, i) * scene->dither;
+            quant_errors[i+256] = quant_errors[i];
+            quant_errors[i+512] = quant_errors[i];
         }
+    }
+    return bits;
+}
 
-        // calculate quant errors from gamma correction for dithering
-        // quant errors need to calculate difference between the BCM value (0-32) and the original value (255)
-        // ideally this happens as a normalized float, not a byte.
-        quant_errors[i]     = byte_to_dither(gamma_pixel.r, num_bits, i) * scene->dither;
-        quant_errors[i+256] = quant_errors[i];//byte_to_dither(normalize8(i), num_bits) * 255;
-        quant_errors[i+512] = quant_errors[i];//byte_to_dither(normalize8(i), num_bits) * 255;
+void *tone_map_rgb_bits_deep(const scene_info *scene, const int num_bits) {
+    ASSERT(num_bits <= 64);
+    ASSERT(scene->image_format != IMAGE_FORMAT_RGB8);
+
+    bcm_tone_args args;
+    bcm_build_tone_args(scene, &args);
+    args.bit_depth = num_bits;
+
+    size_t bytes = BCM_LUT_BYTES;
+    uint32_t *bits = (uint32_t*)aligned_alloc(32, bytes);
+    if (bits == NULL) {
+        die("unable to allocate %zu bytes for the 16 bit lookup table\n", bytes);
+    }
+    bcm_build_lut(&args, bits);
+    return bits;
+}
 
 
 
-        if (num_bits > 32 && num_bits <= 64) {
-            bits64[i]     = byte_to_bcm64(MIN(tone_pixel.r * brightness, 255), scene->bit_depth);
-            bits64[i+256] = byte_to_bcm64(MIN(tone_pixel.g * brightness, 255), scene->bit_depth);
-            bits64[i+512] = byte_to_bcm64(MIN(tone_pixel.b * brightness, 255), scene->bit_depth);
-        } else if (num_bits <= 32) {
+/**
+ * @brief everything needed to encode a band of rows. filled in once per frame by
+ * map_byte_image_to_bcm and shared read only by all encoder threads
+ */
+typedef struct {
+    bcm_row_args args;
+    /** @brief arguments for row_kernel, args unless the rows are converted through cube */
+    bcm_row_args kernel_args;
+    bcm_row_fn row_kernel;
+    /** @brief prepared color lut, NULL to encode the image as is */
+    const bcm_cube *cube;
+    const void *bits;
+    const uint8_t *image;
+    /** @brief source offset table from bcm_build_remap(), NULL to read the image as is */
+    const uint32_t *remap;
+    /** @brief dither table from bcm_build_dither(), NULL to encode without dithering */
+    const uint8_t *dither;
+    uint32_t *bcm_signal;
+    /** @brief the buffer of the previous frame, read only */
+    const uint32_t *prev_signal;
+    /** @brief source hash of every row currently encoded in bcm_signal, updated by the encoder */
+    uint64_t *row_hash;
+    /** @brief source hash of every row currently encoded in prev_signal */
+    const uint64_t *prev_hash;
+    /** @brief number of rows not re-encoded this frame */
+    atomic_uint rows_skipped;
+} bcm_encode_job;
 
-            bits32[i]     = byte_to_bcm32(MIN(tone_pixel.r * brightness, 255), scene->bit_depth, i);
-            bits32[i+256] = byte_to_bcm32(MIN(tone_pixel.g * brightness, 255), scene->bit_depth, i);
-            bits32[i+512] = byte_to_bcm32(MIN(tone_pixel.b * brightness, 255), scene->bit_depth, i);
+/**
+ * @brief hash the image data that is encoded into one bcm row. that is the top and
+ * bottom image row of every port. never returns 0, 0 marks a row with unknown content
+ * 
+ * @param args scene geometry
+ * @param image pointer to the port 0 top pixel of the row, or the image if remap is set
+ * @param remap remap table entry of the port 0 top pixel of the row, or NULL
+ * @return uint64_t 
+ */
+__attribute__((hot))
+static inline uint64_t bcm_row_hash(const bcm_row_args *args, const uint8_t *image, const uint32_t *remap) {
+    const uint32_t row_bytes    = args->width * args->stride;
+    const uint32_t panel_pixels = args->panel_stride / args->stride;
+    ASSERT(row_bytes % 32 == 0);
+
+    // 4 independent multiply-xor lanes, so the multiplies are not one long dependency chain
+    uint64_t h[4] = {0x9E3779B97F4A7C15ULL, 0xC2B2AE3D27D4EB4FULL, 0x165667B19E3779F9ULL, 0x27D4EB2F165667C5ULL};
+    for (uint8_t k = 0; k < args->num_ports * 2; k++) {
+        if (remap == NULL) {
+            const uint8_t *src = image + (k * args->panel_stride);
+            for (uint32_t i = 0; i < row_bytes; i += 32) {
+                for (uint8_t lane = 0; lane < 4; lane++) {
+                    uint64_t v;
+                    memcpy(&v, src + i + (lane * 8), sizeof(v));
+                    h[lane] = (h[lane] ^ v) * 0xFF51AFD7ED558CCDULL;
+                    h[lane] ^= h[lane] >> 29;
+                }
+            }
+            continue;
         }
 
-        if (CONSOLE_DEBUG) {
-            debug("i: %d   / %f, quant_err: %f, Gamma Value: %f,  Tone Map Value: %f, Tone Mapped pwm: ", i, (double)normalize8(i), (double)quant_errors[i], (double)gamma_pixel.r, (double)tone_pixel.r);
-            //debug("quant err: [%f], [%f], [[%f]]\n", quant_errors[i], quant_errors[i+256], quant_errors[i+512]);
-            if (num_bits <= 32) {
-                uint32_t *num = (uint32_t *)bits;
-                binary32(stderr, num[i]);
-            } else {
-                uint64_t *num = (uint64_t *)bits;
-                binary64(stderr, num[i]);
+        const uint32_t *src = remap + (k * panel_pixels);
+        if (args->image_format != IMAGE_FORMAT_RGB8) {
+            // hash the 16 bit RGB of every pixel the remapped kernel reads, 1 pixel per word
+            for (uint16_t x = 0; x < args->width; x += 4) {
+                for (uint8_t lane = 0; lane < 4; lane++) {
+                    uint64_t v = 0;
+                    memcpy(&v, image + src[x + lane], 6);
+                    h[lane] = (h[lane] ^ v) * 0xFF51AFD7ED558CCDULL;
+                    h[lane] ^= h[lane] >> 29;
+                }
+            }
+            continue;
+        }
+
+        // hash the RGB of every pixel the remapped kernel reads, 2 pixels per word
+        for (uint16_t x = 0; x < args->width; x += 8) {
+            for (uint8_t lane = 0; lane < 4; lane++) {
+                const uint8_t *a = image + src[x + (lane * 2)];
+                const uint8_t *b = image + src[x + (lane * 2) + 1];
+                const uint64_t v = (uint64_t)(a[0] | (a[1] << 8) | (a[2] << 16)) |
+                                   ((uint64_t)(b[0] | (b[1] << 8) | (b[2] << 16)) << 32);
+                h[lane] = (h[lane] ^ v) * 0xFF51AFD7ED558CCDULL;
+                h[lane] ^= h[lane] >> 29;
             }
-            debug("\n");
         }
     }
 
-    if (num_bits <= 32) {
-        if (CONSOLE_DEBUG) {
-            printf("return bits32\n");
+    const uint64_t hash = (h[0] ^ (h[1] * 31)) ^ ((h[2] * 127) ^ (h[3] * 8191));
+    return hash | 1;
+}
+
+/**
+ * @brief copy one encoded row from src to dst. handles every bcm layout
+ * 
+ * @param args scene geometry
+ * @param dst plane 0 of the first pixel in the destination row
+ * @param src plane 0 of the first pixel in the source row
+ */
+static inline void bcm_copy_row(const bcm_row_args *args, uint32_t *__restrict__ dst, const uint32_t *__restrict__ src) {
+    if (args->plane_stride != 1) {
+        // plane-major, the row is split into one run of row_stride words per plane
+        for (uint8_t j = 0; j < args->bit_depth; j++) {
+            memcpy(dst + (j * args->plane_stride), src + (j * args->plane_stride), args->row_stride * sizeof(uint32_t));
+        }
+    } else {
+        memcpy(dst, src, args->row_stride * sizeof(uint32_t));
+    }
+}
+
+/**
+ * @brief store one baked GPIO word. BCM_LAYOUT_SET_CLEAR stores the pins to set and then
+ * every other scanout pin to clear, so the two stores leave the pins at exactly word
+ */
+static inline void bcm_bake_word(uint32_t *out, const uint32_t word, const bool set_clear) {
+    out[0] = word;
+    if (set_clear) {
+        out[1] = ~word & GPIO_SCANOUT_MASK;
+    }
+}
+
+/**
+ * @brief turn one encoded BCM_LAYOUT_STREAM or BCM_LAYOUT_SET_CLEAR row into the words
+ * render_forever writes. adds the row address and the OE duty to every pixel, then appends
+ * the latch words. the clock is low in every pixel word, render_forever raises it after each one
+ * 
+ * @param args scene geometry and OE duty
+ * @param bcm_signal plane 0 of the first pixel in the row
+ * @param y panel row (0 - panel_height/2)
+ */
+static void bcm_bake_stream_row(const bcm_row_args *args, uint32_t *bcm_signal, const uint16_t y) {
+    const uint16_t width       = args->width;
+    const uint16_t half_height = args->plane_stride / args->row_stride;
+    const uint32_t address     = row_to_address(y, half_height);
+    // the kernel left the pins of pixel x in word x * words
+    const bool     set_clear   = args->set_clear;
+    const uint8_t  words       = (set_clear) ? BCM_SET_CLEAR_WORDS : 1;
+
+    for (uint8_t j = 0; j < args->bit_depth; j++) {
+        uint32_t *out = bcm_signal + (j * args->plane_stride);
+        // the display is on for the first clocks of the shift, off for the rest. it shows the
+        // row latched before this one in the plane schedule
+        const uint8_t  shown = args->shown_before[(y == 0) ? 0 : 1][j];
+        const uint8_t  shift = bcm_plane_oe_shift(args->bit_depth, args->fraction_bits, shown);
+        const uint16_t on    = bcm_oe_clocks(args->brightness, width, (uint32_t)j * half_height + y, shift);
+        for (uint16_t x = 0; x < on; x++) {
+            bcm_bake_word(out + (x * words), out[x * words] | address, set_clear);
         }
-        return bits32;
+        for (uint16_t x = on; x < width; x++) {
+            bcm_bake_word(out + (x * words), out[x * words] | address | PIN_OE, set_clear);
+        }
+
+        // the last pixel is still on the pins with the clock high. display off, latch
+        // the row, release the latch. the next row's first word re-enables the display
+        const uint32_t last = out[(width - 1) * words] | PIN_CLK | PIN_OE;
+        bcm_bake_word(out + (width * words), last | PIN_LATCH, set_clear);
+        bcm_bake_word(out + ((width + 1) * words), last, set_clear);
     }
-    return bits64;
 }
 
+/**
+ * @brief encode panel rows [row_start, row_end) of the job. worker_band_fn implementation.
+ * rows whose source image has not changed since they were last encoded are skipped,
+ * or copied from the previous frame if only that buffer holds them
+ * 
+ * @param arg pointer to the bcm_encode_job
+ * @param row_start first row to encode (0 - panel_height/2)
+ * @param row_end last row + 1 to encode
+ */
+__attribute__((hot))
+static void map_rows_to_bcm(void *arg, const uint16_t row_start, const uint16_t row_end) {
+    bcm_encode_job *job         = (bcm_encode_job *)arg;
+    const bcm_row_args *args    = &job->args;
+    const uint32_t row_stride   = args->width * args->stride;
+    const uint32_t bcm_row      = args->row_stride;
+    uint32_t skipped            = 0;
+
+    // remapped kernels address the image through the remap table, which has one entry per pixel
+    const uint32_t image_step = (job->remap == NULL) ? row_stride : 0;
+    const uint32_t *remap_ptr = (job->remap == NULL) ? NULL : job->remap + (row_start * args->width);
+
+    // rows are contiguous in every bcm layout
+    const uint8_t *image_ptr = job->image + (row_start * image_step);
+    uint32_t *bcm_signal     = job->bcm_signal + (row_start * bcm_row);
+
+    // color lut output of one row, the top and bottom image row of every port as RGB48
+    uint16_t cube_row[(job->cube != NULL) ? args->num_ports * 2 * args->width * 3 : 1] __attribute__((aligned(32)));
+
+    for (uint16_t y=row_start; y < row_end; y++) {
+        const uint64_t hash = bcm_row_hash(args, image_ptr, remap_ptr);
+
+        if (hash == job->row_hash[y]) {
+            // this buffer already holds the row
+            skipped++;
+        } else if (hash == job->prev_hash[y]) {
+            bcm_copy_row(args, bcm_signal, job->prev_signal + (y * bcm_row));
+            job->row_hash[y] = hash;
+            skipped++;
+        } else {
+            if (job->cube != NULL) {
+                bcm_cube_row(job->cube, args, image_ptr, remap_ptr, cube_row);
+                job->row_kernel(&job->kernel_args, job->bits, bcm_signal, (const uint8_t*)cube_row, NULL, NULL);
+            } else {
+                // the dither tile repeats every BCM_DITHER_TILE rows, half_height is a multiple of it
+                const uint8_t *dither = (job->dither == NULL) ? NULL : job->dither + ((y % BCM_DITHER_TILE) * BCM_DITHER_ROW);
+                job->row_kernel(&job->kernel_args, job->bits, bcm_signal, image_ptr, remap_ptr, dither);
+            }
+            if (args->stream) {
+                bcm_bake_stream_row(args, bcm_signal, y);
+            }
+            job->row_hash[y] = hash;
+        }
+
+        bcm_signal += bcm_row;
+        image_ptr  += image_step;
+        if (remap_ptr != NULL) {
+            remap_ptr += args->width;
+        }
+    }
 
+    atomic_fetch_add(&job->rows_skipped, skipped);
+}
 
 /**
  * @brief this function takes the image data and maps it to the bcm signal.
  * 
- * if scene->tone_mapper is updated, new bcm bit masks will be created.
+ * if scene->tone_mapper or scene->image_format is updated, new bcm bit masks will be created.
+ * with scene->color_lut set, each row is converted through the lut into a 16 bit row right
+ * before it is encoded, so there is no extra pass over the frame.
  * 
  * @param scene the scene information
- * @param image the image to map to the scene bcm data. if NULL scene->image will be used
+ * @param image the image to map to the scene bcm data, scene->stride channels per pixel in
+ * scene->image_format (IE: RGB48 or RGBA16F for the 16 bit formats). if NULL scene->image will be used
  */
 __attribute__((hot))
 void map_byte_image_to_bcm(scene_info *scene, uint8_t *image) {
 
-    // tone map the bits for the current scene, update if the lookup table if scene tone mapping changes....
+    // tone map the bits for the current scene, rebuilt in place whenever a tone parameter changes
     static void *bits = NULL;
-    static float *quant_errors = NULL;
-    static float *dither_map = NULL;
-    static func_tone_mapper_t last_tone_map = NULL;
-    update_bcm_signal_fn update_bcm_signal = NULL;
-
-    if (UNLIKELY(bits == NULL || last_tone_map != scene->tone_mapper)) {
-        if (quant_errors == NULL) {
-            quant_errors = (float*)malloc(768 * sizeof(float));
-            dither_map = (float*)malloc(scene->width * scene->height * scene->stride * sizeof(float));
-
-            for (int i=0; i<scene->width * scene->height * scene->stride; i++) {
-                dither_map[i] = ((rand() / (float)RAND_MAX) - (rand() / (float)RAND_MAX)) * scene->dither;
+    static bcm_tone_args tone_args;
+    // row kernel for the current scene configuration
+    static bcm_row_args row_args;
+    static bcm_row_args kernel_args;
+    static bcm_row_fn row_kernel = NULL;
+    // color lut prepared for the current image format, if any
+    static bcm_cube *cube = NULL;
+    // pin spread table for the current lookup table and scene configuration, if enabled
+    static uint32_t *spread = NULL;
+    // panel layout source offset table for the current scene configuration, if any
+    static uint32_t *remap = NULL;
+    // ordered dither table for the current dither strength, if dithering
+    static uint8_t *dither = NULL;
+    // source hash of every row held in each bcm buffer. 0 = unknown
+    static uint64_t row_hash[BCM_BUFFERS][BCM_MAX_ROWS];
+
+    bcm_tone_args tone;
+    bcm_build_tone_args(scene, &tone);
+    if (UNLIKELY(bits == NULL || memcmp(&tone, &tone_args, sizeof(bcm_tone_args)) != 0)) {
+        if (bits == NULL) {
+            bits = aligned_alloc(32, BCM_LUT_BYTES);
+            if (bits == NULL) {
+                die("unable to allocate %zu bytes for the lookup table\n", BCM_LUT_BYTES);
             }
         }
-        if (bits != NULL) { // don't leak memory!
-            free(bits);
-        }   
-        if (scene->bit_depth > 32) {
-            bits = (uint64_t*)tone_map_rgb_bits(scene, scene->bit_depth, quant_errors);
-        } else {
-            bits = (uint32_t*)tone_map_rgb_bits(scene, scene->bit_depth, quant_errors);
-        }
-        last_tone_map = scene->tone_mapper;
-        debug("new tone mapped bits created\n");
+        tone_args = tone;
+        bcm_build_lut(&tone_args, bits);
+        // both buffers were encoded with the old table
+        memset(row_hash, 0, sizeof(row_hash));
+        free(spread);
+        spread = NULL;
     }
 
     // select our image source
     uint8_t *base_ptr  = (image == NULL) ? scene->image : image;
-    uint8_t *image_ptr = base_ptr;
 
-    // map the image to handle weird panel chain configurations
-    // the image mapper should take a normal image and map it to match the chain configuration
-    // the image mapper should operate on the image in place
+    // custom image mappers take the image and return the image to encode. the built in
+    // panel layouts (scene->panel_layout, scene->panel_rotation) are applied by the encoder
     if (scene->image_mapper != NULL) {
-        scene->image_mapper(base_ptr, NULL, scene);
-    }
-
-
-    // use the correct bcm_signal mapper, 32 or 64 bit
-    if (scene->bit_depth > 32) {
-        switch (scene->pixel_order) {
-        case PIXEL_ORDER_RGB:
-            update_bcm_signal = (update_bcm_signal_fn)update_bcm_signal_64_rgb;
-            break;
-        case PIXEL_ORDER_RBG:
-            update_bcm_signal = (update_bcm_signal_fn)update_bcm_signal_64_rbg;
-            break;
-        case PIXEL_ORDER_BGR:
-            update_bcm_signal = (update_bcm_signal_fn)update_bcm_signal_64_bgr;
-            break;
+        uint8_t *mapped = scene->image_mapper(base_ptr, NULL, scene);
+        if (mapped != NULL) {
+            base_ptr = mapped;
         }
-    } else {
-        switch (scene->pixel_order) {
-        case PIXEL_ORDER_RGB:
-            update_bcm_signal = (update_bcm_signal_fn)update_bcm_signal_32_rgb;
-            break;
-        case PIXEL_ORDER_RBG:
-            update_bcm_signal = (update_bcm_signal_fn)update_bcm_signal_32_rbg;
-            break;
-        case PIXEL_ORDER_BGR:
-            update_bcm_signal = (update_bcm_signal_fn)update_bcm_signal_32_bgr;
-            break;
+    }
+
+
+    // select the kernel specialized for this pixel order, port count and depth class.
+    // only happens again if the scene configuration changes
+    bcm_row_args args;
+    bcm_build_row_args(scene, &args);
+    // the baked OE duty is compared on its own below, a new brightness keeps the kernel and tables
+    const uint8_t brightness = args.brightness;
+    args.brightness = row_args.brightness;
+    if (UNLIKELY(row_kernel == NULL || memcmp(&args, &row_args, sizeof(bcm_row_args)) != 0)) {
+        row_args    = args;
+        kernel_args = args;
+        if (row_args.color_lut != NULL) {
+            if (cube == NULL) {
+                cube = (bcm_cube*)malloc(sizeof(bcm_cube));
+                if (cube == NULL) {
+                    die("unable to allocate memory for the color lut\n");
+                }
+            }
+            bcm_build_cube(row_args.color_lut, row_args.image_format, cube);
+            bcm_build_cube_args(&row_args, &kernel_args);
         }
+        row_kernel = bcm_select_row_kernel(&kernel_args);
+        memset(row_hash, 0, sizeof(row_hash));
+        free(spread);
+        spread = NULL;
+        free(remap);
+        remap = bcm_build_remap(&row_args);
+        free(dither);
+        dither = bcm_build_dither(&row_args);
+        debug("bcm row kernel selected for %d ports, %d bits\n", row_args.num_ports, row_args.bit_depth);
+    }
+    if (UNLIKELY(brightness != row_args.brightness)) {
+        // both buffers were baked with the old OE duty, re-encode every row on the next frames
+        row_args.brightness    = brightness;
+        kernel_args.brightness = brightness;
+        memset(row_hash, 0, sizeof(row_hash));
+    }
+    if (UNLIKELY(row_args.pin_spread && spread == NULL)) {
+        spread = bcm_build_spread_lut(&row_args, bits);
+        debug("new pin spread table created\n");
     }
-    ASSERT(update_bcm_signal);
 
     ASSERT(scene->panel_height % 16 == 0);
     ASSERT(scene->panel_width % 16 == 0);
@@ -1389,66 +2010,47 @@ void map_byte_image_to_bcm(scene_info *scene, uint8_t *image) {
     // const uint32_t pwm_stride = scene->width * scene->bit_depth;
     // half_height is 1/2 the panel height. since we clock in 2 pixels at a time, 
     // we only need to process half the rows
-    const uint8_t  half_height __attribute__((aligned(16))) = scene->panel_height / 2;
-    // ensure 16 bit alignment for width
-    const uint16_t width __attribute__((aligned(32))) = scene->width;
+    // scan patterns light fewer rows per address, each is a longer row, see scan_pattern_t
+    const uint8_t  half_height __attribute__((aligned(16))) = bcm_scan_rows(scene);
 
     // ensure alignment for the compiler to optimize these loops
     ASSERT(scene->bit_depth % BIT_DEPTH_ALIGNMENT == 0);
-    ASSERT(half_height % 16 == 0);
+    ASSERT(half_height % 4 == 0);
     ASSERT(pwm_stride % BIT_DEPTH_ALIGNMENT == 0);
-    ASSERT(width % 32 == 0);                        // Ensure length is a multiple of 32
-
-    // which buffer we are rendering to
-    uint32_t *bcm_signal = (scene->bcm_ptr)
-        ? (scene->bcm_signalA)
-        : (scene->bcm_signalB);
-
-    // convenience variables
-    const uint16_t stride     = scene->stride;
-    const uint8_t  bit_depth  = scene->bit_depth;
-    //const uint16_t height     = scene->height;
-    const uint16_t row_stride = width * stride;
-
-
-    if (scene->dither > 0.1f) {
-        float *dither_ptr     = dither_map;
-        const uint16_t width  = scene->width;
-        const uint16_t height = scene->height;
-        for (uint16_t y=0; y < height; y++) {
-            image_ptr         = base_ptr + y * row_stride;
-            for (uint16_t x=0; x < width; x++) {
-
-                // update this pixel with the dither error corrected value
-                image_ptr[0] = image_ptr[0] == 0 ? 0 : (uint8_t)clampf((float)image_ptr[0] + dither_ptr[0], 1.0f, 250.0f);
-                image_ptr[1] = image_ptr[1] == 0 ? 0 : (uint8_t)clampf((float)image_ptr[1] + dither_ptr[1], 1.0f, 250.0f);
-                image_ptr[2] = image_ptr[2] == 0 ? 0 : (uint8_t)clampf((float)image_ptr[2] + dither_ptr[2], 1.0f, 250.0f);
-
-                image_ptr += stride;
-                dither_ptr += stride;
-            }
-        }
-    }
-
-    image_ptr = (image == NULL) ? scene->image : image;
-
-    for (uint16_t y=0; y < half_height; y ++) {
-        // for clarity: calculate the offset into the PWM buffer for the first pixel in this row
-        //unsigned int pwm_offset = y * pwm_stride;
-
-        for (uint16_t x=0; x < width; x++) {
-
-            // create the bcm signal for the current pixel, 
-            // writes bit_depth *(sizeof(uint32_t)) bytes to bcm_signal
-            update_bcm_signal(scene, bits, bcm_signal, image_ptr);
-
-            bcm_signal += bit_depth + 1;
-            image_ptr += stride;
-        }
-    }
-
-    // flip the double buffer. render_forever will detect this on next vsync and switch the buffers
-    scene->bcm_ptr = !scene->bcm_ptr;
+    ASSERT(scene->width % 32 == 0);                 // Ensure length is a multiple of 32
+
+    // the free buffer we are rendering to. the buffer of the previous frame may be on screen
+    // or waiting for the scanout, it is only read to copy unchanged rows
+    bcm_swap_t *swap = &scene->bcm_swap;
+    const uint8_t target   = bcm_swap_target(swap);
+    const uint8_t previous = swap->last;
+    uint32_t *bcm_signal   = bcm_buffer(scene, target);
+    ASSERT(half_height <= BCM_MAX_ROWS);
+    ASSERT(previous != target || swap->published == 0);
+
+    bcm_encode_job job = {
+        .args = row_args,
+        .kernel_args = kernel_args,
+        .row_kernel = row_kernel,
+        .cube = (row_args.color_lut != NULL) ? cube : NULL,
+        .bits = (row_args.pin_spread) ? (const void*)spread : bits,
+        .image = base_ptr,
+        .remap = remap,
+        .dither = dither,
+        .bcm_signal = bcm_signal,
+        .prev_signal = bcm_buffer(scene, previous),
+        .row_hash = row_hash[target],
+        .prev_hash = row_hash[previous],
+        .rows_skipped = 0
+    };
+
+    // split the rows over the encoder threads. returns once every band is encoded
+    workers_start(scene->encode_threads);
+    workers_run(map_rows_to_bcm, &job, half_height);
+    scene->bcm_rows_skipped = atomic_load(&job.rows_skipped);
+
+    // hand the frame to render_forever, it is shown from the next frame boundary on
+    bcm_swap_publish(swap, target);
 }
 
 
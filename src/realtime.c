@@ -0,0 +1,153 @@
+/**
+ * real-time setup of the scanout thread. render_forever pins the thread it runs on to one
+ * core, raises it to SCHED_FIFO and locks the process memory, so the row timing is not
+ * broken up by the scheduler, other threads or page faults. the kernel can only keep the
+ * core to itself if it is isolated, IE: isolcpus=3 nohz_full=3 rcu_nocbs=3 in cmdline.txt
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/param.h>
+
+#include "rpihub75.h"
+#include "util.h"
+#include "workers.h"
+#include "realtime.h"
+
+#define REALTIME_ISOLATED_PATH "/sys/devices/system/cpu/isolated"
+#define REALTIME_NOHZ_PATH "/sys/devices/system/cpu/nohz_full"
+
+
+bool realtime_cpu_listed(const char *path, const int cpu) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return false;
+    }
+    char list[256] = {0};
+    const bool read = fgets(list, sizeof(list), file) != NULL;
+    fclose(file);
+    if (!read) {
+        return false;
+    }
+
+    // comma separated cores and ranges, IE: 1,3-5
+    for (char *range = strtok(list, ",\n"); range != NULL; range = strtok(NULL, ",\n")) {
+        char *end;
+        const long first = strtol(range, &end, 10);
+        const long last  = (*end == '-') ? strtol(end + 1, NULL, 10) : first;
+        if (end != range && cpu >= first && cpu <= last) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int16_t realtime_pick_cpu(const int16_t cpu) {
+    const int16_t cores = (int16_t)MAX(sysconf(_SC_NPROCESSORS_ONLN), 1);
+
+    int16_t isolated = -1;
+    for (int16_t i = 0; i < cores && isolated < 0; i++) {
+        if (realtime_cpu_listed(REALTIME_ISOLATED_PATH, i)) {
+            isolated = i;
+        }
+    }
+
+    if (cpu == SCANOUT_CPU_AUTO) {
+        return (isolated >= 0) ? isolated : cores - 1;
+    }
+    if (cpu < 0 || cpu >= cores) {
+        fprintf(stderr, "warning: scanout core %d is not online, using core %d\n", cpu, (isolated >= 0) ? isolated : cores - 1);
+        return (isolated >= 0) ? isolated : cores - 1;
+    }
+    if (isolated >= 0 && !realtime_cpu_listed(REALTIME_ISOLATED_PATH, cpu)) {
+        fprintf(stderr, "warning: scanout core %d is not isolated, using isolated core %d\n", cpu, isolated);
+        return isolated;
+    }
+    return cpu;
+}
+
+void realtime_latency_test(const uint16_t ms, realtime_status_t *status) {
+    const uint64_t frequency = cycle_counter_frequency();
+    const uint64_t stall     = frequency * REALTIME_STALL_US / 1000000;
+    const uint64_t end       = cycle_counter() + frequency * ms / 1000;
+
+    uint64_t longest = 0;
+    uint32_t stalls  = 0;
+    uint64_t last    = cycle_counter();
+    while (last < end) {
+        const uint64_t now = cycle_counter();
+        const uint64_t gap = now - last;
+        longest = MAX(longest, gap);
+        stalls += gap > stall;
+        last = now;
+    }
+
+    status->latency_max_us = (double)longest * 1e6 / frequency;
+    status->latency_stalls = stalls;
+}
+
+void realtime_setup(const realtime_config_t *config, realtime_status_t *status) {
+    // zeroed uses the defaults, like scene->panel_timing
+    const realtime_config_t defaults = {
+        .cpu = SCANOUT_CPU, .priority = SCANOUT_PRIORITY, .lock_memory = true, .latency_test_ms = SCANOUT_LATENCY_TEST_MS
+    };
+    const realtime_config_t zeroed = {0};
+    if (memcmp(config, &zeroed, sizeof(realtime_config_t)) == 0) {
+        config = &defaults;
+    }
+    memset(status, 0, sizeof(realtime_status_t));
+
+    // only this thread, threads the caller already started keep their affinity
+    status->cpu = realtime_pick_cpu(config->cpu);
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(status->cpu, &cpuset);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset) != 0) {
+        fprintf(stderr, "warning: unable to pin the scanout thread to core %d\n", status->cpu);
+        status->cpu = -1;
+    }
+    pthread_setname_np(pthread_self(), "hub75-scanout");
+
+    if (status->cpu >= 0) {
+        status->isolated = realtime_cpu_listed(REALTIME_ISOLATED_PATH, status->cpu);
+        status->nohz     = realtime_cpu_listed(REALTIME_NOHZ_PATH, status->cpu);
+        if (!status->isolated) {
+            fprintf(stderr, "warning: scanout core %d is not isolated, add isolcpus=%d nohz_full=%d rcu_nocbs=%d to the kernel command line\n",
+                status->cpu, status->cpu, status->cpu, status->cpu);
+        }
+    }
+    // move the encoder threads to the other cores, now or when they start
+    workers_set_scanout_cpu(status->cpu);
+
+    if (config->priority > 0) {
+        const struct sched_param param = { .sched_priority = MIN(config->priority, sched_get_priority_max(SCHED_FIFO)) };
+        status->fifo = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0;
+        if (!status->fifo) {
+            fprintf(stderr, "warning: unable to set SCHED_FIFO priority %d on the scanout thread (needs root or CAP_SYS_NICE)\n", config->priority);
+        }
+    }
+
+    if (config->lock_memory) {
+        status->locked = mlockall(MCL_CURRENT | MCL_FUTURE) == 0;
+        if (!status->locked) {
+            fprintf(stderr, "warning: unable to lock the process memory (raise RLIMIT_MEMLOCK)\n");
+        }
+    }
+
+    printf("scanout thread: core %d%s%s, %s, memory %s\n", status->cpu,
+        (status->isolated) ? " isolated" : "", (status->nohz) ? " nohz_full" : "",
+        (status->fifo) ? "SCHED_FIFO" : "SCHED_OTHER", (status->locked) ? "locked" : "not locked");
+
+    if (config->latency_test_ms > 0) {
+        realtime_latency_test(config->latency_test_ms, status);
+        printf("scanout latency self test: longest stall %.1fus, %u stalls over %dus in %dms\n",
+            status->latency_max_us, status->latency_stalls, REALTIME_STALL_US, config->latency_test_ms);
+    }
+}
@@ -45,11 +45,14 @@
 
 #include "rpihub75.h"
 #include "util.h"
+#include "workers.h"
+#include "gpio.h"
+#include "realtime.h"
 
 
 /**
  * @brief calculate an address line pin mask for row y
- * not used outside this file
+ * used by the scanout loops and the BCM_LAYOUT_STREAM encoder
  * @param y the panel row number to calculate the mask for
  * @return uint32_t the bitmask for the address lines at row y
  */
@@ -71,6 +74,53 @@ uint32_t row_to_address(const int y, uint8_t half_height) {
 }
 
 
+void bcm_plane_schedule(const scene_info *scene, uint8_t *schedule) {
+    // check_scene() limits the bit depth to MAX_BITS
+    const uint8_t bit_depth = MIN(scene->bit_depth, MAX_BITS);
+    const uint8_t rows      = bcm_scan_rows(scene);
+
+    // the order of one row
+    uint8_t sequence[MAX_BITS];
+    uint8_t count = 0;
+    switch (scene->bcm_plane_order) {
+    case BCM_ORDER_INTERLEAVED:
+        for (uint8_t i=0; i<bit_depth; i++) {
+            sequence[i] = (i & 1) ? bit_depth - 1 - (i / 2) : i / 2;
+        }
+        break;
+    case BCM_ORDER_BIT_REVERSED: {
+        // reverse the bits of every index below the next power of 2, skip the ones past bit_depth
+        uint8_t bits = 0;
+        while ((1 << bits) < bit_depth) {
+            bits++;
+        }
+        for (uint16_t i=0; i < (1 << bits); i++) {
+            uint8_t reversed = 0;
+            for (uint8_t b=0; b<bits; b++) {
+                reversed |= ((i >> b) & 1) << (bits - 1 - b);
+            }
+            if (reversed < bit_depth) {
+                sequence[count++] = reversed;
+            }
+        }
+        break;
+    }
+    default:
+        for (uint8_t i=0; i<bit_depth; i++) {
+            sequence[i] = i;
+        }
+    }
+
+    // every row but the sequential ones starts one plane later than the row above
+    const uint8_t stagger = (scene->bcm_plane_order == BCM_ORDER_SEQUENTIAL) ? 0 : 1;
+    for (uint8_t step=0; step<bit_depth; step++) {
+        for (uint8_t y=0; y<rows; y++) {
+            schedule[(step * rows) + y] = sequence[(step + (y * stagger)) % bit_depth];
+        }
+    }
+}
+
+
 
 
 /**
@@ -101,18 +151,54 @@ void check_scene(const scene_info *scene) {
     if (scene->stride != 3 && scene->stride != 4) { 
         die("Only 3 or 4 byte stride supported\n");
     }
+    if (scene->image_format > IMAGE_FORMAT_RGB16F) {
+        die("unknown image format %d\n", scene->image_format);
+    }
+    if (scene->image_format != IMAGE_FORMAT_RGB8 && scene->image_mapper != NULL) {
+        die("image mappers only support 8 bit images, use panel_layout for 16 bit images\n");
+    }
     if (scene->bcm_signalA == NULL) {
         die("No bcm signal buffer A defined\n");
     }
     if (scene->bcm_signalB == NULL) {
         die("No bcm signal buffer B defined\n");
     }
+    if (scene->bcm_signalC == NULL) {
+        die("No bcm signal buffer C defined\n");
+    }
     if (scene->image == NULL) {
         die("No RGB image buffer defined\n");
     }
     if (scene->bit_depth < 4 || scene->bit_depth > 64) {
         die("Only 4-64 bit depth supported\n");
     }
+    if (scene->panel_rotation != 0 && scene->panel_rotation != 90 && scene->panel_rotation != 180 && scene->panel_rotation != 270) {
+        die("panel rotation must be 0, 90, 180 or 270\n");
+    }
+    if ((scene->panel_rotation == 90 || scene->panel_rotation == 270) && scene->panel_width != scene->panel_height) {
+        die("90 and 270 degree panel rotation requires square panels\n");
+    }
+    if ((scene->panel_layout & PANEL_LAYOUT_U) && (scene->width / scene->panel_width) % 2 != 0) {
+        die("U panel layout requires an even number of panels on each chain\n");
+    }
+    if (scene->scan_pattern.scan != 0) {
+        const scan_pattern_t *scan = &scene->scan_pattern;
+        if (scan->scan != 4 && scan->scan != 8 && scan->scan != 16 && scan->scan != 32) {
+            die("scan pattern must be 1/4, 1/8, 1/16 or 1/32 scan, not 1/%d\n", scan->scan);
+        }
+        if ((scene->panel_height / 2) % scan->scan != 0) {
+            die("1/%d scan does not divide the %d rows of each panel half\n", scan->scan, scene->panel_height / 2);
+        }
+        if (scan->tile_width != 0 && scene->panel_width % scan->tile_width != 0) {
+            die("scan tile width %d does not divide the panel width %d\n", scan->tile_width, scene->panel_width);
+        }
+    }
+    if (scene->height < scene->panel_height * scene->num_ports) {
+        die("image height %d is less than panel_height * num_ports\n", scene->height);
+    }
+    if (scene->encode_threads > MAX_ENCODE_THREADS) {
+        die("Max encode_threads is %d\n", MAX_ENCODE_THREADS);
+    }
     if (scene->motion_blur_frames > 32) {
         die("Max motion blur frames is 32\n");
     }
@@ -120,6 +206,37 @@ void check_scene(const scene_info *scene) {
     if (scene->brightness > 254) {
         die("Max brightness is 254\n");
     }
+    if (scene->bcm_layout > BCM_LAYOUT_SET_CLEAR) {
+        die("unknown bcm layout %d\n", scene->bcm_layout);
+    }
+    if (scene->bcm_weight > BCM_WEIGHT_BINARY) {
+        die("unknown bcm weight %d\n", scene->bcm_weight);
+    }
+    if (scene->bcm_weight == BCM_WEIGHT_BINARY) {
+        if (scene->bit_depth > BCM_BINARY_MAX_BITS) {
+            die("binary bcm supports at most %d bit planes, not %d\n", BCM_BINARY_MAX_BITS, scene->bit_depth);
+        }
+        if (scene->bcm_lsb_ns == 0) {
+            die("binary bcm requires a bcm_lsb_ns display time\n");
+        }
+        if (bcm_layout_stream(scene->bcm_layout)) {
+            die("binary bcm times OE in render_forever, it can not use the prebaked BCM_LAYOUT_STREAM or BCM_LAYOUT_SET_CLEAR\n");
+        }
+    }
+    if (scene->bcm_plane_order > BCM_ORDER_BIT_REVERSED) {
+        die("unknown bcm plane order %d\n", scene->bcm_plane_order);
+    }
+    if (scene->bcm_fraction_bits > BCM_FRACTION_MAX_BITS) {
+        die("at most %d fraction bits supported, not %d\n", BCM_FRACTION_MAX_BITS, scene->bcm_fraction_bits);
+    }
+    if (scene->bcm_fraction_bits > 0) {
+        if (scene->bcm_weight != BCM_WEIGHT_LINEAR) {
+            die("fraction planes require BCM_WEIGHT_LINEAR, binary planes already have their own weights\n");
+        }
+        if (scene->bit_depth < 4 + BCM_FRACTION_MAX_PLANES) {
+            die("fraction planes require a bit depth of at least %d\n", 4 + BCM_FRACTION_MAX_PLANES);
+        }
+    }
     if (scene->bit_depth % BIT_DEPTH_ALIGNMENT != 0) {
         die("requested bit_depth %d, but %d is not aligned to %d bytes\n"
             "To use this bit depth, you must #define BIT_DEPTH_ALIGNMENT to the\n"
@@ -133,8 +250,8 @@ void check_scene(const scene_info *scene) {
  * panels in a left, left, down, right pattern (or right, right, down, left) if the image is
  * mirrored.
  * 
- * NOTE: This code is un-tested. If you have the time, please send me an implementation of U and V
- * mappers
+ * NOTE: This code is un-tested. scene->panel_layout = PANEL_LAYOUT_U maps U chains in the encoder
+ * without an extra pass over the image
  * 
  * 
  * @param image - input buffer to map
@@ -166,16 +283,16 @@ uint8_t *u_mapper_impl(uint8_t *image_in, uint8_t *image_out, const struct scene
     for (int y = 0; y < (scene->height / 2); y++) {
         // Copy each row from bottom half
         debug ("  Y: %d, offset: %d", y, y * scene->width * scene->stride);
-        memcpy(output_image + (y * scene->width * scene->stride), bottom_half + (y * scene->width * scene->stride), row_length);
+        memcpy(image_out + (y * scene->width * scene->stride), bottom_half + (y * scene->width * scene->stride), row_length);
     }
 
     // Remap top half to the second part of the output
     for (int y = 0; y < (scene->height / 2); y++) {
         // Copy each row from top half
-        memcpy(output_image + ((y + (scene->width / 2)) * scene->width * scene->stride), image_in + (y * scene->width * scene->stride), row_length);
+        memcpy(image_out + ((y + (scene->height / 2)) * scene->width * scene->stride), image_in + (y * scene->width * scene->stride), row_length);
     }
 
-    return output_image;
+    return image_out;
 }
 
 
@@ -185,7 +302,17 @@ uint8_t *flip_mapper(uint8_t *image, uint8_t *image_out, const struct scene_info
 
     uint16_t row_sz = scene->width * scene->stride;
 
-    uint8_t *temp_row = malloc(row_sz);
+    // one row, allocated once
+    static uint8_t *temp_row = NULL;
+    static uint16_t temp_sz = 0;
+    if (temp_sz < row_sz) {
+        free(temp_row);
+        temp_row = malloc(row_sz);
+        if (temp_row == NULL) {
+            die("Failed to allocate memory for flip_mapper row\n");
+        }
+        temp_sz = row_sz;
+    }
 
     for (uint16_t y=0; y < scene->height / 2; y++) {
         uint8_t *top_row = image + y * row_sz;
@@ -253,44 +380,238 @@ uint8_t *mirror_flip_mapper(uint8_t *image, uint8_t *image_out, const struct sce
 
 
 /**
- * internal method for rendering on pi zero, 3 and 4
+ * @brief function definition for a write to the GPIO registers, see gpio_backend_t
  */
-void render_forever_pi4(const scene_info *scene, int version) {
+typedef void (*gpio_write_fn)(void *gpio, const uint32_t pins);
 
-    srand(time(NULL));
-    // map the gpio address to we can control the GPIO pins
-    uint32_t *PERIBase = map_gpio(0, version); // for root on pi5 (/dev/mem, offset is 0xD0000)
-    // offset to the RIO registers (required for #define register access. 
-    // TODO: this needs to be improved and #define to RIOBase removed)
-    if (version == 4) {
-    	configure_gpio(PERIBase, 4);
-    } else if (version == 3) {
-    	configure_gpio(PERIBase, 3);
+
+/**
+ * @brief scanout timing kept by the render thread. only scanout_frame_done() touches
+ * the shared scene->scanout_stats, once per frame
+ */
+typedef struct {
+    scanout_timing_t timing;
+    /** @brief counter at the start of the current frame, plane and row */
+    uint64_t frame_start;
+    uint64_t plane_start;
+    uint64_t row_start;
+    /** @brief rows longer than this are stalls. from the mean row of the previous frame */
+    uint64_t stall_ticks;
+    /** @brief ticks of the current frame spent holding binary planes, not counted as row time */
+    uint64_t frame_hold;
+} scanout_clock_t;
+
+
+static void scanout_clock_start(scanout_clock_t *clock) {
+    memset(clock, 0, sizeof(scanout_clock_t));
+    clock->timing.ticks_per_second = cycle_counter_frequency();
+    clock->timing.frame_min = UINT64_MAX;
+    clock->stall_ticks = UINT64_MAX;
+    clock->frame_start = clock->plane_start = clock->row_start = cycle_counter();
+}
+
+/**
+ * @brief time the row just latched. one counter read, the row end is the next row start
+ * 
+ * @param hold ticks the row waited for a BCM_WEIGHT_BINARY plane, 0 for linear planes.
+ * only the rest of the row counts towards stalls
+ */
+static inline __attribute__((always_inline)) void scanout_row_done(scanout_clock_t *clock, const uint64_t hold) {
+    const uint64_t now = cycle_counter();
+    const uint64_t row = now - clock->row_start;
+    clock->row_start = now;
+    clock->frame_hold += hold;
+
+    clock->timing.row_histogram[scanout_bucket(row)]++;
+    clock->timing.stalls += (row - MIN(row, hold) > clock->stall_ticks);
+    if (UNLIKELY(row > clock->timing.row_max)) {
+        clock->timing.row_max = row;
+        clock->timing.row_max_frame = clock->timing.frames;
     }
+}
 
+/**
+ * @brief time the bit plane just shifted out. ends with its last row
+ */
+static inline __attribute__((always_inline)) void scanout_plane_done(scanout_clock_t *clock) {
+    const uint64_t plane = clock->row_start - clock->plane_start;
+    clock->plane_start = clock->row_start;
+
+    clock->timing.planes++;
+    clock->timing.plane_last = plane;
+    clock->timing.plane_histogram[scanout_bucket(plane)]++;
+    clock->timing.plane_max = MAX(clock->timing.plane_max, plane);
+}
 
-     
-    // index into the OE jitter mask
-    uint16_t jitter_idx = 0;
-    // pre compute some variables. let the compiler know the alignment for optimizations
-    const uint8_t  half_height __attribute__((aligned(16))) = scene->panel_height / 2;
-    const uint16_t width __attribute__((aligned(16))) = scene->width;
-    const uint8_t  bit_depth __attribute__((aligned(BIT_DEPTH_ALIGNMENT))) = scene->bit_depth;
+/**
+ * @brief time the frame just shifted out, publish the timing to scene->scanout_stats.
+ * nothing else leaves the scanout thread, scanout_report() prints it for show_fps
+ */
+static void scanout_frame_done(const scene_info *scene, scanout_clock_t *clock) {
+    scanout_timing_t *timing = &clock->timing;
+    const uint64_t frame = clock->row_start - clock->frame_start;
+    clock->frame_start = clock->row_start;
+
+    timing->frames++;
+    timing->frame_last = frame;
+    timing->frame_min = MIN(timing->frame_min, frame);
+    timing->frame_max = MAX(timing->frame_max, frame);
+    timing->frame_sum += frame;
+    timing->frame_sum_sq += (double)frame * (double)frame;
+    timing->frame_histogram[scanout_bucket(frame)]++;
+    clock->stall_ticks = (frame - MIN(frame, clock->frame_hold)) * SCANOUT_STALL_FACTOR / (scene->bit_depth * bcm_scan_rows(scene));
+    clock->frame_hold = 0;
+
+    // seqlock, readers retry while the sequence is odd or has moved
+    scanout_stats_t *stats = scene->scanout_stats;
+    const uint32_t sequence = atomic_load_explicit(&stats->sequence, memory_order_relaxed);
+    atomic_store_explicit(&stats->sequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    memcpy(&stats->timing, timing, sizeof(scanout_timing_t));
+    atomic_store_explicit(&stats->sequence, sequence + 2, memory_order_release);
+}
 
-    // pointer to the current bcm data to be displayed
-    uint32_t *bcm_signal = scene->bcm_signalA;
-    ASSERT(width % 16 == 0);
-    ASSERT(half_height % 16 == 0);
-    ASSERT(bit_depth % BIT_DEPTH_ALIGNMENT == 0);
+/**
+ * @brief show_fps reporter thread. prints the refresh rate every SCANOUT_REPORT_S seconds from
+ * the timing render_forever publishes to scene->scanout_stats, so a slow or blocked stdout
+ * never stalls the scanout. returns once scene->do_render is false
+ *
+ * @param arg the scene_info
+ */
+static void *scanout_report(void *arg) {
+    const scene_info *scene = (const scene_info *)arg;
+    scanout_timing_t last, now;
+    scanout_stats_read(scene->scanout_stats, &last);
+
+    uint32_t waited_ms = 0;
+    while (scene->do_render) {
+        // wake often enough to follow do_render, render_forever joins this thread
+        usleep(SCANOUT_REPORT_POLL_MS * 1000);
+        waited_ms += SCANOUT_REPORT_POLL_MS;
+        if (waited_ms < SCANOUT_REPORT_S * 1000 || !scanout_stats_read(scene->scanout_stats, &now)) {
+            continue;
+        }
+        waited_ms = 0;
+
+        // the frames are back to back, their summed durations are the time shifted out
+        const double seconds = (double)(now.frame_sum - last.frame_sum) / now.ticks_per_second;
+        if (seconds > 0) {
+            printf("Panel Refresh Rate: %.0fHz (%.0f planes/s), worst row: %.1fus, stalls: %llu, unchanged rows skipped: %d/%d, frames dropped: %u\n",
+                (now.frames - last.frames) / seconds, (now.planes - last.planes) / seconds,
+                now.row_max * 1e6 / now.ticks_per_second, (unsigned long long)now.stalls,
+                scene->bcm_rows_skipped, bcm_scan_rows(scene),
+                atomic_load_explicit(&scene->bcm_swap.dropped, memory_order_relaxed));
+        }
+        last = now;
+    }
+    return NULL;
+}
 
-    bool last_pointer = scene->bcm_ptr;
 
-    // create the OE jitter mask to control screen brightness
-    // if we are using BCM brightness, then set OE to 0 (0 is display on ironically)
-    uint32_t *jitter_mask = create_jitter_mask(JITTER_SIZE, scene->brightness);
-    if (scene->jitter_brightness == false) {
-        memset(jitter_mask, 0, JITTER_SIZE);
+/**
+ * @brief counter ticks each BCM_WEIGHT_BINARY plane is shown for, bcm_lsb_ns << plane
+ * rounded to the nearest tick. all 0 for BCM_WEIGHT_LINEAR
+ */
+static void scanout_hold_ticks(const scene_info *scene, uint64_t *hold_ticks) {
+    const uint64_t ticks_per_second = cycle_counter_frequency();
+    for (uint8_t i=0; i<scene->bit_depth; i++) {
+        const uint64_t ns = (uint64_t)scene->bcm_lsb_ns << i;
+        hold_ticks[i] = (scene->bcm_weight == BCM_WEIGHT_BINARY) ? (ns * ticks_per_second + 500000000ULL) / 1000000000ULL : 0;
     }
+}
+
+/**
+ * @brief spin until ticks have passed since start
+ */
+static inline __attribute__((always_inline)) void scanout_hold(const uint64_t start, const uint64_t ticks) {
+    while (cycle_counter() - start < ticks) {
+        asm volatile ("" : : : "memory");
+    }
+}
+
+
+// delays of at least this many counter ticks wait on the counter, shorter ones spin calibrated loops
+#define SCANOUT_DELAY_MIN_TICKS 8
+
+/**
+ * @brief one panel_timing_t delay. short delays spin calibrated loops, anything the cycle
+ * counter resolves well waits on the counter so cpu clock changes do not stretch it
+ */
+typedef struct {
+    uint32_t loops;
+    uint32_t ticks;
+} scanout_delay_t;
+
+/**
+ * @brief the panel_timing_t delays, built once by render_forever
+ */
+typedef struct {
+    scanout_delay_t address_setup;
+    scanout_delay_t clock_low;
+    scanout_delay_t data_setup;
+    scanout_delay_t clock_high;
+    scanout_delay_t latch;
+    scanout_delay_t oe_setup;
+} scanout_delays_t;
+
+static scanout_delay_t scanout_delay_of(const uint16_t ns, const double loops_per_us, const uint64_t ticks_per_second) {
+    const uint64_t ticks = ((uint64_t)ns * ticks_per_second + 500000000ULL) / 1000000000ULL;
+    if (ticks >= SCANOUT_DELAY_MIN_TICKS) {
+        return (scanout_delay_t) { .loops = 0, .ticks = ticks };
+    }
+    return (scanout_delay_t) { .loops = (uint32_t)(ns * loops_per_us / 1000.0 + 0.5), .ticks = 0 };
+}
+
+/**
+ * @brief convert the panel timing to delays calibrated on this core
+ */
+static void scanout_build_delays(const panel_timing_t *timing, scanout_delays_t *delays) {
+    const double loops_per_us = spin_loops_per_us();
+    const uint64_t ticks_per_second = cycle_counter_frequency();
+    delays->address_setup = scanout_delay_of(timing->address_setup_ns, loops_per_us, ticks_per_second);
+    delays->clock_low     = scanout_delay_of(timing->clock_low_ns, loops_per_us, ticks_per_second);
+    delays->data_setup    = scanout_delay_of(timing->data_setup_ns, loops_per_us, ticks_per_second);
+    delays->clock_high    = scanout_delay_of(timing->clock_high_ns, loops_per_us, ticks_per_second);
+    delays->latch         = scanout_delay_of(timing->latch_ns, loops_per_us, ticks_per_second);
+    delays->oe_setup      = scanout_delay_of(timing->oe_setup_ns, loops_per_us, ticks_per_second);
+    debug("%s panel timing, %.1f spin loops/us\n", timing->name, loops_per_us);
+}
+
+/**
+ * @brief wait out one panel_timing_t delay. 0 returns at once
+ */
+static inline __attribute__((always_inline)) void scanout_delay(const scanout_delay_t delay) {
+    spin_delay(delay.loops);
+    if (delay.ticks != 0) {
+        scanout_hold(cycle_counter(), delay.ticks);
+    }
+}
+
+
+/**
+ * @brief scanout for the pi zero, 3 and 4. the pins can only be set and cleared,
+ * so every pixel takes a clear and two sets. runs until scene->do_render is false.
+ * always inlined so the hardware register ops compile to plain stores
+ */
+static inline __attribute__((always_inline)) void scanout_set_clear(scene_info *scene, const scanout_delays_t *delays, void *gpio, gpio_write_fn gpio_set, gpio_write_fn gpio_clear) {
+
+    // pre compute some variables. let the compiler know the alignment for optimizations
+    // scan patterns shift every row a row address lights in one pass, see scan_pattern_t
+    const uint8_t  half_height __attribute__((aligned(16))) = bcm_scan_rows(scene);
+    const uint16_t width __attribute__((aligned(16))) = bcm_shift_width(scene);
+    const uint8_t  bit_depth __attribute__((aligned(BIT_DEPTH_ALIGNMENT))) = scene->bit_depth;
+    // BCM_LAYOUT_PLANE: planes are contiguous and pixels are 1 word apart (sequential read)
+    // BCM_LAYOUT_PIXEL: planes are 1 word apart and pixels are bit_depth + 1 words apart
+    const uint32_t plane_stride = bcm_plane_stride(scene);
+    const uint32_t pixel_stride = bcm_pixel_stride(scene);
+    const uint32_t row_stride   = bcm_row_stride(scene);
+
+    // the buffer on screen and its bcm data
+    uint8_t front = BCM_BUFFERS - 1;
+    uint32_t *bcm_signal = bcm_buffer(scene, front);
+    ASSERT(width % 16 == 0);
+    ASSERT(half_height % 4 == 0);
+    ASSERT(bit_depth % BIT_DEPTH_ALIGNMENT == 0);
 
     // store the row to address mapping in an array for faster access
     uint32_t addr_map[half_height];
@@ -298,225 +619,381 @@ void render_forever_pi4(const scene_info *scene, int version) {
         addr_map[i] = row_to_address(i, half_height);
     }
 
-    time_t last_time_s     = time(NULL);
-    uint32_t frame_count   = 0;
+    // the plane each row shows at each step of the frame
+    uint8_t schedule[bit_depth * half_height];
+    bcm_plane_schedule(scene, schedule);
+
+    // BCM_WEIGHT_BINARY: the ticks each plane is shown for, the plane of the row on the
+    // panel and the time the last row took to shift in
+    const bool binary = scene->bcm_weight == BCM_WEIGHT_BINARY;
+    uint64_t hold_ticks[MAX_BITS];
+    scanout_hold_ticks(scene, hold_ticks);
+    uint8_t  shown       = schedule[(bit_depth * half_height) - 1];
+    uint64_t shift_ticks = 0;
+    // BCM_WEIGHT_LINEAR: how much shorter the OE pulse of each plane is, the row shown while
+    // shifting is the one latched before it
+    uint8_t oe_shift[MAX_BITS];
+    for (uint8_t i=0; i<bit_depth; i++) {
+        oe_shift[i] = bcm_plane_oe_shift(bit_depth, scene->bcm_fraction_bits, i);
+    }
+
+    scanout_clock_t clock;
+    scanout_clock_start(&clock);
     uint32_t last_addr     = 0;
     uint32_t color_pins    = 0;
 
-    // uint8_t bright = scene->brightness;
     while(scene->do_render) {
+        // OE duty of every linear row, picked up once per frame. see bcm_oe_clocks()
+        const uint8_t brightness = (scene->oe_brightness && !binary) ? scene->brightness : 255;
 
-        // iterate over the bit plane
-        for (uint8_t pwm=0; pwm<bit_depth; pwm++) {
-            time_t current_time_s = time(NULL);
-            frame_count++;
-            // for the current bit plane, render the entire frame
-            uint32_t offset = pwm;
+        // iterate over the bit plane schedule, every row shows its own plane at each step
+        for (uint8_t step=0; step<bit_depth; step++) {
             for (uint16_t y=0; y<half_height; y++) {
                 asm volatile ("" : : : "memory");  // Prevents optimization
+                const uint8_t pwm = schedule[(step * half_height) + y];
+                uint32_t offset = (pwm * plane_stride) + (y * row_stride);
+                const uint16_t on = bcm_oe_clocks(brightness, width, (uint32_t)pwm * half_height + y, oe_shift[shown]);
 
-                PERIBase[7]  = addr_map[y] & ~last_addr;
-                SLOW
-                PERIBase[10] = ~addr_map[y] & last_addr;
-                SLOW
+                gpio_set(gpio, addr_map[y] & ~last_addr);
+                gpio_clear(gpio, ~addr_map[y] & last_addr);
+                scanout_delay(delays->address_setup);
                 last_addr    = addr_map[y];
 
+                // linear planes turn the display on once the address is set, and off again
+                // after the first on clocks of the shift
+                if (!binary && on != 0) {
+                    gpio_clear(gpio, PIN_OE);
+                }
+
+                // binary planes show the latched row for exactly hold, planes shorter than
+                // the shift are shown before it, the others while shifting
+                uint64_t shown_start = 0, hold = 0;
+                bool overlap = false;
+                if (binary) {
+                    gpio_clear(gpio, PIN_OE);
+                    shown_start = cycle_counter();
+                    hold = hold_ticks[shown];
+                    overlap = hold > shift_ticks;
+                    if (!overlap) {
+                        scanout_hold(shown_start, hold);
+                        gpio_set(gpio, PIN_OE);
+                    }
+                }
+                const uint64_t shift_start = (binary) ? cycle_counter() : 0;
+
                 for (uint16_t x=0; x<width; x++) {
                     asm volatile ("" : : : "memory");  // Prevents optimization
-                    uint32_t new_mask = (bcm_signal[offset]);// | jitter_mask[jitter_idx]);
-                    PERIBase[10]      = (~new_mask & color_pins) | PIN_CLK;
-                    SLOW
-                    PERIBase[7]       = (new_mask & ~color_pins);
-                    SLOW
-                    SLOW
-                    SLOW
-                    PERIBase[7]       = (new_mask) | PIN_CLK;
-
-                    SLOW
-                    SLOW
-                    SLOW
+                    uint32_t new_mask = (bcm_signal[offset]);
+                    gpio_clear(gpio, (~new_mask & color_pins) | PIN_CLK);
+                    scanout_delay(delays->clock_low);
+                    gpio_set(gpio, (new_mask & ~color_pins) | ((x < on) ? 0 : PIN_OE));
+                    scanout_delay(delays->data_setup);
+                    gpio_set(gpio, new_mask | PIN_CLK);
+                    scanout_delay(delays->clock_high);
                     color_pins        = new_mask;
 
-                    // advance the global OE jitter mask 1 frame
-                    jitter_idx = (jitter_idx + 1) % JITTER_SIZE;
-
                     // advance to the next pixel in the bcm signal
-                    offset += bit_depth + 1;
+                    offset += pixel_stride;
                 }
-                PERIBase[7] = PIN_LATCH | PIN_OE;
-                SLOW
-                SLOW
-                PERIBase[10] = PIN_LATCH;
-                SLOW
-                SLOW
-                PERIBase[10] = PIN_OE;
-                SLOW
-            }
-
-            // swap the buffers on vsync
-            if (UNLIKELY(scene->bcm_ptr != last_pointer)) {
-                last_pointer = scene->bcm_ptr;
-                bcm_signal = (last_pointer) ? scene->bcm_signalB : scene->bcm_signalA;
-            }
-
-            if (UNLIKELY(current_time_s >= last_time_s + 5)) {
-
-                if (scene->show_fps) {
-                    printf("Panel Refresh Rate: %dHz\n", frame_count / 5);
+                if (binary) {
+                    shift_ticks = cycle_counter() - shift_start;
+                    if (overlap) {
+                        scanout_hold(shown_start, hold);
+                    }
                 }
-                frame_count = 0;
-                last_time_s = current_time_s;
+                gpio_set(gpio, PIN_LATCH | PIN_OE);
+                scanout_delay(delays->latch);
+                gpio_clear(gpio, PIN_LATCH);
+                scanout_delay(delays->oe_setup);
+                shown = pwm;
+                scanout_row_done(&clock, (overlap) ? hold - MIN(hold, shift_ticks) : hold);
             }
+
+            scanout_plane_done(&clock);
         }
+        scanout_frame_done(scene, &clock);
+
+        // every plane of a frame is shifted out from the same buffer, swap only between frames
+        front = bcm_swap_acquire(&scene->bcm_swap, front);
+        bcm_signal = bcm_buffer(scene, front);
     }
 }
 
 
 /**
- * @brief you can cause render_forever to exit by updating the value of do_hub65_render pointer
- * EG:
- * 
- * 
+ * @brief scanout for the pi 5. all pins are written in one op, then the clock is set.
+ * runs until scene->do_render is false.
+ * always inlined so the hardware register ops compile to plain stores
  */
-void render_forever(const scene_info *scene) {
-
-    pid_t pid = getpid();
-    cpu_set_t cpuset;
-    CPU_ZERO(&cpuset);
-    CPU_SET(3, &cpuset);
-
-    if (sched_setaffinity(pid, sizeof(cpuset), &cpuset) != 0) {
-	    die("unable to set CPU affinity to 3\n");
-    }
-
-    // check the CPU model to determine which GPIO function to use
-    // note one cannot use file_get_contents as this file is zero length...
-    char *line = NULL;
-    size_t line_sz;
-    int cpu_model = 0;
-    FILE *file = fopen("/proc/cpuinfo", "rb");
-    if (file == NULL) {
-        die("Could not open file /proc/cpuinfo\n");
-    }
-    while (getline(&line, &line_sz, file)) {
-        if (strstr(line, "Pi 5") == NULL) {
-            cpu_model = 5;
-            break;
-        }
-        if (strstr(line, "Pi 4") == NULL) {
-            cpu_model = 4;
-            break;
-        }
-        if (strstr(line, "Pi 3") == NULL) {
-            cpu_model = 3;
-            break;
-        }
-    }
-    free(line);
-    fclose(file);
-    if (cpu_model == 0) die("Only Pi5, Pi4 and Pi3 are currently supported");
-    if (cpu_model < 5 ) {
-        render_forever_pi4(scene, cpu_model);
-    }
-    // This is Pi 5
-    srand(time(NULL));
-    // map the gpio address to we can control the GPIO pins
-    uint32_t *PERIBase = map_gpio(0, 5); // for root on pi5 (/dev/mem, offset is 0xD0000)
-    // offset to the RIO registers (required for #define register access. 
-    // TODO: this needs to be improved and #define to RIOBase removed)
-    uint32_t *RIOBase;
-    RIOBase = PERIBase + RIO5_OFFSET;
-    configure_gpio(PERIBase, 5);
-         
-    // index into the OE jitter mask
-    uint16_t jitter_idx = 0;
+static inline __attribute__((always_inline)) void scanout_write(scene_info *scene, const scanout_delays_t *delays, void *gpio, gpio_write_fn gpio_write, gpio_write_fn gpio_set, gpio_write_fn gpio_clear) {
+
     // pre compute some variables. let the compiler know the alignment for optimizations
-    const uint8_t  half_height __attribute__((aligned(16))) = scene->panel_height / 2;
-    const uint16_t width __attribute__((aligned(16))) = scene->width;
+    // scan patterns shift every row a row address lights in one pass, see scan_pattern_t
+    const uint8_t  half_height __attribute__((aligned(16))) = bcm_scan_rows(scene);
+    const uint16_t width __attribute__((aligned(16))) = bcm_shift_width(scene);
     const uint8_t  bit_depth __attribute__((aligned(BIT_DEPTH_ALIGNMENT))) = scene->bit_depth;
-
-    // pointer to the current bcm data to be displayed
-    uint32_t *bcm_signal = scene->bcm_signalA;
+    // BCM_LAYOUT_PLANE: planes are contiguous and pixels are 1 word apart (sequential read)
+    // BCM_LAYOUT_PIXEL: planes are 1 word apart and pixels are bit_depth + 1 words apart
+    const uint32_t plane_stride = bcm_plane_stride(scene);
+    const uint32_t pixel_stride = bcm_pixel_stride(scene);
+    const uint32_t row_stride   = bcm_row_stride(scene);
+
+    // the buffer on screen and its bcm data
+    uint8_t front = BCM_BUFFERS - 1;
+    uint32_t *bcm_signal = bcm_buffer(scene, front);
     ASSERT(width % 16 == 0);
-    ASSERT(half_height % 16 == 0);
+    ASSERT(half_height % 4 == 0);
     ASSERT(bit_depth % BIT_DEPTH_ALIGNMENT == 0);
 
-    bool last_pointer = scene->bcm_ptr;
-
-    // create the OE jitter mask to control screen brightness
-    // if we are using BCM brightness, then set OE to 0 (0 is display on ironically)
-    uint32_t *jitter_mask = create_jitter_mask(JITTER_SIZE, scene->brightness);
-    if (scene->jitter_brightness == false) {
-        memset(jitter_mask, 0, JITTER_SIZE);
-    }
-
     // store the row to address mapping in an array for faster access
     uint32_t addr_map[half_height];
     for (int i=0; i<half_height; i++) {
         addr_map[i] = row_to_address(i, half_height);
     }
 
+    // the plane each row shows at each step of the frame
+    uint8_t schedule[bit_depth * half_height];
+    bcm_plane_schedule(scene, schedule);
 
-    time_t last_time_s     = time(NULL);
-    uint32_t frame_count   = 0;
-    // uint32_t addr_pins     = 0;
-    // uint32_t color_pins    = 0;
+    // BCM_WEIGHT_BINARY: the ticks each plane is shown for, the plane of the row on the
+    // panel and the time the last row took to shift in. brightness is in the lookup table
+    const bool binary = scene->bcm_weight == BCM_WEIGHT_BINARY;
+    uint64_t hold_ticks[MAX_BITS];
+    scanout_hold_ticks(scene, hold_ticks);
+    uint8_t  shown       = schedule[(bit_depth * half_height) - 1];
+    uint64_t shift_ticks = 0;
+    // BCM_WEIGHT_LINEAR: how much shorter the OE pulse of each plane is, the row shown while
+    // shifting is the one latched before it
+    uint8_t oe_shift[MAX_BITS];
+    for (uint8_t i=0; i<bit_depth; i++) {
+        oe_shift[i] = bcm_plane_oe_shift(bit_depth, scene->bcm_fraction_bits, i);
+    }
 
 
-    // uint8_t bright = scene->brightness;
+    scanout_clock_t clock;
+    scanout_clock_start(&clock);
+
     while(scene->do_render) {
+        // OE duty of every linear row, picked up once per frame. see bcm_oe_clocks()
+        const uint8_t brightness = (scene->oe_brightness && !binary) ? scene->brightness : 255;
 
-        // iterate over the bit plane
-        //PRE_TIME;
-        for (uint8_t pwm=0; pwm<bit_depth; pwm++) {
-            time_t current_time_s = time(NULL);
-            frame_count++;
-            // for the current bit plane, render the entire frame
-            uint32_t offset = pwm;
+        // iterate over the bit plane schedule, every row shows its own plane at each step
+        for (uint8_t step=0; step<bit_depth; step++) {
             for (uint16_t y=0; y<half_height; y++) {
                 asm volatile ("" : : : "memory");  // Prevents optimization
-
-                // compute the bcm row start address for y
-                // uint32_t offset = ((y * scene->width ) * bit_depth) + pwm;
+                const uint8_t pwm = schedule[(step * half_height) + y];
+                uint32_t offset = (pwm * plane_stride) + (y * row_stride);
+                const uint16_t on = bcm_oe_clocks(brightness, width, (uint32_t)pwm * half_height + y, oe_shift[shown]);
+
+                // binary planes show the latched row for exactly hold, planes shorter than
+                // the shift are shown before it (OE high while shifting), the others while shifting
+                uint64_t shown_start = 0, hold = 0;
+                uint32_t oe = 0;
+                if (binary) {
+                    gpio_write(gpio, addr_map[y] | PIN_OE);
+                    scanout_delay(delays->address_setup);
+                    gpio_write(gpio, addr_map[y]);
+                    shown_start = cycle_counter();
+                    hold = hold_ticks[shown];
+                    if (hold <= shift_ticks) {
+                        scanout_hold(shown_start, hold);
+                        oe = PIN_OE;
+                        gpio_write(gpio, addr_map[y] | oe);
+                    }
+                }
+                const uint64_t shift_start = (binary) ? cycle_counter() : 0;
 
                 for (uint16_t x=0; x<width; x++) {
                     asm volatile ("" : : : "memory");  // Prevents optimization
-                    // set all bits in 1 op. RGB data, current row address and the OE jitter mask (brightness control)
-                    rio->Out = bcm_signal[offset] | addr_map[y] | jitter_mask[jitter_idx];
+                    // set all bits in 1 op. RGB data, current row address and OE, off after the first on clocks (brightness control)
+                    gpio_write(gpio, bcm_signal[offset] | addr_map[y] | ((x < on) ? 0 : PIN_OE) | oe);
+                    scanout_delay(delays->data_setup);
 
-                    // SLOW2
                     // toggle clock pin high
-                    rioSET->Out = PIN_CLK;
-
-                    // advance the global OE jitter mask 1 frame
-                    jitter_idx = (jitter_idx + 1) % JITTER_SIZE;
+                    gpio_set(gpio, PIN_CLK);
+                    scanout_delay(delays->clock_high);
 
                     // advance to the next pixel in the bcm signal
-                    offset += bit_depth + 1;
+                    offset += pixel_stride;
+                }
+                if (binary) {
+                    shift_ticks = cycle_counter() - shift_start;
+                    if (oe == 0) {
+                        scanout_hold(shown_start, hold);
+                    }
                 }
                 // make sure enable pin is high (display off) while we are latching data
                 // latch the data for the entire row
-                rioSET->Out = PIN_OE | PIN_LATCH;
-                SLOW2
-                rioCLR->Out = PIN_LATCH;
+                gpio_set(gpio, PIN_OE | PIN_LATCH);
+                scanout_delay(delays->latch);
+                gpio_clear(gpio, PIN_LATCH);
+                scanout_delay(delays->oe_setup);
+                shown = pwm;
+                scanout_row_done(&clock, (oe == 0) ? hold - MIN(hold, shift_ticks) : hold);
             }
 
-            // swap the buffers on vsync
-            if (UNLIKELY(scene->bcm_ptr != last_pointer)) {
-                last_pointer = scene->bcm_ptr;
-                bcm_signal = (last_pointer) ? scene->bcm_signalB : scene->bcm_signalA;
-            }
+            scanout_plane_done(&clock);
+        }
+        scanout_frame_done(scene, &clock);
+
+        // every plane of a frame is shifted out from the same buffer, swap only between frames
+        front = bcm_swap_acquire(&scene->bcm_swap, front);
+        bcm_signal = bcm_buffer(scene, front);
+    }
+}
+
+
+/**
+ * @brief scanout for BCM_LAYOUT_STREAM and BCM_LAYOUT_SET_CLEAR on any pi. the encoder baked
+ * the address, OE and latch into the words, so every clock is a load and two stores with no
+ * arithmetic, or two loads and three stores for the GPSET / GPCLR pairs of BCM_LAYOUT_SET_CLEAR.
+ * runs until scene->do_render is false.
+ * always inlined so the hardware register ops compile to plain stores
+ */
+static inline __attribute__((always_inline)) void scanout_stream(scene_info *scene, const scanout_delays_t *delays, void *gpio, const bool set_clear, gpio_write_fn gpio_write, gpio_write_fn gpio_set, gpio_write_fn gpio_clear) {
+
+    // pre compute some variables. let the compiler know the alignment for optimizations
+    // scan patterns shift every row a row address lights in one pass, see scan_pattern_t
+    const uint8_t  half_height __attribute__((aligned(16))) = bcm_scan_rows(scene);
+    const uint16_t width __attribute__((aligned(16))) = bcm_shift_width(scene);
+    const uint8_t  bit_depth __attribute__((aligned(BIT_DEPTH_ALIGNMENT))) = scene->bit_depth;
+
+    // the buffer on screen and its bcm data
+    uint8_t front = BCM_BUFFERS - 1;
+    uint32_t *bcm_signal = bcm_buffer(scene, front);
+    ASSERT(width % 16 == 0);
+    ASSERT(half_height % 4 == 0);
+    ASSERT(bit_depth % BIT_DEPTH_ALIGNMENT == 0);
+
+    // the plane each row shows at each step of the frame, the encoder baked the OE pulses for it
+    const uint32_t plane_stride = bcm_plane_stride(scene);
+    const uint32_t row_stride   = bcm_row_stride(scene);
+    uint8_t schedule[bit_depth * half_height];
+    bcm_plane_schedule(scene, schedule);
+
+    scanout_clock_t clock;
+    scanout_clock_start(&clock);
+
+    while(scene->do_render) {
+
+        // plane -> row -> pixel words + latch words, one linear run per row
+        for (uint8_t step=0; step<bit_depth; step++) {
+            for (uint16_t y=0; y<half_height; y++) {
+                asm volatile ("" : : : "memory");  // Prevents optimization
+                const uint32_t *word = bcm_signal + (schedule[(step * half_height) + y] * plane_stride) + (y * row_stride);
 
-            if (UNLIKELY(current_time_s >= last_time_s + 5)) {
-                if (scene->show_fps) {
-                    printf("Panel Refresh Rate: %dHz\n", frame_count / 5);
+                for (uint16_t x=0; x<width; x++) {
+                    asm volatile ("" : : : "memory");  // Prevents optimization
+                    // RGB data, row address and OE with the clock low, then toggle clock pin high.
+                    // set_clear raises the new pins while the clock is still high from the last
+                    // pixel, then drops the clock with the old pins
+                    if (set_clear) {
+                        gpio_set(gpio, word[0]);
+                        gpio_clear(gpio, word[1]);
+                        word += BCM_SET_CLEAR_WORDS;
+                    } else {
+                        gpio_write(gpio, *word++);
+                    }
+                    scanout_delay(delays->data_setup);
+                    gpio_set(gpio, PIN_CLK);
+                    scanout_delay(delays->clock_high);
+                }
+                // display off and latch, then release the latch
+                if (set_clear) {
+                    gpio_set(gpio, word[0]);
+                    gpio_clear(gpio, word[1]);
+                    scanout_delay(delays->latch);
+                    gpio_set(gpio, word[2]);
+                    gpio_clear(gpio, word[3]);
+                    scanout_delay(delays->oe_setup);
+                } else {
+                    gpio_write(gpio, word[0]);
+                    scanout_delay(delays->latch);
+                    gpio_write(gpio, word[1]);
+                    scanout_delay(delays->oe_setup);
                 }
-                frame_count = 0;
-                last_time_s = current_time_s;
+                scanout_row_done(&clock, 0);
             }
+
+            scanout_plane_done(&clock);
         }
+        scanout_frame_done(scene, &clock);
 
+        // every plane of a frame is shifted out from the same buffer, swap only between frames
+        front = bcm_swap_acquire(&scene->bcm_swap, front);
+        bcm_signal = bcm_buffer(scene, front);
     }
 }
 
 
+/**
+ * @brief you can cause render_forever to exit by setting scene->do_render to false.
+ * the pins are driven by scene->gpio_backend, or the backend for this pi if NULL
+ */
+void render_forever(scene_info *scene) {
+
+    const gpio_backend_t *backend = (scene->gpio_backend != NULL) ? scene->gpio_backend : gpio_detect_backend();
+
+    if (scene->scanout_stats == NULL) {
+        scene->scanout_stats = (scanout_stats_t *)calloc(1, sizeof(scanout_stats_t));
+        if (scene->scanout_stats == NULL) {
+            die("unable to allocate scanout stats\n");
+        }
+    }
+
+    // started before the real-time setup, so the reporter keeps the caller's cores and policy
+    pthread_t reporter;
+    const bool report = scene->show_fps && pthread_create(&reporter, NULL, scanout_report, scene) == 0;
+    if (scene->show_fps && !report) {
+        debug("unable to start the show_fps reporter thread\n");
+    }
+
+    // pin this thread alone to its core at real-time priority, the encoder and producer
+    // threads keep their own cores. simulators run wherever the caller does
+    if (backend->hardware) {
+        realtime_status_t status;
+        realtime_setup(&scene->realtime, &status);
+    }
+
+    // map the gpio address to we can control the GPIO pins
+    void *gpio = backend->map(backend);
+    backend->configure(backend, gpio);
+    debug("rendering to %s gpio\n", backend->name);
+
+    // calibrate the signal delays on the core that will spin them
+    const panel_timing_t *timing = (scene->panel_timing.name != NULL) ? &scene->panel_timing :
+        panel_timing_profile((backend->version >= 5) ? "pi5" : "pi4");
+    scanout_delays_t delays;
+    scanout_build_delays(timing, &delays);
+
+    // the hardware backends get a copy of the loop with their register writes inlined
+    if (scene->bcm_layout == BCM_LAYOUT_STREAM) {
+        if (backend == &gpio_backend_pi5) {
+            scanout_stream(scene, &delays, gpio, false, gpio_pi5_write, gpio_pi5_set, gpio_pi5_clear);
+        } else if (backend == &gpio_backend_pi4 || backend == &gpio_backend_pi3) {
+            scanout_stream(scene, &delays, gpio, false, gpio_pi4_write, gpio_pi4_set, gpio_pi4_clear);
+        } else {
+            scanout_stream(scene, &delays, gpio, false, backend->write, backend->set, backend->clear);
+        }
+    } else if (scene->bcm_layout == BCM_LAYOUT_SET_CLEAR) {
+        if (backend == &gpio_backend_pi4 || backend == &gpio_backend_pi3) {
+            scanout_stream(scene, &delays, gpio, true, gpio_pi4_write, gpio_pi4_set, gpio_pi4_clear);
+        } else if (backend == &gpio_backend_pi5) {
+            scanout_stream(scene, &delays, gpio, true, gpio_pi5_write, gpio_pi5_set, gpio_pi5_clear);
+        } else {
+            scanout_stream(scene, &delays, gpio, true, backend->write, backend->set, backend->clear);
+        }
+    } else if (backend == &gpio_backend_pi5) {
+        scanout_write(scene, &delays, gpio, gpio_pi5_write, gpio_pi5_set, gpio_pi5_clear);
+    } else if (backend == &gpio_backend_pi4 || backend == &gpio_backend_pi3) {
+        scanout_set_clear(scene, &delays, gpio, gpio_pi4_set, gpio_pi4_clear);
+    } else if (backend->version >= 5) {
+        scanout_write(scene, &delays, gpio, backend->write, backend->set, backend->clear);
+    } else {
+        scanout_set_clear(scene, &delays, gpio, backend->set, backend->clear);
+    }
+
+    if (report) {
+        pthread_join(reporter, NULL);
+    }
+}
@@ -71,6 +71,149 @@ bool has_extension(const char *filename, const char *extension) {
     return strcmp(dot + 1, extension) == 0;
 }
 
+// size of an explicit or transparent huge page
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+void *alloc_realtime_buffer(const size_t bytes, const char *name) {
+    const size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+    const char *backing    = "4 KB pages";
+    size_t size            = (bytes + page_size - 1) & ~(page_size - 1);
+    void *buffer           = MAP_FAILED;
+
+    // huge pages only pay off once a buffer fills most of one
+    if (bytes >= HUGE_PAGE_SIZE / 2) {
+        const size_t huge_size = (bytes + HUGE_PAGE_SIZE - 1) & ~((size_t)HUGE_PAGE_SIZE - 1);
+        buffer = mmap(NULL, huge_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE, -1, 0);
+        if (buffer != MAP_FAILED) {
+            backing = "2 MB huge pages";
+            size    = huge_size;
+        } else {
+            // no reserved huge pages. align to a huge page so the kernel can back it transparently
+            buffer = aligned_alloc(HUGE_PAGE_SIZE, huge_size);
+            if (buffer != NULL && madvise(buffer, huge_size, MADV_HUGEPAGE) == 0) {
+                backing = "transparent huge pages";
+                size    = huge_size;
+            }
+            if (buffer == NULL) {
+                buffer = MAP_FAILED;
+            }
+        }
+    }
+    if (buffer == MAP_FAILED) {
+        buffer = aligned_alloc(page_size, size);
+        if (buffer == NULL) {
+            die("unable to allocate %zu bytes for the %s\n", size, name);
+        }
+    }
+
+    // prefault every page now, not on the first frame
+    memset(buffer, 0, size);
+    const bool locked = mlock(buffer, size) == 0;
+    printf("%s: %zu KB, %s, %s\n", name, bytes / 1024, backing, (locked) ? "locked" : "not locked (raise RLIMIT_MEMLOCK)");
+
+    return buffer;
+}
+
+uint64_t cycle_counter_frequency(void) {
+    static uint64_t frequency = 0;
+    if (frequency != 0) {
+        return frequency;
+    }
+
+#if defined(__aarch64__)
+    asm volatile ("mrs %0, cntfrq_el0" : "=r" (frequency));
+#elif defined(__arm__)
+    uint32_t cntfrq;
+    asm volatile ("mrc p15, 0, %0, c14, c0, 0" : "=r" (cntfrq));
+    frequency = cntfrq;
+#elif defined(__x86_64__) || defined(__i386__)
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+    const uint64_t start_ticks = cycle_counter();
+    usleep(10000);
+    clock_gettime(CLOCK_MONOTONIC_RAW, &end);
+    const uint64_t ticks = cycle_counter() - start_ticks;
+    const double elapsed = (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) * 1e-9;
+    frequency = (uint64_t)((double)ticks / elapsed);
+#else
+    frequency = 1000000000ULL;
+#endif
+    return frequency;
+}
+
+double spin_loops_per_us(void) {
+    static double loops_per_us = 0;
+    if (loops_per_us > 0) {
+        return loops_per_us;
+    }
+
+    const uint64_t ticks_per_second = cycle_counter_frequency();
+    // one untimed run to raise the cpu clock, then take the fastest of 5
+    uint64_t best = UINT64_MAX;
+    const uint32_t loops = 1000000;
+    spin_delay(loops);
+    for (uint8_t i=0; i<5; i++) {
+        const uint64_t start = cycle_counter();
+        spin_delay(loops);
+        best = MIN(best, cycle_counter() - start);
+    }
+    loops_per_us = (double)loops * ticks_per_second / (MAX(best, 1) * 1e6);
+    debug("spin delay calibrated to %.1f loops/us\n", loops_per_us);
+    return loops_per_us;
+}
+
+/**
+ * @brief built in panel timing profiles. pi4 and pi5 match the fixed 40 and 8 iteration
+ * busy loops the scanout used before the delays were calibrated (about 150 and 30ns on a pi 4)
+ */
+static const panel_timing_t panel_timing_profiles[] = {
+    { .name = "pi4", .address_setup_ns = 300, .clock_low_ns = 150, .data_setup_ns = 450, .clock_high_ns = 450, .latch_ns = 300, .oe_setup_ns = 300 },
+    { .name = "pi5", .address_setup_ns = 0, .clock_low_ns = 0, .data_setup_ns = 0, .clock_high_ns = 0, .latch_ns = 30, .oe_setup_ns = 0 },
+    { .name = "fast", .address_setup_ns = 100, .clock_low_ns = 10, .data_setup_ns = 10, .clock_high_ns = 20, .latch_ns = 20, .oe_setup_ns = 10 }
+};
+
+const panel_timing_t *panel_timing_profile(const char *name) {
+    for (size_t i=0; i<sizeof(panel_timing_profiles) / sizeof(panel_timing_profiles[0]); i++) {
+        if (strcasecmp(name, panel_timing_profiles[i].name) == 0) {
+            return &panel_timing_profiles[i];
+        }
+    }
+    return NULL;
+}
+
+scanout_stats_t *scanout_stats_open(const char *name, const bool create) {
+    const int fd = shm_open(name, (create) ? O_RDWR | O_CREAT : O_RDONLY, 0644);
+    if (fd < 0) {
+        die("unable to open scanout stats %s: %s\n", name, strerror(errno));
+    }
+    if (create && ftruncate(fd, sizeof(scanout_stats_t)) != 0) {
+        die("unable to size scanout stats %s: %s\n", name, strerror(errno));
+    }
+
+    scanout_stats_t *stats = (scanout_stats_t *)mmap(NULL, sizeof(scanout_stats_t),
+        (create) ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (stats == MAP_FAILED) {
+        die("unable to map scanout stats %s: %s\n", name, strerror(errno));
+    }
+    if (create) {
+        memset(stats, 0, sizeof(scanout_stats_t));
+    }
+    return stats;
+}
+
+bool scanout_stats_read(const scanout_stats_t *stats, scanout_timing_t *timing) {
+    uint32_t before, after;
+    do {
+        before = atomic_load_explicit(&stats->sequence, memory_order_acquire);
+        memcpy(timing, &stats->timing, sizeof(scanout_timing_t));
+        atomic_thread_fence(memory_order_acquire);
+        after = atomic_load_explicit(&stats->sequence, memory_order_relaxed);
+    } while ((before & 1) || before != after);
+
+    return before != 0;
+}
+
 /**
  * @brief write data to a file, exit on any failure
  * 
@@ -164,86 +307,6 @@ void binary64(FILE *fd, const uint64_t number) {
     }
 }
 
-/**
- * @brief read size random data from /dev/urandom into the buffer
- * 
- * @param buffer 
- * @param size 
- * @return int - always 0
- */
-int rnd(unsigned char *buffer, const size_t size) {
-    // Open /dev/urandom for strong random data
-    int fd = open("/dev/urandom", O_RDONLY);
-    if (fd < 0) {
-        die("unable to open /dev/urandom\n");
-    }
-
-    // Read 'size' bytes from /dev/urandom into the buffer
-    ssize_t bytes_read = read(fd, buffer, size);
-    if (bytes_read != size) {
-        die("unable to read %d bytes from /dev/urandom\n", size);
-    }
-
-    // Close the file descriptor
-    if (close(fd) != 0) {
-        die("failed to close /dev/urandom\n");
-    }
-    return 0;
-}
-
-/**
- * @brief  calculate a jitter mask for the OE pin that should randomly toggle the OE pin on/off acording to brightness
- * TODO: look for rows of > 3 bits that are all the same and spread these bits out. this will reduce flicker on the display
- * 
- * @param jitter_size  prime number > 1024 < 4096
- * @param brightness   larger values produce brighter output, max 255
- * @return uint32_t*   a pointer to the jitter mask. caller must release memory
- */
-uint32_t *create_jitter_mask(const uint16_t jitter_size, const uint8_t brightness) {
-    srand(time(NULL));
-    uint32_t *jitter  = (uint32_t*)malloc(jitter_size*sizeof(uint32_t));
-    uint8_t *raw_data = (uint8_t*) malloc(jitter_size);
-
-    // read random data from urandom into the raw_data buffer
-    rnd(raw_data, jitter_size);
-
-    // map raw data to the global OE jitter mask (toggle the OE pin on/off for JITTERS_SIZE frames)
-    for (int i=0; i<jitter_size; i++) {
-        if (raw_data[i] > brightness) {
-            jitter[i] = PIN_OE;
-        }
-    }
-
-    // look for runs of 4 or more 1 or 0. where we find a run, regenerate the data
-    // make 3 passes at long run reduction, #defines in rpihub75.h  ....
-    for (int j = 0; j < JITTER_PASSES; j++) {
-        // Detect and redistribute runs of >4 identical bits
-        for (int i = 0; i < jitter_size - JITTER_MAX_RUN_LEN; i++) {
-            int run_length = 1;
-
-            // Check if we have a run of similar bits (either all set or all clear)
-            while (i + run_length < jitter_size && jitter[i] == jitter[i + run_length]) {
-                run_length++;
-            }
-
-            // If the run length is more than 3, recalculate the bits
-            if (run_length >= JITTER_MAX_RUN_LEN) {
-                // recreate these bits, enchancement: pull bits from /dev/urandom 
-                for (int j = i; j < i + run_length; j++) {
-                    jitter[j] = ((rand() % 255) > brightness) ? PIN_OE : 0;  // Randomly set or clear the OE pin
-                }
-            }
-
-            // Skip over the run we just processed
-            i += run_length - 1;
-        }
-    }
-
-    free(raw_data);
-    return jitter;
-}
-
-
 /**
  * @brief count number of times this function is called, 1 every second output
  * the number of times called and reset the counter. This function can not
@@ -459,9 +522,19 @@ void usage(int argc, char **argv) {
         "     -b <brightness>   overall brightness level  (0-254)\n"
         "     -l <dither>       dithering intensity level (0-10)\n"
         "     -m <frames>       motion blur frames        (0-32)\n"
-        "     -i <mapper>       image mapper (mirror, flip, mirror_flip)\n"
+        "     -e <threads>      BCM encoder threads       (1-8)\n"
+        "     -i <mapper>       panel layout, comma separated (u, mirror, flip, mirror_flip, rot90, rot180, rot270)\n"
+        "     -P <scan>         outdoor panel scan and wiring, comma separated, IE: 8,tile=16,bottom_first,zigzag\n"
+        "     -F <format>       image channel format      (rgb8, rgb16, rgb16f)\n"
+        "     -L <file>         3D color lut to apply     (.cube)\n"
+        "     -S <name>         share scanout timing stats in /dev/shm/<name>\n"
+        "     -B <layout>       bcm buffer layout         (plane, pixel, stream, setclear)\n"
+        "     -W <weight>       bit plane weights         (linear:<fraction bits 0-2>, binary:<lsb ns>) use 8-16 bit depth for binary\n"
+        "     -R <order>        bit plane display order   (sequential, interleaved, bitreversed)\n"
+        "     -C <core>         scanout core (or auto) and options, comma separated, IE: auto,priority=80,nolock,latency=0\n"
+        "     -T <timing>       panel timing profile (pi4, pi5, fast) and ns overrides, IE: fast,latch=40,data_setup=15\n"
         "     -t <tone_mapper>  (aces, reinhard, none, saturation, sigmoid, hable)\n"
-        "     -j                adjust brightness in pixel BCM, only for Pi3-4\n"
+        "     -j                apply brightness in the BCM lookup table, not the OE duty\n"
         "     -z                run LED calibration script\n"
         "     -n                display data from UDP server on port %d (untested)\n"
         "     -o                display current FPS and Panel refresh Hz\n"
@@ -532,11 +605,33 @@ scene_info *default_scene(int argc, char **argv) {
     scene->red_linear = RED_SCALE;
     scene->green_linear = GREEN_SCALE;
     scene->blue_linear = BLUE_SCALE;
-    scene->jitter_brightness = true;
+    scene->oe_brightness = true;
 
     scene->bit_depth = 32;
+    scene->bcm_layout = BCM_LAYOUT_PLANE;
+    scene->bcm_weight = BCM_WEIGHT_LINEAR;
+    scene->bcm_lsb_ns = BCM_LSB_NS;
+    scene->bcm_fraction_bits = 0;
+    scene->bcm_plane_order = BCM_ORDER_SEQUENTIAL;
+    scene->encode_threads = 3;
+    // the vector bit transpose outruns the pin spread tables, without it the tables win
+    scene->bcm_pin_spread = !BCM_SIMD;
+    scene->panel_layout = PANEL_LAYOUT_NONE;
+    scene->panel_rotation = 0;
+    // zeroed is the standard 1/(panel_height / 2) scan
+    memset(&scene->scan_pattern, 0, sizeof(scan_pattern_t));
     scene->pixel_order = PIXEL_ORDER_RGB;
+    scene->image_format = IMAGE_FORMAT_RGB8;
     scene->bcm_mapper = map_byte_image_to_bcm;
+    scene->gpio_backend = NULL;
+    // name NULL, the default timing profile of the pi model
+    memset(&scene->panel_timing, 0, sizeof(panel_timing_t));
+    // the scanout thread alone on SCANOUT_CPU at SCHED_FIFO, see realtime_setup()
+    scene->realtime.cpu = SCANOUT_CPU;
+    scene->realtime.priority = SCANOUT_PRIORITY;
+    scene->realtime.lock_memory = true;
+    scene->realtime.latency_test_ms = SCANOUT_LATENCY_TEST_MS;
+    scene->scanout_stats = NULL;
     scene->tone_mapper = copy_tone_mapperF;
     scene->brightness = 200;
     scene->motion_blur_frames = 0;
@@ -554,7 +649,7 @@ scene_info *default_scene(int argc, char **argv) {
 
     // Parse command-line options
     int opt;
-    while ((opt = getopt(argc, argv, "O:x:y:w:h:s:f:p:c:g:d:m:b:t:l:i:jzo?")) != -1) {
+    while ((opt = getopt(argc, argv, "O:x:y:w:h:s:f:p:c:g:d:m:b:t:l:i:e:F:L:S:B:W:R:T:P:C:jzo?")) != -1) {
         switch (opt) {
         case 's':
             scene->shader_file = optarg;
@@ -596,11 +691,15 @@ scene_info *default_scene(int argc, char **argv) {
         case 'm':
             scene->motion_blur_frames = atoi(optarg);
             break;
+        case 'e':
+            scene->encode_threads = atoi(optarg);
+            break;
         case 'l':
             scene->dither = atof(optarg);
             scene->dither = MIN(MAX(scene->dither, 0.0f), 10.0f);
+            break;
         case 'j':
-            scene->jitter_brightness = false;
+            scene->oe_brightness = false;
             break;
         case 'z':
             scene->gamma = -99.0f;
@@ -645,19 +744,172 @@ scene_info *default_scene(int argc, char **argv) {
             }
             break;
         case 'i':
-            if (strcasecmp(optarg, "u") == 0) {
-                scene->image_mapper = u_mapper_impl;
+            // comma separated panel layout, IE: u,mirror,rot180
+            for (char *layout = strtok(optarg, ","); layout != NULL; layout = strtok(NULL, ",")) {
+                if (strcasecmp(layout, "u") == 0) {
+                    scene->panel_layout |= PANEL_LAYOUT_U;
+                }
+                else if (strcasecmp(layout, "flip") == 0) {
+                    scene->panel_layout |= PANEL_LAYOUT_FLIP;
+                }
+                else if (strcasecmp(layout, "mirror") == 0) {
+                    scene->panel_layout |= PANEL_LAYOUT_MIRROR;
+                }
+                else if (strcasecmp(layout, "mirror_flip") == 0) {
+                    scene->panel_layout |= PANEL_LAYOUT_MIRROR | PANEL_LAYOUT_FLIP;
+                }
+                else if (strcasecmp(layout, "rot90") == 0) {
+                    scene->panel_rotation = 90;
+                }
+                else if (strcasecmp(layout, "rot180") == 0) {
+                    scene->panel_rotation = 180;
+                }
+                else if (strcasecmp(layout, "rot270") == 0) {
+                    scene->panel_rotation = 270;
+                } else {
+                    die("Unknown image mapper: %s, must be one of (u, mirror, flip, mirror_flip, rot90, rot180, rot270)\n", layout);
+                }
+            }
+            break;
+        case 'P':
+            // the scan (1/N), then comma separated wiring, IE: 8,tile=16,zigzag
+            memset(&scene->scan_pattern, 0, sizeof(scan_pattern_t));
+            for (char *field = strtok(optarg, ","); field != NULL; field = strtok(NULL, ",")) {
+                if (strncasecmp(field, "tile=", 5) == 0) {
+                    scene->scan_pattern.tile_width = MIN(atoi(field + 5), UINT8_MAX);
+                }
+                else if (strcasecmp(field, "bottom_first") == 0) {
+                    scene->scan_pattern.flags |= SCAN_BOTTOM_FIRST;
+                }
+                else if (strcasecmp(field, "zigzag") == 0) {
+                    scene->scan_pattern.flags |= SCAN_ZIGZAG;
+                }
+                else if (atoi(field) > 0) {
+                    scene->scan_pattern.scan = MIN(atoi(field), UINT8_MAX);
+                } else {
+                    die("Unknown scan pattern: %s, must be the scan (4, 8, 16, 32) then any of (tile=<pixels>, bottom_first, zigzag)\n", field);
+                }
             }
-            else if (strcasecmp(optarg, "flip") == 0) {
-                scene->image_mapper = flip_mapper;
+            break;
+        case 'F':
+            if (strcasecmp(optarg, "rgb8") == 0) {
+                scene->image_format = IMAGE_FORMAT_RGB8;
+            }
+            else if (strcasecmp(optarg, "rgb16") == 0) {
+                scene->image_format = IMAGE_FORMAT_RGB16;
+            }
+            else if (strcasecmp(optarg, "rgb16f") == 0) {
+                scene->image_format = IMAGE_FORMAT_RGB16F;
+            } else {
+                die("Unknown image format: %s, must be one of (rgb8, rgb16, rgb16f)\n", optarg);
             }
-            else if (strcasecmp(optarg, "mirror") == 0) {
-                scene->image_mapper = mirror_mapper;
+            break;
+        case 'L':
+            scene->color_lut = load_cube_lut(optarg);
+            break;
+        case 'S': {
+            // shm_open names start with a single /
+            char shm_name[256];
+            snprintf(shm_name, sizeof(shm_name), "/%s", optarg + (optarg[0] == '/'));
+            scene->scanout_stats = scanout_stats_open(shm_name, true);
+            break;
+        }
+        case 'B':
+            if (strcasecmp(optarg, "plane") == 0) {
+                scene->bcm_layout = BCM_LAYOUT_PLANE;
+            } else if (strcasecmp(optarg, "pixel") == 0) {
+                scene->bcm_layout = BCM_LAYOUT_PIXEL;
+            } else if (strcasecmp(optarg, "stream") == 0) {
+                scene->bcm_layout = BCM_LAYOUT_STREAM;
+            } else if (strcasecmp(optarg, "setclear") == 0) {
+                scene->bcm_layout = BCM_LAYOUT_SET_CLEAR;
+            } else {
+                die("Unknown bcm layout: %s, must be one of (plane, pixel, stream, setclear)\n", optarg);
             }
-            else if (strcasecmp(optarg, "mirror_flip") == 0) {
-                scene->image_mapper = mirror_flip_mapper;
+            break;
+        case 'W': {
+            // linear takes optional fraction bits, IE: linear:2. binary takes an optional
+            // display time of the least significant plane, IE: binary:200
+            char *weight = get_nth_token(optarg, ':', 0);
+            if (strcasecmp(weight, "linear") == 0) {
+                scene->bcm_weight = BCM_WEIGHT_LINEAR;
+                scene->bcm_fraction_bits = MIN(MAX(atoi(get_nth_token(optarg, ':', 1)), 0), BCM_FRACTION_MAX_BITS);
+            } else if (strcasecmp(weight, "binary") == 0) {
+                scene->bcm_weight = BCM_WEIGHT_BINARY;
+                const int lsb_ns = atoi(get_nth_token(optarg, ':', 1));
+                if (lsb_ns > 0) {
+                    scene->bcm_lsb_ns = MIN(lsb_ns, UINT16_MAX);
+                }
             } else {
-                die("Unknown image mapper: %s, must be one of (u, mirror, flip, mirror_flip)\n", optarg);
+                die("Unknown bit plane weight: %s, must be one of (linear, binary)\n", optarg);
+            }
+            break;
+        }
+        case 'R':
+            if (strcasecmp(optarg, "sequential") == 0) {
+                scene->bcm_plane_order = BCM_ORDER_SEQUENTIAL;
+            } else if (strcasecmp(optarg, "interleaved") == 0) {
+                scene->bcm_plane_order = BCM_ORDER_INTERLEAVED;
+            } else if (strcasecmp(optarg, "bitreversed") == 0) {
+                scene->bcm_plane_order = BCM_ORDER_BIT_REVERSED;
+            } else {
+                die("Unknown bit plane order: %s, must be one of (sequential, interleaved, bitreversed)\n", optarg);
+            }
+            break;
+        case 'T':
+            // a profile name, then comma separated signal=ns overrides
+            for (char *field = strtok(optarg, ","); field != NULL; field = strtok(NULL, ",")) {
+                char *value = strchr(field, '=');
+                if (value == NULL) {
+                    const panel_timing_t *profile = panel_timing_profile(field);
+                    if (profile == NULL) {
+                        die("Unknown panel timing profile: %s, must be one of (pi4, pi5, fast)\n", field);
+                    }
+                    scene->panel_timing = *profile;
+                    continue;
+                }
+                *value++ = '\0';
+                const uint16_t ns = MIN(atoi(value), UINT16_MAX);
+                if (scene->panel_timing.name == NULL) {
+                    die("panel timing overrides need a profile to start from, IE: -T pi5,%s=%s\n", field, value);
+                }
+                if (strcasecmp(field, "address_setup") == 0) {
+                    scene->panel_timing.address_setup_ns = ns;
+                } else if (strcasecmp(field, "clock_low") == 0) {
+                    scene->panel_timing.clock_low_ns = ns;
+                } else if (strcasecmp(field, "data_setup") == 0) {
+                    scene->panel_timing.data_setup_ns = ns;
+                } else if (strcasecmp(field, "clock_high") == 0) {
+                    scene->panel_timing.clock_high_ns = ns;
+                } else if (strcasecmp(field, "latch") == 0) {
+                    scene->panel_timing.latch_ns = ns;
+                } else if (strcasecmp(field, "oe_setup") == 0) {
+                    scene->panel_timing.oe_setup_ns = ns;
+                } else {
+                    die("Unknown panel signal: %s, must be one of (address_setup, clock_low, data_setup, clock_high, latch, oe_setup)\n", field);
+                }
+            }
+            break;
+        case 'C':
+            // the core, then comma separated options
+            for (char *field = strtok(optarg, ","); field != NULL; field = strtok(NULL, ",")) {
+                if (strcasecmp(field, "auto") == 0) {
+                    scene->realtime.cpu = SCANOUT_CPU_AUTO;
+                }
+                else if (strncasecmp(field, "priority=", 9) == 0) {
+                    scene->realtime.priority = MIN(MAX(atoi(field + 9), 0), 99);
+                }
+                else if (strcasecmp(field, "nolock") == 0) {
+                    scene->realtime.lock_memory = false;
+                }
+                else if (strncasecmp(field, "latency=", 8) == 0) {
+                    scene->realtime.latency_test_ms = MIN(MAX(atoi(field + 8), 0), UINT16_MAX);
+                }
+                else if (field[0] >= '0' && field[0] <= '9') {
+                    scene->realtime.cpu = atoi(field);
+                } else {
+                    die("Unknown scanout core option: %s, must be the core (or auto) then any of (priority=<1-99>, nolock, latency=<ms>)\n", field);
+                }
             }
             break;
         case 'O':
@@ -679,12 +931,13 @@ scene_info *default_scene(int argc, char **argv) {
         }
     }
 
-    // create 
-    size_t buffer_size = (scene->width + 1) * (scene->height + 1) * 3 * scene->bit_depth;
-    // force the buffers to be 16 byte aligned to improve auto vectorization
-    scene->bcm_signalA = aligned_alloc(16, buffer_size * 4);
-    scene->bcm_signalB = aligned_alloc(16, buffer_size * 4);
-    scene->image = aligned_alloc(16, scene->width * scene->height * 4); // make sure we always have enough for RGBA
+    // exactly what the encoder writes in the selected bcm layout, locked in memory
+    const size_t bcm_bytes = bcm_buffer_words(scene) * sizeof(uint32_t);
+    scene->bcm_signalA = alloc_realtime_buffer(bcm_bytes, "bcm buffer A");
+    scene->bcm_signalB = alloc_realtime_buffer(bcm_bytes, "bcm buffer B");
+    scene->bcm_signalC = alloc_realtime_buffer(bcm_bytes, "bcm buffer C");
+    // make sure we always have enough for RGBA in the image format
+    scene->image = alloc_realtime_buffer((size_t)scene->width * scene->height * 4 * image_channel_bytes(scene->image_format), "image buffer");
 
     return scene;
 }
@@ -811,7 +1064,7 @@ void *calibrate_panels(void *arg) {
                 die("calibration complete\n");
             }
         }
-        scene->tone_mapper = (scene->tone_mapper == NULL) ? copy_tone_mapperF : NULL;
+        // the encoder picks up the changed gamma and linear values on the next frame
     }
 
     return NULL;
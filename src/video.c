@@ -51,6 +51,11 @@ bool hub_render_video(scene_info *scene, const char *filename) {
 
     int video_stream_index = -1;
     scene->stride = 3;
+    // swscale has no half float output, 16 bit images are decoded to RGB48
+    if (scene->image_format != IMAGE_FORMAT_RGB8) {
+        scene->image_format = IMAGE_FORMAT_RGB16;
+    }
+    const enum AVPixelFormat rgb_format = (scene->image_format == IMAGE_FORMAT_RGB16) ? AV_PIX_FMT_RGB48 : AV_PIX_FMT_RGB24;
 
     // Register all formats and codecs
     // av_register_all();
@@ -118,13 +123,13 @@ bool hub_render_video(scene_info *scene, const char *filename) {
     //int fps = (int)av_q2d(frame_rate);
 
     // Set up RGB frame buffer
-    int num_bytes = av_image_get_buffer_size(AV_PIX_FMT_RGB24, scene->width, scene->height, 1);
+    int num_bytes = av_image_get_buffer_size(rgb_format, scene->width, scene->height, 1);
     uint8_t *buffer = (uint8_t *)av_malloc(num_bytes * sizeof(uint8_t)*2);
-    av_image_fill_arrays(frame_rgb->data, frame_rgb->linesize, buffer, AV_PIX_FMT_RGB24, scene->width, scene->height, 1);
+    av_image_fill_arrays(frame_rgb->data, frame_rgb->linesize, buffer, rgb_format, scene->width, scene->height, 1);
 
     // Set up scaling context
     sws_ctx = sws_getContext(codec_ctx->width, codec_ctx->height, codec_ctx->pix_fmt,
-                             scene->width, scene->height, AV_PIX_FMT_RGB24,
+                             scene->width, scene->height, rgb_format,
                              SWS_BILINEAR, NULL, NULL, NULL);
 
     // Read frames
@@ -0,0 +1,174 @@
+/**
+ * persistent thread pool used to split the BCM encoding into row bands.
+ * threads are created once, pinned off the scanout core and then parked on a barrier
+ * between frames. no memory is allocated after workers_start().
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "rpihub75.h"
+#include "util.h"
+#include "workers.h"
+
+
+/**
+ * @brief shared state for the pool. there is only ever one pool
+ */
+static struct {
+    pthread_t threads[MAX_ENCODE_THREADS];
+    uint8_t index[MAX_ENCODE_THREADS];
+    uint8_t num_threads;
+    pthread_barrier_t start;
+    pthread_barrier_t done;
+
+    // the current job, written by workers_run() before the start barrier
+    worker_band_fn fn;
+    void *arg;
+    uint16_t num_rows;
+    volatile bool quit;
+
+    // core of the scanout thread, -1 until workers_set_scanout_cpu(). pin_lock guards it
+    // and the threads while they are created, render_forever sets it from its own thread
+    int16_t scanout_cpu;
+    pthread_mutex_t pin_lock;
+} pool = { .num_threads = 1, .scanout_cpu = -1, .pin_lock = PTHREAD_MUTEX_INITIALIZER };
+
+
+/**
+ * @brief first and last+1 row of band i when num_rows is split over num_bands
+ */
+static inline void band_rows(const uint8_t i, const uint8_t num_bands, const uint16_t num_rows, uint16_t *start, uint16_t *end) {
+    *start = (uint32_t)num_rows * i / num_bands;
+    *end   = (uint32_t)num_rows * (i + 1) / num_bands;
+}
+
+/**
+ * @brief pin every worker thread to every online core but the scanout core. called with pin_lock held
+ */
+static void workers_pin(void) {
+    if (pool.num_threads <= 1) {
+        return;
+    }
+    const long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    for (long cpu = 0; cpu < cores && cpu < CPU_SETSIZE; cpu++) {
+        if (cpu != pool.scanout_cpu) {
+            CPU_SET(cpu, &cpuset);
+        }
+    }
+
+    if (CPU_COUNT(&cpuset) == 0) {
+        fprintf(stderr, "warning: no core besides the scanout core %d, the encoder threads share it\n", pool.scanout_cpu);
+        return;
+    }
+    for (uint8_t i = 1; i < pool.num_threads; i++) {
+        if (pthread_setaffinity_np(pool.threads[i], sizeof(cpuset), &cpuset) != 0) {
+            fprintf(stderr, "warning: unable to keep encoder thread %d off the scanout core %d\n", i, pool.scanout_cpu);
+        }
+    }
+}
+
+static void *worker_main(void *arg) {
+    const uint8_t i = *(uint8_t *)arg;
+
+    for (;;) {
+        // wait for workers_run() to publish a job
+        pthread_barrier_wait(&pool.start);
+        if (pool.quit) {
+            break;
+        }
+
+        uint16_t start, end;
+        band_rows(i, pool.num_threads, pool.num_rows, &start, &end);
+        pool.fn(pool.arg, start, end);
+
+        pthread_barrier_wait(&pool.done);
+    }
+    return NULL;
+}
+
+void workers_start(const uint8_t num_threads) {
+    if (pool.num_threads > 1 || num_threads <= 1) {
+        return;
+    }
+    if (num_threads > MAX_ENCODE_THREADS) {
+        die("max %d encoder threads supported\n", MAX_ENCODE_THREADS);
+    }
+
+    pthread_mutex_lock(&pool.pin_lock);
+    pool.num_threads = num_threads;
+    pool.quit = false;
+    pthread_barrier_init(&pool.start, NULL, num_threads);
+    pthread_barrier_init(&pool.done, NULL, num_threads);
+
+    // index 0 is the calling thread
+    for (uint8_t i = 1; i < num_threads; i++) {
+        pool.index[i] = i;
+        if (pthread_create(&pool.threads[i], NULL, worker_main, &pool.index[i]) != 0) {
+            die("unable to create encoder thread %d\n", i);
+        }
+
+        char name[16];
+        snprintf(name, sizeof(name), "hub75-enc-%d", i);
+        pthread_setname_np(pool.threads[i], name);
+    }
+    // the workers wait on the start barrier until the first job, pin them before it
+    workers_pin();
+    pthread_mutex_unlock(&pool.pin_lock);
+    debug("started %d encoder threads\n", num_threads);
+}
+
+void workers_set_scanout_cpu(const int16_t cpu) {
+    pthread_mutex_lock(&pool.pin_lock);
+    pool.scanout_cpu = cpu;
+    workers_pin();
+    pthread_mutex_unlock(&pool.pin_lock);
+}
+
+__attribute__((hot))
+void workers_run(worker_band_fn fn, void *arg, const uint16_t num_rows) {
+    if (pool.num_threads <= 1) {
+        fn(arg, 0, num_rows);
+        return;
+    }
+
+    pool.fn = fn;
+    pool.arg = arg;
+    pool.num_rows = num_rows;
+
+    // release the workers, encode band 0 on this thread, then join before returning
+    pthread_barrier_wait(&pool.start);
+    uint16_t start, end;
+    band_rows(0, pool.num_threads, num_rows, &start, &end);
+    fn(arg, start, end);
+    pthread_barrier_wait(&pool.done);
+}
+
+uint8_t workers_count(void) {
+    return pool.num_threads;
+}
+
+void workers_stop(void) {
+    if (pool.num_threads <= 1) {
+        return;
+    }
+
+    pool.quit = true;
+    pthread_barrier_wait(&pool.start);
+    for (uint8_t i = 1; i < pool.num_threads; i++) {
+        pthread_join(pool.threads[i], NULL);
+    }
+    pthread_barrier_destroy(&pool.start);
+    pthread_barrier_destroy(&pool.done);
+    pthread_mutex_lock(&pool.pin_lock);
+    pool.num_threads = 1;
+    pthread_mutex_unlock(&pool.pin_lock);
+}